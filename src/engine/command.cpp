@@ -18,11 +18,98 @@ enum
 
 VARN(numargs, _numargs, MAXARGS, 0, 0);
 
+// short string values made by the script VM come from a fixed arena of slots instead of the heap:
+// the first slots are interned constants ("" and small integers) that are never freed, the rest are
+// recycled through a free list, and anything longer or past the end of the arena uses newstring
+enum
+{
+    STRSLOTSIZE = 16,
+    MINSTRCONST = -16,
+    MAXSTRCONST = 1024,
+    NUMSTRCONSTS = MAXSTRCONST - MINSTRCONST + 2,
+    NUMSTRSLOTS = 1<<14
+};
+
+static char strslots[NUMSTRSLOTS][STRSLOTSIZE];
+static int numstrslots = 0, freestrslot = -1;
+
+static void initstrslots()
+{
+    for(int i = MINSTRCONST; i <= MAXSTRCONST; i++) intformat(strslots[1 + i - MINSTRCONST], i, STRSLOTSIZE);
+    numstrslots = NUMSTRCONSTS;
+}
+
+static inline bool isstrslot(const char *s)
+{
+    return s >= strslots[0] && s < strslots[0] + sizeof(strslots);
+}
+
+static inline char *newscriptstr(size_t len)
+{
+    if(len < STRSLOTSIZE)
+    {
+        if(freestrslot >= 0)
+        {
+            char *s = strslots[freestrslot];
+            memcpy(&freestrslot, s, sizeof(freestrslot));
+            return s;
+        }
+        if(numstrslots < NUMSTRSLOTS)
+        {
+            if(!numstrslots) initstrslots();
+            return strslots[numstrslots++];
+        }
+    }
+    return newstring(len);
+}
+
+char *newscriptstr(const char *s, size_t len)
+{
+    if(!len) return strslots[0];
+    char *d = newscriptstr(len);
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+char *newscriptstr(const char *s)
+{
+    return newscriptstr(s, strlen(s));
+}
+
+char *intscriptstr(int v)
+{
+    if(v >= MINSTRCONST && v <= MAXSTRCONST)
+    {
+        if(!numstrslots) initstrslots();
+        return strslots[1 + v - MINSTRCONST];
+    }
+    return newscriptstr(intstr(v));
+}
+
+void freescriptstr(char *s)
+{
+    if(!isstrslot(s)) { delete[] s; return; }
+    int slot = int(s - strslots[0])/STRSLOTSIZE;
+    if(slot < NUMSTRCONSTS) return;
+    memcpy(s, &freestrslot, sizeof(freestrslot));
+    freestrslot = slot;
+}
+
+// hands out a string value as a heap string the caller may delete[]
+static inline char *ownscriptstr(char *s)
+{
+    if(!isstrslot(s)) return s;
+    char *d = newstring(s);
+    freescriptstr(s);
+    return d;
+}
+
 static inline void freearg(tagval &v)
 {
     switch(v.type)
     {
-        case VAL_STR: delete[] v.s; break;
+        case VAL_STR: freescriptstr(v.s); break;
         case VAL_CODE: if(v.code[-1] == CODE_START) delete[] (uchar *)&v.code[-1]; break;
     }
 }
@@ -71,12 +158,12 @@ static inline const char *forcestr(tagval &v)
     switch(v.type)
     {
         case VAL_FLOAT: s = floatstr(v.f); break;
-        case VAL_INT: s = intstr(v.i); break;
+        case VAL_INT: v.setstr(intscriptstr(v.i)); return v.s;
         case VAL_MACRO: case VAL_CSTR: s = v.s; break;
         case VAL_STR: return v.s;
     }
     freearg(v);
-    v.setstr(newstring(s));
+    v.setstr(newscriptstr(s));
     return s;
 }
 
@@ -101,6 +188,39 @@ static inline void freeargs(tagval *args, int &oldnum, int newnum)
     oldnum = newnum;
 }
 
+// tokenized form of an alias value that is used as a list: offsets of each element into buf,
+// which holds a copy of the source followed by the NUL-terminated element values
+struct parsedlist
+{
+    struct elem { int quotestart, start, end, quoteend, val, raw; };
+
+    int refs, stop;
+    vector<elem> elems;
+    vector<char> buf;
+
+    parsedlist() : refs(1), stop(0) {}
+
+    int length() const { return elems.length(); }
+    const char *src() const { return buf.getbuf(); }
+    const char *str(int i) const { return &buf[elems[i].val]; }
+    const char *rawstr(int i) const { return &buf[elems[i].raw]; }
+
+    void addref() { refs++; }
+    void release() { if(--refs <= 0) delete this; }
+};
+
+// marks an alias whose value has been used as a list once, so it is parsed into a cache on the next use
+static parsedlist pendinglist;
+
+static inline void cleanlist(ident &id)
+{
+    if(id.list)
+    {
+        if(id.list != &pendinglist) id.list->release();
+        id.list = NULL;
+    }
+}
+
 static inline void cleancode(ident &id)
 {
     if(id.code)
@@ -109,6 +229,7 @@ static inline void cleancode(ident &id)
         if(int(id.code[0]) < 0x100) delete[] id.code;
         id.code = NULL;
     }
+    cleanlist(id);
 }
 
 struct nullval : tagval
@@ -126,6 +247,7 @@ void clear_command()
             DELETEA(i.name);
             i.forcenull();
             DELETEA(i.code);
+            cleanlist(i);
         }
     });
 }
@@ -139,11 +261,11 @@ void clearoverride(ident &i)
             if(i.valtype==VAL_STR)
             {
                 if(!i.val.s[0]) break;
-                delete[] i.val.s;
+                freescriptstr(i.val.s);
             }
             cleancode(i);
             i.valtype = VAL_STR;
-            i.val.s = newstring("");
+            i.val.s = newscriptstr("", 0);
             break;
         case ID_VAR:
             *i.storage.i = i.overrideval.i;
@@ -301,7 +423,7 @@ static inline void poparg(ident &id)
 {
     if(!id.stack) return;
     identstack *stack = id.stack;
-    if(id.valtype == VAL_STR) delete[] id.val.s;
+    if(id.valtype == VAL_STR) freescriptstr(id.val.s);
     id.setval(*stack);
     cleancode(id);
     id.stack = stack->next;
@@ -410,7 +532,7 @@ static inline ident *forceident(tagval &v)
         case VAL_STR:
         {
             ident *id = newident(v.s, IDF_UNKNOWN);
-            delete[] v.s;
+            freescriptstr(v.s);
             v.setident(id);
             return id;
         }
@@ -458,7 +580,7 @@ static inline void setarg(ident &id, tagval &v)
 {
     if(aliasstack->usedargs&(1<<id.index))
     {
-        if(id.valtype == VAL_STR) delete[] id.val.s;
+        if(id.valtype == VAL_STR) freescriptstr(id.val.s);
         id.setval(v);
         cleancode(id);
     }
@@ -471,7 +593,7 @@ static inline void setarg(ident &id, tagval &v)
 
 static inline void setalias(ident &id, tagval &v)
 {
-    if(id.valtype == VAL_STR) delete[] id.val.s;
+    if(id.valtype == VAL_STR) freescriptstr(id.val.s);
     id.setval(v);
     cleancode(id);
     id.flags = (id.flags & identflags) | identflags;
@@ -787,21 +909,21 @@ void setsvarchecked(ident *id, const char *val)
     }
 }
 
-bool addcommand(const char *name, identfun fun, const char *args, int type)
+bool addcommand(const char *name, identfun fun, const char *args, int type, int flags)
 {
     uint argmask = 0;
     int numargs = 0;
     bool limit = true;
     if(args) for(const char *fmt = args; *fmt; fmt++) switch(*fmt)
     {
-        case 'i': case 'b': case 'f': case 'F': case 't': case 'T': case 'E': case 'N': case 'D': if(numargs < MAXARGS) numargs++; break;
+        case 'i': case 'b': case 'f': case 'F': case 't': case 'T': case 'E': case 'L': case 'N': case 'D': if(numargs < MAXARGS) numargs++; break;
         case 'S': case 's': case 'e': case 'r': case '$': if(numargs < MAXARGS) { argmask |= 1<<numargs; numargs++; } break;
         case '1': case '2': case '3': case '4': if(numargs < MAXARGS) fmt -= *fmt-'0'+1; break;
         case 'C': case 'V': limit = false; break;
         default: fatal("builtin %s declared with illegal type: %s", name, args); break;
     }
     if(limit && numargs > MAXCOMARGS) fatal("builtin %s declared with too many args: %d", name, numargs);
-    addident(ident(type, name, args, argmask, numargs, (void *)fun));
+    addident(ident(type, name, args, argmask, numargs, (void *)fun, flags));
     return false;
 }
 
@@ -895,7 +1017,7 @@ static char *conc(tagval *v, int n, bool space, const char *prefix, int prefixle
     }
 overflow:
     if(space) len += max(prefix ? i : i-1, 0);
-    char *buf = newstring(len + numlen);
+    char *buf = newscriptstr(len + numlen);
     int offset = 0, numoffset = 0;
     if(prefix)
     {
@@ -919,7 +1041,7 @@ overflow:
     if(i < n)
     {
         char *morebuf = conc(&v[i], n-i, space, buf, offset);
-        delete[] buf;
+        freescriptstr(buf);
         return morebuf;
     }
     return buf;
@@ -1009,6 +1131,8 @@ static inline char *cutword(const char *&p)
     return p!=word ? newstring(word, p-word) : NULL;
 }
 
+VAR(scriptopt, 0, 1, 1);
+
 #define retcode(type, defaultret) ((type) >= VAL_ANY ? ((type) == VAL_CSTR ? RET_STR : (defaultret)) : (type) << CODE_RET)
 #define retcodeint(type) retcode(type, RET_INT)
 #define retcodefloat(type) retcode(type, RET_FLOAT)
@@ -1178,13 +1302,26 @@ static inline bool getbool(const tagval &v)
     }
 }
 
+static inline bool parseintliteral(const stringslice &word, int &val)
+{
+    char buf[12];
+    if(word.len <= 0 || word.len >= int(sizeof(buf))) return false;
+    memcpy(buf, word.str, word.len);
+    buf[word.len] = '\0';
+    char *end;
+    val = int(strtol(buf, &end, 10));
+    return !*end && !strcmp(intstr(val), buf);
+}
+
 static inline void compileval(vector<uint> &code, int wordtype, const stringslice &word = stringslice(NULL, 0))
 {
+    int val;
     switch(wordtype)
     {
         case VAL_CANY: if(word.len) compilestr(code, word, true); else compilenull(code); break;
         case VAL_CSTR: compilestr(code, word, true); break;
-        case VAL_ANY: if(word.len) compilestr(code, word); else compilenull(code); break;
+        // integers that print back identically behave the same as their string, so skip allocating one on every use
+        case VAL_ANY: if(!word.len) compilenull(code); else if(scriptopt && parseintliteral(word, val)) compileint(code, val); else compilestr(code, word); break;
         case VAL_STR: compilestr(code, word); break;
         case VAL_FLOAT: compilefloat(code, word); break;
         case VAL_INT: compileint(code, word); break;
@@ -1195,6 +1332,65 @@ static inline void compileval(vector<uint> &code, int wordtype, const stringslic
     }
 }
 
+static const uint *runcode(const uint *code, tagval &result);
+
+static inline bool getconstnum(const vector<uint> &code, int &i, tagval &v)
+{
+    uint op = code[i];
+    switch(op&0xFF)
+    {
+        case CODE_VALI|RET_INT: v.setint(int(op)>>8); i++; return true;
+        case CODE_VALI|RET_FLOAT: v.setfloat(float(int(op)>>8)); i++; return true;
+        case CODE_VAL|RET_INT: v.setint(int(code[i+1])); i += 2; return true;
+        case CODE_VAL|RET_FLOAT: v.setfloat(*(const float *)&code[i+1]); i += 2; return true;
+    }
+    return false;
+}
+
+static inline bool compileconstnum(vector<uint> &code, const tagval &v)
+{
+    switch(v.type)
+    {
+        case VAL_INT: compileint(code, v.i); return true;
+        case VAL_FLOAT: compilefloat(code, v.f); return true;
+    }
+    return false;
+}
+
+static void foldconst(vector<uint> &code, int start, int rettype)
+{
+    int end = code.length()-1, i = start;
+    tagval arg;
+    while(i < end && getconstnum(code, i, arg));
+    if(i != end) return;
+    vector<uint> buf;
+    buf.reserve(end+2 - start);
+    buf.put(&code[start], end+1 - start);
+    buf.add(CODE_EXIT);
+    tagval result;
+    runcode(buf.getbuf(), result);
+    code.setsize(start);
+    if(compileconstnum(code, result)) code.add(CODE_RESULT|retcodeany(rettype));
+    else code.put(&buf[0], end+1 - start);
+    freearg(result);
+}
+
+static bool foldresult(vector<uint> &code, int start, int wordtype)
+{
+    switch(wordtype)
+    {
+        case VAL_INT: case VAL_FLOAT: case VAL_ANY: case VAL_CANY: break;
+        default: return false;
+    }
+    int i = start;
+    tagval val;
+    if(!getconstnum(code, i, val) || i+1 != code.length() || code[i] != CODE_RESULT) return false;
+    code.setsize(start);
+    forcearg(val, retcodeany(wordtype));
+    compileconstnum(code, val);
+    return true;
+}
+
 static stringslice unusedword(NULL, 0);
 static bool compilearg(vector<uint> &code, const char *&p, int wordtype, int prevargs = MAXRESULTS, stringslice &word = unusedword);
 
@@ -1273,6 +1469,7 @@ static void compilelookup(vector<uint> &code, const char *&p, int ltype, int pre
                     for(const char *fmt = id->args; *fmt; fmt++) switch(*fmt)
                     {
                         case 'S': compilestr(code); numargs++; break;
+                        case 'L':
                         case 's': compilestr(code, NULL, 0, true); numargs++; break;
                         case 'i': compileint(code); numargs++; break;
                         case 'b': compileint(code, INT_MIN); numargs++; break;
@@ -1577,8 +1774,10 @@ static bool compilearg(vector<uint> &code, const char *&p, int wordtype, int pre
             {
                 int start = code.length();
                 compilestatements(code, p, wordtype > VAL_ANY ? VAL_CANY : VAL_ANY, ')', prevargs);
-                if(code.length() > start) code.add(CODE_RESULT_ARG|retcodeany(wordtype));
-                else { compileval(code, wordtype); return true; }
+                if(code.length() <= start) { compileval(code, wordtype); return true; }
+                if(scriptopt && foldresult(code, start, wordtype)) return true;
+                if(scriptopt && (code.last()&0xFF) == CODE_COMV) code.last() += CODE_COMV_ARG - CODE_COMV + retcodeany(wordtype);
+                else code.add(CODE_RESULT_ARG|retcodeany(wordtype));
             }
             switch(wordtype)
             {
@@ -1632,6 +1831,28 @@ static bool compilearg(vector<uint> &code, const char *&p, int wordtype, int pre
     }
 }
 
+// a list argument that is just $alias passes the alias itself, so the command can reuse the alias' parsed list
+static bool compilelistarg(vector<uint> &code, const char *&p, int prevargs)
+{
+    skipcomments(p);
+    if(scriptopt && p[0] == '$')
+    {
+        const char *word = p+1, *end = parseword(word);
+        stringslice name(word, end);
+        if(name.len && *word != '$' && int(strcspn(word, "()[]")) >= name.len && !checknumber(name))
+        {
+            ident *id = newident(name, IDF_UNKNOWN);
+            if(id && id->type == ID_ALIAS)
+            {
+                code.add(CODE_IDENT|(id->index<<8));
+                p = end;
+                return true;
+            }
+        }
+    }
+    return compilearg(code, p, VAL_CSTR, prevargs);
+}
+
 static void compilestatements(vector<uint> &code, const char *&p, int rettype, int brak, int prevargs)
 {
     const char *line = p;
@@ -1716,7 +1937,7 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                     break;
                 case ID_COMMAND:
                 {
-                    int comtype = CODE_COM, fakeargs = 0;
+                    int comtype = CODE_COM, fakeargs = 0, start = code.length();
                     bool rep = false;
                     for(const char *fmt = id->args; *fmt; fmt++) switch(*fmt)
                     {
@@ -1743,6 +1964,7 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                     case 'F': if(more) more = compilearg(code, p, VAL_FLOAT, prevargs+numargs); if(!more) { if(rep) break; code.add(CODE_DUP|RET_FLOAT); fakeargs++; } numargs++; break;
                     case 'T':
                     case 't': if(more) more = compilearg(code, p, *fmt == 't' ? VAL_CANY : VAL_ANY, prevargs+numargs); if(!more) { if(rep) break; compilenull(code); fakeargs++; } numargs++; break;
+                    case 'L': if(more) more = compilelistarg(code, p, prevargs+numargs); if(!more) { if(rep) break; compilestr(code, NULL, 0, true); fakeargs++; } numargs++; break;
                     case 'E': if(more) more = compilearg(code, p, VAL_COND, prevargs+numargs); if(!more) { if(rep) break; compilenull(code); fakeargs++; } numargs++; break;
                     case 'e': if(more) more = compilearg(code, p, VAL_CODE, prevargs+numargs); if(!more) { if(rep) break; compileblock(code); fakeargs++; } numargs++; break;
                     case 'r': if(more) more = compilearg(code, p, VAL_IDENT, prevargs+numargs); if(!more) { if(rep) break; compileident(code); fakeargs++; } numargs++; break;
@@ -1756,9 +1978,11 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
                     case '1': case '2': case '3': case '4': if(more) { fmt -= *fmt-'0'+1; rep = true; } break;
                     }
                     code.add(comtype|retcodeany(rettype)|(id->index<<8));
+                    if(scriptopt && id->flags&IDF_PURE) foldconst(code, start, rettype);
                     break;
                 compilecomv:
                     code.add(comtype|retcodeany(rettype)|(numargs<<8)|(id->index<<13));
+                    if(scriptopt && id->flags&IDF_PURE) foldconst(code, start, rettype);
                     break;
                 }
                 case ID_LOCAL:
@@ -2114,7 +2338,7 @@ static inline void copyarg(tagval &dst, const tagval &src)
         case VAL_STR:
         case VAL_MACRO:
         case VAL_CSTR:
-            dst.setstr(newstring(src.s));
+            dst.setstr(newscriptstr(src.s));
             break;
         case VAL_CODE:
             dst.setcode(copycode(src.code));
@@ -2133,17 +2357,173 @@ static inline void addreleaseaction(ident *id, tagval *args, int numargs)
 }
 #endif
 
+// script profiler: call counts, inclusive and exclusive time and string allocations per ident,
+// and a call tree when scriptprof is 2
+VARF(scriptprof, 0, 0, 2, countnewstrings = scriptprof != 0);
+
+struct profstats
+{
+    int calls, depth;
+    uint allocs;
+    ullong total, self;
+
+    profstats() { reset(); }
+
+    void reset()
+    {
+        calls = depth = 0;
+        allocs = 0;
+        total = self = 0;
+    }
+};
+
+struct profnode : profstats
+{
+    int id, child, sibling;
+
+    profnode(int id = -1) : id(id), child(-1), sibling(-1) {}
+};
+
+struct profframe
+{
+    int id, node;
+    uint allocs, childallocs;
+    ullong start, childtime;
+};
+
+static vector<profstats> profidents;
+static vector<profnode> proftree;
+static vector<profframe> profstack;
+
+static int profchild(int parent, int id)
+{
+    for(int i = proftree[parent].child; i >= 0; i = proftree[i].sibling) if(proftree[i].id == id) return i;
+    int n = proftree.length();
+    proftree.add(profnode(id)).sibling = proftree[parent].child;
+    proftree[parent].child = n;
+    return n;
+}
+
+static void profbegin(ident *id)
+{
+    while(profidents.length() <= id->index) profidents.add();
+    profidents[id->index].depth++;
+    int node = -1;
+    if(scriptprof > 1)
+    {
+        if(proftree.empty()) proftree.add();
+        node = profchild(profstack.length() ? max(profstack.last().node, 0) : 0, id->index);
+    }
+    profframe &f = profstack.add();
+    f.id = id->index;
+    f.node = node;
+    f.allocs = numnewstrings;
+    f.childallocs = 0;
+    f.childtime = 0;
+    f.start = getmicroseconds();
+}
+
+static void profend()
+{
+    ullong elapsed = getmicroseconds() - profstack.last().start;
+    profframe &f = profstack.pop();
+    uint allocs = numnewstrings - f.allocs;
+    profstats &s = profidents[f.id];
+    s.calls++;
+    s.self += elapsed - f.childtime;
+    s.allocs += allocs - f.childallocs;
+    // recursive calls are already covered by the outermost one
+    if(--s.depth <= 0) s.total += elapsed;
+    if(f.node >= 0)
+    {
+        profnode &n = proftree[f.node];
+        n.calls++;
+        n.total += elapsed;
+        n.self += elapsed - f.childtime;
+        n.allocs += allocs - f.childallocs;
+    }
+    if(profstack.length())
+    {
+        profframe &parent = profstack.last();
+        parent.childtime += elapsed;
+        parent.childallocs += allocs;
+    }
+}
+
+void profchanged(ident *id)
+{
+    profbegin(id);
+    id->fun(id);
+    profend();
+}
+
+static bool profselfcmp(int x, int y) { return profidents[x].self > profidents[y].self; }
+static bool proftotalcmp(int x, int y) { return proftree[x].total > proftree[y].total; }
+
+static void printproftree(int parent, int depth, ullong mintime)
+{
+    vector<int> children;
+    for(int i = proftree[parent].child; i >= 0; i = proftree[i].sibling) if(proftree[i].calls && proftree[i].total >= mintime) children.add(i);
+    children.sort(proftotalcmp);
+    loopv(children)
+    {
+        profnode &n = proftree[children[i]];
+        conoutf("%*s%s: %d calls, %.3f ms total, %.3f ms self, %u allocs", 2*depth, "", identmap[n.id]->name, n.calls, n.total/1000.0, n.self/1000.0, n.allocs);
+        if(depth < 32) printproftree(children[i], depth+1, mintime);
+    }
+}
+
+void printscriptprof(int limit)
+{
+    vector<int> order;
+    ullong profiled = 0;
+    loopv(profidents) if(profidents[i].calls) { order.add(i); profiled += profidents[i].self; }
+    if(order.empty()) { conoutf("no script profile recorded"); return; }
+    order.sort(profselfcmp);
+    conoutf("script profile: %d idents, %.3f ms", order.length(), profiled/1000.0);
+    conoutf("%10s %12s %12s %10s  %s", "calls", "total ms", "self ms", "allocs", "ident");
+    loopv(order)
+    {
+        if(limit > 0 && i >= limit) { conoutf("(%d more)", order.length() - i); break; }
+        profstats &s = profidents[order[i]];
+        conoutf("%10d %12.3f %12.3f %10u  %s", s.calls, s.total/1000.0, s.self/1000.0, s.allocs, identmap[order[i]]->name);
+    }
+    if(proftree.length() > 1)
+    {
+        // calls under 1% of the profiled time are left out of the tree
+        conoutf("script call tree:");
+        printproftree(0, 0, profiled/100);
+    }
+}
+
+void resetscriptprof()
+{
+    // calls still in progress keep their frames, so only clear the counters
+    loopv(profidents) profidents[i].reset();
+    loopv(proftree) proftree[i].reset();
+}
+
+void dumpscriptprof()
+{
+    if(profidents.length()) printscriptprof(-1);
+}
+
+ICOMMAND(scriptprofreport, "b", (int *limit), printscriptprof(*limit != INT_MIN ? *limit : 20));
+COMMAND(resetscriptprof, "");
+
 static inline void callcommand(ident *id, tagval *args, int numargs, bool lookup = false)
 {
-    int i = -1, fakeargs = 0;
+    int i = -1, fakeargs = 0, profiling = scriptprof;
     bool rep = false;
+    if(profiling) profbegin(id);
     for(const char *fmt = id->args; *fmt; fmt++) switch(*fmt)
     {
         case 'i': if(++i >= numargs) { if(rep) break; args[i].setint(0); fakeargs++; } else forceint(args[i]); break;
         case 'b': if(++i >= numargs) { if(rep) break; args[i].setint(INT_MIN); fakeargs++; } else forceint(args[i]); break;
         case 'f': if(++i >= numargs) { if(rep) break; args[i].setfloat(0.0f); fakeargs++; } else forcefloat(args[i]); break;
         case 'F': if(++i >= numargs) { if(rep) break; args[i].setfloat(args[i-1].getfloat()); fakeargs++; } else forcefloat(args[i]); break;
-        case 'S': if(++i >= numargs) { if(rep) break; args[i].setstr(newstring("")); fakeargs++; } else forcestr(args[i]); break;
+        case 'S': if(++i >= numargs) { if(rep) break; args[i].setstr(newscriptstr("", 0)); fakeargs++; } else forcestr(args[i]); break;
+        case 'L':
         case 's': if(++i >= numargs) { if(rep) break; args[i].setcstr(""); fakeargs++; } else forcestr(args[i]); break;
         case 'T':
         case 't': if(++i >= numargs) { if(rep) break; args[i].setnull(); fakeargs++; } break;
@@ -2192,6 +2572,7 @@ static inline void callcommand(ident *id, tagval *args, int numargs, bool lookup
 cleanup:
     loopk(i) freearg(args[k]);
     for(; i < numargs; i++) freearg(args[i]);
+    if(profiling) profend();
 }
 
 #define MAXRUNDEPTH 255
@@ -2223,16 +2604,16 @@ static const uint *runcode(const uint *code, tagval &result)
                     continue;
 
             RETOP(CODE_NULL|RET_NULL, result.setnull())
-            RETOP(CODE_NULL|RET_STR, result.setstr(newstring("")))
+            RETOP(CODE_NULL|RET_STR, result.setstr(newscriptstr("", 0)))
             RETOP(CODE_NULL|RET_INT, result.setint(0))
             RETOP(CODE_NULL|RET_FLOAT, result.setfloat(0.0f))
 
-            RETOP(CODE_FALSE|RET_STR, result.setstr(newstring("0")))
+            RETOP(CODE_FALSE|RET_STR, result.setstr(intscriptstr(0)))
             case CODE_FALSE|RET_NULL:
             RETOP(CODE_FALSE|RET_INT, result.setint(0))
             RETOP(CODE_FALSE|RET_FLOAT, result.setfloat(0.0f))
 
-            RETOP(CODE_TRUE|RET_STR, result.setstr(newstring("1")))
+            RETOP(CODE_TRUE|RET_STR, result.setstr(intscriptstr(1)))
             case CODE_TRUE|RET_NULL:
             RETOP(CODE_TRUE|RET_INT, result.setint(1))
             RETOP(CODE_TRUE|RET_FLOAT, result.setfloat(1.0f))
@@ -2240,7 +2621,7 @@ static const uint *runcode(const uint *code, tagval &result)
             #define RETPOP(op, val) \
                 RETOP(op, { --numargs; val; freearg(args[numargs]); })
 
-            RETPOP(CODE_NOT|RET_STR, result.setstr(newstring(getbool(args[numargs]) ? "0" : "1")))
+            RETPOP(CODE_NOT|RET_STR, result.setstr(intscriptstr(getbool(args[numargs]) ? 0 : 1)))
             case CODE_NOT|RET_NULL:
             RETPOP(CODE_NOT|RET_INT, result.setint(getbool(args[numargs]) ? 0 : 1))
             RETPOP(CODE_NOT|RET_FLOAT, result.setfloat(getbool(args[numargs]) ? 0.0f : 1.0f))
@@ -2354,14 +2735,14 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_VAL|RET_STR:
             {
                 uint len = op>>8;
-                args[numargs++].setstr(newstring((const char *)code, len));
+                args[numargs++].setstr(newscriptstr((const char *)code, len));
                 code += len/sizeof(uint) + 1;
                 continue;
             }
             case CODE_VALI|RET_STR:
             {
                 char s[4] = { char((op>>8)&0xFF), char((op>>16)&0xFF), char((op>>24)&0xFF), '\0' };
-                args[numargs++].setstr(newstring(s));
+                args[numargs++].setstr(newscriptstr(s));
                 continue;
             }
             case CODE_VAL|RET_NULL:
@@ -2374,7 +2755,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_DUP|RET_NULL: args[numargs-1].getval(args[numargs]); numargs++; continue;
             case CODE_DUP|RET_INT: args[numargs].setint(args[numargs-1].getint()); numargs++; continue;
             case CODE_DUP|RET_FLOAT: args[numargs].setfloat(args[numargs-1].getfloat()); numargs++; continue;
-            case CODE_DUP|RET_STR: args[numargs].setstr(newstring(args[numargs-1].getstr())); numargs++; continue;
+            case CODE_DUP|RET_STR: args[numargs].setstr(newscriptstr(args[numargs-1].getstr())); numargs++; continue;
 
             case CODE_FORCE|RET_STR: forcestr(args[numargs-1]); continue;
             case CODE_FORCE|RET_INT: forceint(args[numargs-1]); continue;
@@ -2497,11 +2878,11 @@ static const uint *runcode(const uint *code, tagval &result)
                     nval; \
                     continue; \
                 }
-                LOOKUPU(arg.setstr(newstring(id->getstr())),
-                        arg.setstr(newstring(*id->storage.s)),
-                        arg.setstr(newstring(intstr(*id->storage.i))),
-                        arg.setstr(newstring(floatstr(*id->storage.f))),
-                        arg.setstr(newstring("")));
+                LOOKUPU(arg.setstr(newscriptstr(id->getstr())),
+                        arg.setstr(newscriptstr(*id->storage.s)),
+                        arg.setstr(intscriptstr(*id->storage.i)),
+                        arg.setstr(newscriptstr(floatstr(*id->storage.f))),
+                        arg.setstr(newscriptstr("", 0)));
             case CODE_LOOKUP|RET_STR:
                 #define LOOKUP(aval) { \
                     ident *id = identmap[op>>8]; \
@@ -2509,7 +2890,7 @@ static const uint *runcode(const uint *code, tagval &result)
                     aval; \
                     continue; \
                 }
-                LOOKUP(args[numargs++].setstr(newstring(id->getstr())));
+                LOOKUP(args[numargs++].setstr(newscriptstr(id->getstr())));
             case CODE_LOOKUPARG|RET_STR:
                 #define LOOKUPARG(aval, nval) { \
                     ident *id = identmap[op>>8]; \
@@ -2517,7 +2898,7 @@ static const uint *runcode(const uint *code, tagval &result)
                     aval; \
                     continue; \
                 }
-                LOOKUPARG(args[numargs++].setstr(newstring(id->getstr())), args[numargs++].setstr(newstring("")));
+                LOOKUPARG(args[numargs++].setstr(newscriptstr(id->getstr())), args[numargs++].setstr(newscriptstr("", 0)));
             case CODE_LOOKUPU|RET_INT:
                 LOOKUPU(arg.setint(id->getint()),
                         arg.setint(parseint(*id->storage.s)),
@@ -2540,7 +2921,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 LOOKUPARG(args[numargs++].setfloat(id->getfloat()), args[numargs++].setfloat(0.0f));
             case CODE_LOOKUPU|RET_NULL:
                 LOOKUPU(id->getval(arg),
-                        arg.setstr(newstring(*id->storage.s)),
+                        arg.setstr(newscriptstr(*id->storage.s)),
                         arg.setint(*id->storage.i),
                         arg.setfloat(*id->storage.f),
                         arg.setnull());
@@ -2552,8 +2933,8 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_LOOKUPMU|RET_STR:
                 LOOKUPU(id->getcstr(arg),
                         arg.setcstr(*id->storage.s),
-                        arg.setstr(newstring(intstr(*id->storage.i))),
-                        arg.setstr(newstring(floatstr(*id->storage.f))),
+                        arg.setstr(intscriptstr(*id->storage.i)),
+                        arg.setstr(newscriptstr(floatstr(*id->storage.f))),
                         arg.setcstr(""));
             case CODE_LOOKUPM|RET_STR:
                 LOOKUP(id->getcstr(args[numargs++]));
@@ -2570,21 +2951,21 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_LOOKUPMARG|RET_NULL:
                 LOOKUPARG(id->getcval(args[numargs++]), args[numargs++].setnull());
 
-            case CODE_SVAR|RET_STR: case CODE_SVAR|RET_NULL: args[numargs++].setstr(newstring(*identmap[op>>8]->storage.s)); continue;
+            case CODE_SVAR|RET_STR: case CODE_SVAR|RET_NULL: args[numargs++].setstr(newscriptstr(*identmap[op>>8]->storage.s)); continue;
             case CODE_SVAR|RET_INT: args[numargs++].setint(parseint(*identmap[op>>8]->storage.s)); continue;
             case CODE_SVAR|RET_FLOAT: args[numargs++].setfloat(parsefloat(*identmap[op>>8]->storage.s)); continue;
             case CODE_SVARM: args[numargs++].setcstr(*identmap[op>>8]->storage.s); continue;
             case CODE_SVAR1: setsvarchecked(identmap[op>>8], args[--numargs].s); freearg(args[numargs]); continue;
 
             case CODE_IVAR|RET_INT: case CODE_IVAR|RET_NULL: args[numargs++].setint(*identmap[op>>8]->storage.i); continue;
-            case CODE_IVAR|RET_STR: args[numargs++].setstr(newstring(intstr(*identmap[op>>8]->storage.i))); continue;
+            case CODE_IVAR|RET_STR: args[numargs++].setstr(intscriptstr(*identmap[op>>8]->storage.i)); continue;
             case CODE_IVAR|RET_FLOAT: args[numargs++].setfloat(float(*identmap[op>>8]->storage.i)); continue;
             case CODE_IVAR1: setvarchecked(identmap[op>>8], args[--numargs].i); continue;
             case CODE_IVAR2: numargs -= 2; setvarchecked(identmap[op>>8], (args[numargs].i<<16)|(args[numargs+1].i<<8)); continue;
             case CODE_IVAR3: numargs -= 3; setvarchecked(identmap[op>>8], (args[numargs].i<<16)|(args[numargs+1].i<<8)|args[numargs+2].i); continue;
 
             case CODE_FVAR|RET_FLOAT: case CODE_FVAR|RET_NULL: args[numargs++].setfloat(*identmap[op>>8]->storage.f); continue;
-            case CODE_FVAR|RET_STR: args[numargs++].setstr(newstring(floatstr(*identmap[op>>8]->storage.f))); continue;
+            case CODE_FVAR|RET_STR: args[numargs++].setstr(newscriptstr(floatstr(*identmap[op>>8]->storage.f))); continue;
             case CODE_FVAR|RET_INT: args[numargs++].setint(int(*identmap[op>>8]->storage.f)); continue;
             case CODE_FVAR1: setfvarchecked(identmap[op>>8], args[--numargs].f); continue;
 
@@ -2592,9 +2973,11 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_COM|RET_NULL: case CODE_COM|RET_STR: case CODE_COM|RET_FLOAT: case CODE_COM|RET_INT:
             {
                 ident *id = identmap[op>>8];
-                int offset = numargs-id->numargs;
+                int offset = numargs-id->numargs, profiling = scriptprof;
                 forcenull(result);
+                if(profiling) profbegin(id);
                 CALLCOM(id->numargs)
+                if(profiling) profend();
                 forcearg(result, op&CODE_RET_MASK);
                 freeargs(args, numargs, offset);
                 continue;
@@ -2603,9 +2986,11 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_COMD|RET_NULL: case CODE_COMD|RET_STR: case CODE_COMD|RET_FLOAT: case CODE_COMD|RET_INT:
             {
                 ident *id = identmap[op>>8];
-                int offset = numargs-(id->numargs-1);
+                int offset = numargs-(id->numargs-1), profiling = scriptprof;
                 addreleaseaction(id, &args[offset], id->numargs-1);
+                if(profiling) profbegin(id);
                 CALLCOM(id->numargs)
+                if(profiling) profend();
                 forcearg(result, op&CODE_RET_MASK);
                 freeargs(args, numargs, offset);
                 continue;
@@ -2616,23 +3001,41 @@ static const uint *runcode(const uint *code, tagval &result)
             case CODE_COMV|RET_NULL: case CODE_COMV|RET_STR: case CODE_COMV|RET_FLOAT: case CODE_COMV|RET_INT:
             {
                 ident *id = identmap[op>>13];
-                int callargs = (op>>8)&0x1F, offset = numargs-callargs;
+                int callargs = (op>>8)&0x1F, offset = numargs-callargs, profiling = scriptprof;
+                forcenull(result);
+                if(profiling) profbegin(id);
+                ((comfunv)id->fun)(&args[offset], callargs);
+                if(profiling) profend();
+                forcearg(result, op&CODE_RET_MASK);
+                freeargs(args, numargs, offset);
+                continue;
+            }
+            case CODE_COMV_ARG|RET_NULL: case CODE_COMV_ARG|RET_STR: case CODE_COMV_ARG|RET_FLOAT: case CODE_COMV_ARG|RET_INT:
+            {
+                ident *id = identmap[op>>13];
+                int callargs = (op>>8)&0x1F, offset = numargs-callargs, profiling = scriptprof;
                 forcenull(result);
+                if(profiling) profbegin(id);
                 ((comfunv)id->fun)(&args[offset], callargs);
+                if(profiling) profend();
                 forcearg(result, op&CODE_RET_MASK);
                 freeargs(args, numargs, offset);
+                args[numargs++] = result;
+                result.setnull();
                 continue;
             }
             case CODE_COMC|RET_NULL: case CODE_COMC|RET_STR: case CODE_COMC|RET_FLOAT: case CODE_COMC|RET_INT:
             {
                 ident *id = identmap[op>>13];
-                int callargs = (op>>8)&0x1F, offset = numargs-callargs;
+                int callargs = (op>>8)&0x1F, offset = numargs-callargs, profiling = scriptprof;
                 forcenull(result);
+                if(profiling) profbegin(id);
                 {
                     vector<char> buf;
                     buf.reserve(MAXSTRLEN);
                     ((comfun1)id->fun)(conc(buf, &args[offset], callargs, true));
                 }
+                if(profiling) profend();
                 forcearg(result, op&CODE_RET_MASK);
                 freeargs(args, numargs, offset);
                 continue;
@@ -2681,6 +3084,8 @@ static const uint *runcode(const uint *code, tagval &result)
                     continue; \
                 }
                 #define CALLALIAS { \
+                    int profiling = scriptprof; \
+                    if(profiling) profbegin(id); \
                     identstack argstack[MAXARGS]; \
                     for(int i = 0; i < callargs; i++) \
                         pusharg(*identmap[i], args[offset + i], argstack[i]); \
@@ -2702,6 +3107,7 @@ static const uint *runcode(const uint *code, tagval &result)
                         poparg(*identmap[i]); \
                     for(int argmask = aliaslink.usedargs&(~0<<callargs), i = callargs; argmask; i++) \
                         if(argmask&(1<<i)) { poparg(*identmap[i]); argmask &= ~(1<<i); } \
+                    if(profiling) profend(); \
                     forcearg(result, op&CODE_RET_MASK); \
                     _numargs = oldargs; \
                     numargs = SKIPARGS(offset); \
@@ -2868,7 +3274,7 @@ char *executestr(const uint *code)
     runcode(code, result);
     if(result.type == VAL_NULL) return NULL;
     forcestr(result);
-    return result.s;
+    return ownscriptstr(result.s);
 }
 
 char *executestr(const char *p)
@@ -2877,7 +3283,7 @@ char *executestr(const char *p)
     executeret(p, result);
     if(result.type == VAL_NULL) return NULL;
     forcestr(result);
-    return result.s;
+    return ownscriptstr(result.s);
 }
 
 char *executestr(ident *id, tagval *args, int numargs, bool lookup)
@@ -2886,7 +3292,7 @@ char *executestr(ident *id, tagval *args, int numargs, bool lookup)
     executeret(id, args, numargs, lookup, result);
     if(result.type == VAL_NULL) return NULL;
     forcestr(result);
-    return result.s;
+    return ownscriptstr(result.s);
 }
 
 char *execidentstr(const char *name, bool lookup)
@@ -2998,11 +3404,191 @@ bool execidentbool(const char *name, bool noid, bool lookup)
     return id ? executebool(id, NULL, 0, lookup) : noid;
 }
 
+// compiled configs are cached in the home dir, keyed by the size, mtime and CRC of their source, and with
+// ident references stored by name and type so they can be relinked against the idents of the current session
+VAR(cfgcache, 0, 1, 1);
+
+#define CFGCACHE_MAGIC "TCFC"
+#define CFGCACHE_VERSION 2
+#define CFGCACHE_UNKNOWN 0x80
+
+struct cfgcacheheader
+{
+    char magic[4];
+    int version;
+    llong mtime;
+    uint builtins, crc;
+    int scriptopt, size, numnames, namelen, codelen;
+};
+
+static struct cfgstats
+{
+    int files, cached;
+    ullong read, compile, cache, run;
+} cfgstats = { 0, 0, 0, 0, 0, 0 };
+
+static inline int codeidentshift(uint op)
+{
+    switch(op&CODE_OP_MASK)
+    {
+        case CODE_IDENT: case CODE_IDENTARG:
+        case CODE_COM: case CODE_COMD:
+        case CODE_SVAR: case CODE_SVARM: case CODE_SVAR1:
+        case CODE_IVAR: case CODE_IVAR1: case CODE_IVAR2: case CODE_IVAR3:
+        case CODE_FVAR: case CODE_FVAR1:
+        case CODE_LOOKUP: case CODE_LOOKUPARG: case CODE_LOOKUPM: case CODE_LOOKUPMARG:
+        case CODE_ALIAS: case CODE_ALIASARG:
+        case CODE_PRINT:
+            return 8;
+        case CODE_COMV: case CODE_COMC: case CODE_COMV_ARG:
+        case CODE_CALL: case CODE_CALLARG:
+            return 13;
+    }
+    return 0;
+}
+
+static inline int codedatalen(uint op)
+{
+    switch(op&0xFF)
+    {
+        case CODE_MACRO: case CODE_VAL|RET_STR: return (op>>8)/sizeof(uint) + 1;
+        case CODE_VAL|RET_INT: case CODE_VAL|RET_FLOAT: return 1;
+    }
+    return 0;
+}
+
+// rewrites the ident indexes in code through remap; when used is given, remap is built as it goes by
+// numbering the idents in order of first use
+static bool remapcodeidents(uint *code, int len, vector<int> &remap, vector<int> *used = NULL)
+{
+    for(int i = 1; i < len; i += codedatalen(code[i]) + 1)
+    {
+        uint op = code[i];
+        int shift = codeidentshift(op);
+        if(!shift) continue;
+        int index = op>>shift;
+        if(used)
+        {
+            while(remap.length() <= index) remap.add(-1);
+            if(remap[index] < 0) { remap[index] = used->length(); used->add(index); }
+        }
+        else if(index >= remap.length()) return false;
+        code[i] = (op&((1<<shift)-1)) | (remap[index]<<shift);
+    }
+    return true;
+}
+
+static uint builtinsignature()
+{
+    static uint sig = 0;
+    if(!sig)
+    {
+        sig = crc32(0, NULL, 0);
+        loopv(identmap)
+        {
+            ident &id = *identmap[i];
+            if(id.type == ID_ALIAS) continue;
+            sig = crc32(sig, (const Bytef *)id.name, strlen(id.name)+1);
+            sig = crc32(sig, (const Bytef *)&id.type, sizeof(id.type));
+            if(id.type == ID_COMMAND && id.args) sig = crc32(sig, (const Bytef *)id.args, strlen(id.args)+1);
+        }
+    }
+    return sig;
+}
+
+// configs the engine writes itself change on every run, so caching them would only rewrite their entry at each startup
+static bool cfgcacheable(const char *cfgfile)
+{
+#ifndef STANDALONE
+    if(!strcmp(cfgfile, game::savedconfig()) || !strcmp(cfgfile, game::restoreconfig())) return false;
+#endif
+    return true;
+}
+
+static bool getcfgcachename(char *cachename, const char *cfgfile)
+{
+    if(cfgfile[0] == PATHDIV || strchr(cfgfile, ':') || strstr(cfgfile, "..")) return false;
+    nformatstring(cachename, MAXSTRLEN, "cache%c%s.cfc", PATHDIV, cfgfile);
+    return true;
+}
+
+static bool loadcfgcache(const char *cachename, const cfgcacheheader &key, vector<uint> &code)
+{
+    stream *f = openrawfile(cachename, "rb");
+    if(!f) return false;
+    cfgcacheheader hdr;
+    bool valid = f->read(&hdr, sizeof(hdr)) == sizeof(hdr) && !memcmp(hdr.magic, key.magic, sizeof(hdr.magic)) &&
+                 hdr.version == key.version && hdr.mtime == key.mtime && hdr.builtins == key.builtins && hdr.crc == key.crc &&
+                 hdr.scriptopt == key.scriptopt && hdr.size == key.size &&
+                 hdr.numnames >= 0 && hdr.namelen >= 0 && hdr.codelen >= 2;
+    if(valid)
+    {
+        vector<char> names;
+        valid = f->read(names.reserve(hdr.namelen+1).buf, hdr.namelen) == hdr.namelen;
+        if(valid)
+        {
+            names.advance(hdr.namelen);
+            names.add('\0');
+            vector<uchar> types;
+            valid = f->read(types.reserve(hdr.numnames).buf, hdr.numnames) == hdr.numnames;
+            if(valid) types.advance(hdr.numnames);
+            vector<int> remap;
+            for(const char *name = names.getbuf(), *end = name + hdr.namelen; valid && remap.length() < hdr.numnames && name < end; name += strlen(name)+1)
+            {
+                // the code was compiled against an ident of this type, and only an unknown alias may be created in its place
+                int type = types[remap.length()];
+                ident *id = idents.access(name);
+                if(id ? id->type != (type&~CFGCACHE_UNKNOWN) : type != (ID_ALIAS|CFGCACHE_UNKNOWN)) valid = false;
+                else remap.add(id ? id->index : newident(name, IDF_UNKNOWN)->index);
+            }
+            valid = valid && remap.length() == hdr.numnames &&
+                    f->read(code.reserve(hdr.codelen).buf, hdr.codelen*int(sizeof(uint))) == hdr.codelen*int(sizeof(uint));
+            if(valid)
+            {
+                code.advance(hdr.codelen);
+                valid = code[0] == CODE_START && remapcodeidents(code.getbuf(), code.length(), remap);
+            }
+        }
+    }
+    delete f;
+    if(!valid) code.setsize(0);
+    return valid;
+}
+
+static void savecfgcache(const char *cachename, cfgcacheheader &hdr, const vector<uint> &code)
+{
+    vector<uint> relinked;
+    relinked.put(code.getbuf(), code.length());
+    vector<int> remap, used;
+    remapcodeidents(relinked.getbuf(), relinked.length(), remap, &used);
+    vector<char> names;
+    vector<uchar> types;
+    loopv(used)
+    {
+        const ident &id = *identmap[used[i]];
+        names.put(id.name, strlen(id.name)+1);
+        types.add(id.type | (id.type == ID_ALIAS && id.flags&IDF_UNKNOWN ? CFGCACHE_UNKNOWN : 0));
+    }
+    stream *f = openrawfile(cachename, "wb");
+    if(!f) return;
+    hdr.numnames = used.length();
+    hdr.namelen = names.length();
+    hdr.codelen = relinked.length();
+    f->write(&hdr, sizeof(hdr));
+    f->write(names.getbuf(), names.length());
+    f->write(types.getbuf(), types.length());
+    f->write(relinked.getbuf(), relinked.length()*sizeof(uint));
+    delete f;
+}
+
 bool execfile(const char *cfgfile, bool msg)
 {
-    string s;
+    static int execdepth = 0;
+    string s, cachename;
     copystring(s, cfgfile);
-    char *buf = loadfile(path(s), NULL);
+    ullong start = getmicroseconds();
+    int len = 0;
+    char *buf = loadfile(path(s), &len);
     if(!buf)
     {
         if(msg) conoutf(CON_ERROR, "could not read \"%s\"", cfgfile);
@@ -3011,7 +3597,51 @@ bool execfile(const char *cfgfile, bool msg)
     const char *oldsourcefile = sourcefile, *oldsourcestr = sourcestr;
     sourcefile = cfgfile;
     sourcestr = buf;
-    execute(buf);
+    cfgstats.files++;
+
+    vector<uint> code;
+    cfgcacheheader key;
+    bool usecache = cfgcache && cfgcacheable(cfgfile) && getcfgcachename(cachename, s);
+    if(usecache)
+    {
+        memset(&key, 0, sizeof(key));
+        memcpy(key.magic, CFGCACHE_MAGIC, sizeof(key.magic));
+        key.version = CFGCACHE_VERSION;
+        key.mtime = getfilemtime(s);
+        key.builtins = builtinsignature();
+        key.crc = crc32(crc32(0, NULL, 0), (const Bytef *)buf, len);
+        key.scriptopt = scriptopt;
+        key.size = len;
+    }
+    ullong loaded = getmicroseconds();
+    cfgstats.read += loaded - start;
+    if(usecache && loadcfgcache(cachename, key, code))
+    {
+        cfgstats.cached++;
+        cfgstats.cache += getmicroseconds() - loaded;
+    }
+    else
+    {
+        code.reserve(64);
+        compilemain(code, buf, VAL_INT);
+        ullong compiled = getmicroseconds();
+        cfgstats.compile += compiled - loaded;
+        if(usecache)
+        {
+            savecfgcache(cachename, key, code);
+            cfgstats.cache += getmicroseconds() - compiled;
+        }
+    }
+
+    ullong runstart = getmicroseconds();
+    execdepth++;
+    tagval result;
+    runcode(code.getbuf()+1, result);
+    if(int(code[0]) >= 0x100) code.disown();
+    freearg(result);
+    // nested execs are already counted in the run time of the outermost one
+    if(!--execdepth) cfgstats.run += getmicroseconds() - runstart;
+
     sourcefile = oldsourcefile;
     sourcestr = oldsourcestr;
     delete[] buf;
@@ -3019,6 +3649,13 @@ bool execfile(const char *cfgfile, bool msg)
 }
 ICOMMAND(exec, "s", (char *file), execfile(file));
 
+void printcfgstats()
+{
+    conoutf("cfg: %d files (%d cached), %.1f ms read, %.1f ms compile, %.1f ms cache, %.1f ms run",
+        cfgstats.files, cfgstats.cached, cfgstats.read/1000.0, cfgstats.compile/1000.0, cfgstats.cache/1000.0, cfgstats.run/1000.0);
+}
+COMMAND(printcfgstats, "");
+
 const char *escapestring(const char *s)
 {
     stridx = (stridx + 1)%4;
@@ -3205,7 +3842,7 @@ void loopiter(ident *id, identstack &stack, const tagval &v)
     }
     else
     {
-        if(id->valtype == VAL_STR) delete[] id->val.s;
+        if(id->valtype == VAL_STR) freescriptstr(id->val.s);
         cleancode(*id);
         id->setval(v);
     }
@@ -3222,7 +3859,7 @@ static inline void setiter(ident &id, int i, identstack &stack)
     {
         if(id.valtype != VAL_INT)
         {
-            if(id.valtype == VAL_STR) delete[] id.val.s;
+            if(id.valtype == VAL_STR) freescriptstr(id.val.s);
             cleancode(id);
             id.valtype = VAL_INT;
         }
@@ -3407,15 +4044,23 @@ static bool parselist(const char *&s, const char *&start = liststart, const char
     return true;
 }
 
-static inline char *listelem(const char *start = liststart, const char *end = listend, const char *quotestart = listquotestart)
+static inline char *copyelem(char *s, const char *start, const char *end, const char *quotestart)
 {
-    size_t len = end-start;
-    char *s = newstring(len);
     if(*quotestart == '"') unescapestring(s, start, end);
-    else copystring(s, start, len+1);
+    else copystring(s, start, end-start+1);
     return s;
 }
 
+static inline char *listelem(const char *start = liststart, const char *end = listend, const char *quotestart = listquotestart)
+{
+    return copyelem(newstring(end-start), start, end, quotestart);
+}
+
+static inline char *scriptelem(const char *start, const char *end, const char *quotestart)
+{
+    return start < end ? copyelem(newscriptstr(end-start), start, end, quotestart) : newscriptstr("", 0);
+}
+
 void explodelist(const char *s, vector<char *> &elems, int limit)
 {
     const char *start, *end, *qstart;
@@ -3430,28 +4075,147 @@ char *indexlist(const char *s, int pos)
     return parselist(s, start, end, qstart) ? listelem(start, end, qstart) : newstring("");
 }
 
+static parsedlist *buildlist(const char *s)
+{
+    parsedlist *l = new parsedlist;
+    l->buf.put(s, strlen(s)+1);
+    const char *p = s, *start, *end, *qstart, *qend;
+    while(parselist(p, start, end, qstart, qend))
+    {
+        parsedlist::elem &e = l->elems.add();
+        e.quotestart = qstart-s;
+        e.start = start-s;
+        e.end = end-s;
+        e.quoteend = qend-s;
+        e.val = e.raw = l->buf.length();
+        int len = end-start;
+        if(*qstart == '"')
+        {
+            int unescaped = unescapestring(l->buf.reserve(len+1).buf, start, end);
+            l->buf.advance(unescaped+1);
+            if(unescaped == len) continue;
+            e.raw = l->buf.length();
+        }
+        l->buf.put(start, len);
+        l->buf.add('\0');
+    }
+    l->stop = p-s;
+    return l;
+}
+
+static const char *getlist(tagval &arg, parsedlist *&list)
+{
+    list = NULL;
+    if(arg.type != VAL_IDENT) return arg.getstr();
+    ident &id = *arg.id;
+    if(id.index < MAXARGS && !(aliasstack->usedargs&(1<<id.index))) return "";
+    if(id.flags&IDF_UNKNOWN) debugcode("unknown alias lookup: %s", id.name);
+    switch(id.valtype)
+    {
+        case VAL_STR: case VAL_MACRO: case VAL_CSTR:
+            if(!id.list) id.list = &pendinglist;
+            else
+            {
+                if(id.list == &pendinglist) id.list = buildlist(id.val.s);
+                list = id.list;
+            }
+            return id.val.s;
+    }
+    return id.getstr();
+}
+
+// walks a list argument, over its alias' parsed list when it has one and by parsing the string otherwise
+struct listparser
+{
+    parsedlist *list;
+    const char *s, *start, *end, *quotestart, *quoteend;
+    int n;
+
+    listparser(tagval &arg) : n(0)
+    {
+        s = getlist(arg, list);
+        if(list) list->addref();
+    }
+    ~listparser() { if(list) list->release(); }
+
+    void seek(int i)
+    {
+        n = i;
+        s = list->src() + (n < list->length() ? list->elems[n].quotestart : list->stop);
+    }
+
+    bool next()
+    {
+        if(!list) return parselist(s, start, end, quotestart, quoteend);
+        if(n >= list->length()) return false;
+        const char *src = list->src();
+        const parsedlist::elem &e = list->elems[n];
+        start = src + e.start;
+        end = src + e.end;
+        quotestart = src + e.quotestart;
+        quoteend = src + e.quoteend;
+        seek(n+1);
+        return true;
+    }
+
+    bool skip(int num)
+    {
+        if(num <= 0) return true;
+        if(!list) { loopi(num) if(!parselist(s)) return false; return true; }
+        if(num > list->length() - n) { seek(list->length()); return false; }
+        seek(n + num);
+        return true;
+    }
+
+    int length()
+    {
+        if(list) return list->length();
+        int len = 0;
+        for(const char *p = s; parselist(p);) len++;
+        return len;
+    }
+
+    void getelem(tagval &v)
+    {
+        if(list) v.setcstr(list->str(n-1));
+        else v.setstr(scriptelem(start, end, quotestart));
+    }
+
+    void getraw(tagval &v)
+    {
+        if(list) v.setcstr(list->rawstr(n-1));
+        else v.setstr(newscriptstr(start, end-start));
+    }
+};
+
 int listlen(const char *s)
 {
     int n = 0;
     while(parselist(s)) n++;
     return n;
 }
-ICOMMAND(listlen, "s", (char *s), intret(listlen(s)));
+ICOMMAND(listlen, "L", (tagval *list), intret(listparser(*list).length()));
 
 void at(tagval *args, int numargs)
 {
     if(!numargs) return;
-    const char *start = args[0].getstr(), *end = start + strlen(start), *qstart = "";
-    for(int i = 1; i < numargs; i++)
+    listparser l(args[0]);
+    const char *start = l.s, *end = start + strlen(start), *qstart = "";
+    if(numargs >= 2)
+    {
+        if(!l.skip(args[1].getint()) || !l.next()) start = end = qstart = "";
+        else { start = l.start; end = l.end; qstart = l.quotestart; }
+    }
+    for(int i = 2; i < numargs; i++)
     {
         const char *list = start;
         int pos = args[i].getint();
         for(; pos > 0; pos--) if(!parselist(list)) break;
         if(pos > 0 || !parselist(list, start, end, qstart)) start = end = qstart = "";
     }
-    commandret->setstr(listelem(start, end, qstart));
+    commandret->setstr(scriptelem(start, end, qstart));
 }
-COMMAND(at, "si1V");
+COMMAND(at, "Li1V");
 
 void substr(char *s, int *start, int *count, int *numargs)
 {
@@ -3460,16 +4224,22 @@ void substr(char *s, int *start, int *count, int *numargs)
 }
 COMMAND(substr, "siiN");
 
-void sublist(const char *s, int *skip, int *count, int *numargs)
+void sublist(tagval *list, int *skip, int *count, int *numargs)
 {
+    listparser l(*list);
     int offset = max(*skip, 0), len = *numargs >= 3 ? max(*count, 0) : -1;
-    loopi(offset) if(!parselist(s)) break;
-    if(len < 0) { if(offset > 0) skiplist(s); commandret->setstr(newstring(s)); return; }
-    const char *list = s, *start, *end, *qstart, *qend = s;
-    if(len > 0 && parselist(s, start, end, list, qend)) while(--len > 0 && parselist(s, start, end, qstart, qend));
-    commandret->setstr(newstring(list, qend - list));
+    l.skip(offset);
+    if(len < 0) { if(offset > 0) skiplist(l.s); commandret->setstr(newstring(l.s)); return; }
+    const char *start = l.s, *end = l.s;
+    if(len > 0 && l.next())
+    {
+        start = l.quotestart;
+        end = l.quoteend;
+        while(--len > 0 && l.next()) end = l.quoteend;
+    }
+    commandret->setstr(newstring(start, end - start));
 }
-COMMAND(sublist, "siiN");
+COMMAND(sublist, "LiiN");
 
 ICOMMAND(stripcolors, "s", (char *s),
 {
@@ -3483,7 +4253,7 @@ static inline void setiter(ident &id, char *val, identstack &stack)
 {
     if(id.stack == &stack)
     {
-        if(id.valtype == VAL_STR) delete[] id.val.s;
+        if(id.valtype == VAL_STR) freescriptstr(id.val.s);
         else id.valtype = VAL_STR;
         cleancode(id);
         id.val.s = val;
@@ -3497,125 +4267,147 @@ static inline void setiter(ident &id, char *val, identstack &stack)
     }
 }
 
-void listfind(ident *id, const char *list, const uint *body)
+// elements from a parsed list are set as views into it rather than copies, as the listparser
+// keeps the parsed list alive until the loop is done
+static inline void setiter(ident &id, listparser &l, identstack &stack, bool raw = false)
+{
+    tagval v;
+    if(raw) l.getraw(v);
+    else l.getelem(v);
+    loopiter(&id, stack, v);
+}
+
+static inline void setiter(ident &id, listparser &l, bool valid, identstack &stack)
+{
+    if(valid) setiter(id, l, stack);
+    else
+    {
+        tagval v;
+        v.setcstr("");
+        loopiter(&id, stack, v);
+    }
+}
+
+void listfind(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) { intret(-1); return; }
     identstack stack;
+    listparser l(*list);
     int n = -1;
-    for(const char *s = list, *start, *end; parselist(s, start, end);)
+    while(l.next())
     {
         ++n;
-        setiter(*id, newstring(start, end-start), stack);
+        setiter(*id, l, stack, true);
         if(executebool(body)) { intret(n); goto found; }
     }
     intret(-1);
 found:
     if(n >= 0) poparg(*id);
 }
-COMMAND(listfind, "rse");
+COMMAND(listfind, "rLe");
 
-void listassoc(ident *id, const char *list, const uint *body)
+void listassoc(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
+    listparser l(*list);
     int n = -1;
-    for(const char *s = list, *start, *end, *qstart; parselist(s, start, end);)
+    while(l.next())
     {
         ++n;
-        setiter(*id, newstring(start, end-start), stack);
-        if(executebool(body)) { if(parselist(s, start, end, qstart)) stringret(listelem(start, end, qstart)); break; }
-        if(!parselist(s)) break;
+        setiter(*id, l, stack, true);
+        if(executebool(body)) { if(l.next()) stringret(scriptelem(l.start, l.end, l.quotestart)); break; }
+        if(!l.next()) break;
     }
     if(n >= 0) poparg(*id);
 }
-COMMAND(listassoc, "rse");
+COMMAND(listassoc, "rLe");
 
 #define LISTFIND(name, fmt, type, init, cmp) \
-    ICOMMAND(name, "s" fmt "i", (char *list, type *val, int *skip), \
+    ICOMMAND(name, "L" fmt "i", (tagval *list, type *val, int *skip), \
     { \
         int n = 0; \
         init; \
-        for(const char *s = list, *start, *end, *qstart; parselist(s, start, end, qstart); n++) \
+        for(listparser l(*list); l.next(); n++) \
         { \
             if(cmp) { intret(n); return; } \
-            loopi(*skip) { if(!parselist(s)) goto notfound; n++; } \
+            if(!l.skip(*skip)) break; \
+            n += max(*skip, 0); \
         } \
-    notfound: \
         intret(-1); \
     });
-LISTFIND(listfind=, "i", int, , parseint(start) == *val);
-LISTFIND(listfind=f, "f", float, , parsefloat(start) == *val);
-LISTFIND(listfind=s, "s", char, int len = (int)strlen(val), int(end-start) == len && !memcmp(start, val, len));
+LISTFIND(listfind=, "i", int, , parseint(l.start) == *val);
+LISTFIND(listfind=f, "f", float, , parsefloat(l.start) == *val);
+LISTFIND(listfind=s, "s", char, int len = (int)strlen(val), int(l.end-l.start) == len && !memcmp(l.start, val, len));
 
 #define LISTASSOC(name, fmt, type, init, cmp) \
-    ICOMMAND(name, "s" fmt, (char *list, type *val), \
+    ICOMMAND(name, "L" fmt, (tagval *list, type *val), \
     { \
         init; \
-        for(const char *s = list, *start, *end, *qstart; parselist(s, start, end);) \
+        for(listparser l(*list); l.next();) \
         { \
-            if(cmp) { if(parselist(s, start, end, qstart)) stringret(listelem(start, end, qstart)); return; } \
-            if(!parselist(s)) break; \
+            if(cmp) { if(l.next()) stringret(scriptelem(l.start, l.end, l.quotestart)); return; } \
+            if(!l.next()) break; \
         } \
     });
-LISTASSOC(listassoc=, "i", int, , parseint(start) == *val);
-LISTASSOC(listassoc=f, "f", float, , parsefloat(start) == *val);
-LISTASSOC(listassoc=s, "s", char, int len = (int)strlen(val), int(end-start) == len && !memcmp(start, val, len));
+LISTASSOC(listassoc=, "i", int, , parseint(l.start) == *val);
+LISTASSOC(listassoc=f, "f", float, , parsefloat(l.start) == *val);
+LISTASSOC(listassoc=s, "s", char, int len = (int)strlen(val), int(l.end-l.start) == len && !memcmp(l.start, val, len));
 
-void looplist(ident *id, const char *list, const uint *body)
+void looplist(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     int n = 0;
-    for(const char *s = list, *start, *end, *qstart; parselist(s, start, end, qstart); n++)
+    for(listparser l(*list); l.next(); n++)
     {
-        setiter(*id, listelem(start, end, qstart), stack);
+        setiter(*id, l, stack);
         execute(body);
     }
     if(n) poparg(*id);
 }
-COMMAND(looplist, "rse");
+COMMAND(looplist, "rLe");
 
-void looplist2(ident *id, ident *id2, const char *list, const uint *body)
+void looplist2(ident *id, ident *id2, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS || id2->type!=ID_ALIAS) return;
     identstack stack, stack2;
     int n = 0;
-    for(const char *s = list, *start, *end, *qstart; parselist(s, start, end, qstart); n += 2)
+    for(listparser l(*list); l.next(); n += 2)
     {
-        setiter(*id, listelem(start, end, qstart), stack);
-        setiter(*id2, parselist(s, start, end, qstart) ? listelem(start, end, qstart) : newstring(""), stack2);
+        setiter(*id, l, stack);
+        setiter(*id2, l, l.next(), stack2);
         execute(body);
     }
     if(n) { poparg(*id); poparg(*id2); }
 }
-COMMAND(looplist2, "rrse");
+COMMAND(looplist2, "rrLe");
 
-void looplist3(ident *id, ident *id2, ident *id3, const char *list, const uint *body)
+void looplist3(ident *id, ident *id2, ident *id3, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS || id2->type!=ID_ALIAS || id3->type!=ID_ALIAS) return;
     identstack stack, stack2, stack3;
     int n = 0;
-    for(const char *s = list, *start, *end, *qstart; parselist(s, start, end, qstart); n += 3)
+    for(listparser l(*list); l.next(); n += 3)
     {
-        setiter(*id, listelem(start, end, qstart), stack);
-        setiter(*id2, parselist(s, start, end, qstart) ? listelem(start, end, qstart) : newstring(""), stack2);
-        setiter(*id3, parselist(s, start, end, qstart) ? listelem(start, end, qstart) : newstring(""), stack3);
+        setiter(*id, l, stack);
+        setiter(*id2, l, l.next(), stack2);
+        setiter(*id3, l, l.next(), stack3);
         execute(body);
     }
     if(n) { poparg(*id); poparg(*id2); poparg(*id3); }
 }
-COMMAND(looplist3, "rrrse");
+COMMAND(looplist3, "rrrLe");
 
-void looplistconc(ident *id, const char *list, const uint *body, bool space)
+void looplistconc(ident *id, tagval *list, const uint *body, bool space)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     vector<char> r;
     int n = 0;
-    for(const char *s = list, *start, *end, *qstart; parselist(s, start, end, qstart); n++)
+    for(listparser l(*list); l.next(); n++)
     {
-        char *val = listelem(start, end, qstart);
-        setiter(*id, val, stack);
+        setiter(*id, l, stack);
 
         if(n && space) r.add(' ');
 
@@ -3630,47 +4422,45 @@ void looplistconc(ident *id, const char *list, const uint *body, bool space)
     r.add('\0');
     commandret->setstr(r.disown());
 }
-ICOMMAND(looplistconcat, "rse", (ident *id, char *list, uint *body), looplistconc(id, list, body, true));
-ICOMMAND(looplistconcatword, "rse", (ident *id, char *list, uint *body), looplistconc(id, list, body, false));
+ICOMMAND(looplistconcat, "rLe", (ident *id, tagval *list, uint *body), looplistconc(id, list, body, true));
+ICOMMAND(looplistconcatword, "rLe", (ident *id, tagval *list, uint *body), looplistconc(id, list, body, false));
 
-void listfilter(ident *id, const char *list, const uint *body)
+void listfilter(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     vector<char> r;
     int n = 0;
-    for(const char *s = list, *start, *end, *qstart, *qend; parselist(s, start, end, qstart, qend); n++)
+    for(listparser l(*list); l.next(); n++)
     {
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l, stack, true);
 
         if(executebool(body))
         {
             if(r.length()) r.add(' ');
-            r.put(qstart, qend-qstart);
+            r.put(l.quotestart, l.quoteend-l.quotestart);
         }
     }
     if(n) poparg(*id);
     r.add('\0');
     commandret->setstr(r.disown());
 }
-COMMAND(listfilter, "rse");
+COMMAND(listfilter, "rLe");
 
-void listcount(ident *id, const char *list, const uint *body)
+void listcount(ident *id, tagval *list, const uint *body)
 {
     if(id->type!=ID_ALIAS) return;
     identstack stack;
     int n = 0, r = 0;
-    for(const char *s = list, *start, *end; parselist(s, start, end); n++)
+    for(listparser l(*list); l.next(); n++)
     {
-        char *val = newstring(start, end-start);
-        setiter(*id, val, stack);
+        setiter(*id, l, stack, true);
         if(executebool(body)) r++;
     }
     if(n) poparg(*id);
     intret(r);
 }
-COMMAND(listcount, "rse");
+COMMAND(listcount, "rLe");
 
 void prettylist(const char *s, const char *conj)
 {
@@ -3707,7 +4497,13 @@ int listincludes(const char *list, const char *needle, int needlelen)
     }
     return -1;
 }
-ICOMMAND(indexof, "ss", (char *list, char *elem), intret(listincludes(list, elem, strlen(elem))));
+ICOMMAND(indexof, "Ls", (tagval *list, char *elem),
+{
+    int len = strlen(elem);
+    int n = 0;
+    for(listparser l(*list); l.next(); n++) if(int(l.end - l.start) == len && !strncmp(elem, l.start, len)) { intret(n); return; }
+    intret(-1);
+});
 
 #define LISTMERGECMD(name, init, iter, filter, dir) \
     ICOMMAND(name, "ss", (const char *list, const char *elems), \
@@ -3896,7 +4692,7 @@ COMMAND(sortlist, "srree");
 ICOMMAND(uniquelist, "srre", (char *list, ident *x, ident *y, uint *body), sortlist(list, x, y, NULL, body));
 
 #define MATHCMD(name, fmt, type, op, initval, unaryop) \
-    ICOMMANDS(name, #fmt "1V", (tagval *args, int numargs), \
+    ICOMMANDPS(name, #fmt "1V", (tagval *args, int numargs), \
     { \
         type val; \
         if(numargs >= 2) \
@@ -3915,7 +4711,7 @@ ICOMMAND(uniquelist, "srre", (char *list, ident *x, ident *y, uint *body), sortl
 #define MATHFCMD(name, initval, unaryop) MATHFCMDN(name, name, initval, unaryop)
 
 #define CMPCMD(name, fmt, type, op) \
-    ICOMMANDS(name, #fmt "1V", (tagval *args, int numargs), \
+    ICOMMANDPS(name, #fmt "1V", (tagval *args, int numargs), \
     { \
         bool val; \
         if(numargs >= 2) \
@@ -3993,20 +4789,20 @@ DIVCMD(divf, f, float, val /= val2);
 DIVCMD(modf, f, float, val = fmod(val, val2));
 MATHCMD("pow", f, float, val = pow(val, val2), 0, );
 
-ICOMMAND(sin, "f", (float *a), floatret(sin(*a*RAD)));
-ICOMMAND(cos, "f", (float *a), floatret(cos(*a*RAD)));
-ICOMMAND(tan, "f", (float *a), floatret(tan(*a*RAD)));
-ICOMMAND(asin, "f", (float *a), floatret(asin(*a)/RAD));
-ICOMMAND(acos, "f", (float *a), floatret(acos(*a)/RAD));
-ICOMMAND(atan, "f", (float *a), floatret(atan(*a)/RAD));
-ICOMMAND(sqrt, "f", (float *a), floatret(sqrt(*a)));
-ICOMMAND(loge, "f", (float *a), floatret(log(*a)));
-ICOMMAND(log2, "f", (float *a), floatret(log(*a)/M_LN2));
-ICOMMAND(log10, "f", (float *a), floatret(log10(*a)));
-ICOMMAND(exp, "f", (float *a), floatret(exp(*a)));
+ICOMMANDP(sin, "f", (float *a), floatret(sin(*a*RAD)));
+ICOMMANDP(cos, "f", (float *a), floatret(cos(*a*RAD)));
+ICOMMANDP(tan, "f", (float *a), floatret(tan(*a*RAD)));
+ICOMMANDP(asin, "f", (float *a), floatret(asin(*a)/RAD));
+ICOMMANDP(acos, "f", (float *a), floatret(acos(*a)/RAD));
+ICOMMANDP(atan, "f", (float *a), floatret(atan(*a)/RAD));
+ICOMMANDP(sqrt, "f", (float *a), floatret(sqrt(*a)));
+ICOMMANDP(loge, "f", (float *a), floatret(log(*a)));
+ICOMMANDP(log2, "f", (float *a), floatret(log(*a)/M_LN2));
+ICOMMANDP(log10, "f", (float *a), floatret(log10(*a)));
+ICOMMANDP(exp, "f", (float *a), floatret(exp(*a)));
 
 #define MINMAXCMD(name, fmt, type, op) \
-    ICOMMAND(name, #fmt "1V", (tagval *args, int numargs), \
+    ICOMMANDP(name, #fmt "1V", (tagval *args, int numargs), \
     { \
         type val = numargs > 0 ? args[0].fmt : 0; \
         for(int i = 1; i < numargs; i++) val = op(val, args[i].fmt); \
@@ -4018,12 +4814,12 @@ MINMAXCMD(max, i, int, max);
 MINMAXCMD(minf, f, float, min);
 MINMAXCMD(maxf, f, float, max);
 
-ICOMMAND(abs, "i", (int *n), intret(abs(*n)));
-ICOMMAND(absf, "f", (float *n), floatret(fabs(*n)));
+ICOMMANDP(abs, "i", (int *n), intret(abs(*n)));
+ICOMMANDP(absf, "f", (float *n), floatret(fabs(*n)));
 
-ICOMMAND(floor, "f", (float *n), floatret(floor(*n)));
-ICOMMAND(ceil, "f", (float *n), floatret(ceil(*n)));
-ICOMMAND(round, "f", (float *n), floatret(floor(*n + 0.5)));
+ICOMMANDP(floor, "f", (float *n), floatret(floor(*n)));
+ICOMMANDP(ceil, "f", (float *n), floatret(ceil(*n)));
+ICOMMANDP(round, "f", (float *n), floatret(floor(*n + 0.5)));
 
 ICOMMAND(cond, "ee2V", (tagval *args, int numargs),
 {
@@ -4202,3 +4998,55 @@ void clearsleep_(int *clearoverrides)
 COMMANDN(clearsleep, clearsleep_, "i");
 #endif
 
+struct scriptbenchcase
+{
+    const char *name, *setup, *body;
+    bool late;
+};
+
+static const scriptbenchcase scriptbenches[] =
+{
+    { "alias", "benchadd = [+ $arg1 $arg2]", "benchadd 1 2", false },
+    { "forward", "benchfwd%d = [+ $arg1 $arg2]", "benchfwd%d 1 2", true },
+    { "loop", "benchsum = 0", "loop i 10 [benchsum = (+ $benchsum $i)]", false },
+    { "looplist", "benchstr = \"\"", "looplist v \"alpha beta gamma delta epsilon zeta eta theta\" [benchstr = $v]", false },
+    { "listalias", "benchlist = \"alpha beta [gamma delta] \\\"epsilon zeta\\\" eta theta iota kappa\"; benchstr = \"\"", "looplist v $benchlist [benchstr = $v]; benchstr = (at $benchlist 6); listfind v $benchlist [=s $v iota]", false },
+    { "arith", "benchsum = 0", "benchsum = (+ (* (mod $benchsum 1000) 3) (div 100 7) (- 20 (* 2 3)) (<< 1 4))", false },
+    { "format", "benchsum = 0", "format \"%%1 + %%2 = %%3\" $benchsum (* 2 (+ 3 4)) (+ $benchsum 14)", false },
+    { "if", "benchsum = 0", "if (< $benchsum (* 10 100)) [benchsum = (+ $benchsum 1)] [benchsum = 0]", false }
+};
+
+void scriptbench(int *iterations)
+{
+    static int benchids = 0;
+    int n = *iterations > 0 ? *iterations : 100000, oldopt = scriptopt, mismatches = 0;
+    loopi(sizeof(scriptbenches)/sizeof(scriptbenches[0]))
+    {
+        const scriptbenchcase &b = scriptbenches[i];
+        int elapsed[2] = { INT_MAX, INT_MAX };
+        string results[2];
+        loopk(2*3) // alternate unoptimized and optimized runs, keeping the fastest of each
+        {
+            ++benchids;
+            defformatstring(setup, b.setup, benchids);
+            defformatstring(body, b.body, benchids);
+            scriptopt = k&1;
+            if(!b.late) execute(setup);
+            uint *code = compilecode(body);
+            if(b.late) execute(setup);
+            int start = enet_time_get();
+            loopj(n-1) execute(code);
+            tagval result;
+            executeret(code, result);
+            elapsed[k&1] = min(elapsed[k&1], int(enet_time_get() - start));
+            copystring(results[k&1], result.getstr());
+            freearg(result);
+            freecode(code);
+        }
+        if(strcmp(results[0], results[1])) { conoutf(CON_ERROR, "scriptbench %s: result mismatch \"%s\" != \"%s\"", b.name, results[0], results[1]); mismatches++; }
+        conoutf("scriptbench %s: %d iterations, %d ms unoptimized, %d ms optimized", b.name, n, elapsed[0], elapsed[1]);
+    }
+    scriptopt = oldopt;
+    if(mismatches) conoutf(CON_ERROR, "scriptbench: %d mismatches", mismatches);
+}
+COMMAND(scriptbench, "i");
@@ -228,8 +228,8 @@ extern bool isvalidcube(const cube &c);
 extern ivec lu;
 extern int lusize;
 extern cube &lookupcube(const ivec &to, int tsize = 0, ivec &ro = lu, int &rsize = lusize);
-extern const cube *neighbourstack[32];
-extern int neighbourdepth;
+extern THREADLOCAL const cube *neighbourstack[32];
+extern THREADLOCAL int neighbourdepth;
 extern const cube &neighbourcube(const cube &c, int orient, const ivec &co, int size, ivec &ro = lu, int &rsize = lusize);
 extern void resetclipplanes();
 extern int getmippedtexture(const cube &p, int orient);
@@ -309,6 +309,7 @@ extern void collectlights();
 extern void loaddeferredlightshaders();
 extern void cleardeferredlightshaders();
 extern void clearshadowcache();
+extern void clearshadowcache(const ivec &bbmin, const ivec &bbmax);
 
 extern void findshadowvas();
 extern void findshadowmms();
@@ -322,6 +323,7 @@ extern void renderrsmgeom(bool dyntex = false);
 extern bool useradiancehints();
 extern void renderradiancehints();
 extern void clearradiancehintscache();
+extern void invalidateradiancehints(const vec &bbmin, const vec &bbmax);
 extern void cleanuplights();
 
 extern int calcbbsidemask(const vec &bbmin, const vec &bbmax, const vec &lightpos, float lightradius, float bias);
@@ -411,6 +413,7 @@ extern ushort encodenormal(const vec &n);
 extern vec decodenormal(ushort norm);
 extern void reduceslope(ivec &n);
 extern void findtjoints();
+extern void findtjoints(const ivec &bbmin, const ivec &bbmax);
 extern void octarender();
 extern void allchanged(bool load = false);
 extern void clearvas(cube *c);
@@ -454,6 +457,7 @@ extern void drawbb(const ivec &bo, const ivec &br, const vec &camera = camera1->
 struct shadowmesh;
 extern void clearshadowmeshes();
 extern void genshadowmeshes();
+extern void updateshadowmeshes(const ivec &bbmin, const ivec &bbmax);
 extern shadowmesh *findshadowmesh(int idx, extentity &e);
 extern void rendershadowmesh(shadowmesh *m);
 
@@ -599,6 +603,7 @@ enum
     INIT_RESET
 };
 extern int initing, numcpus;
+extern bool headless;
 
 enum
 {
@@ -242,31 +242,34 @@ void PackNode::reserve(ushort tx, ushort ty, ushort tw, ushort th)
     available = max(child1->available, child2->available);
 }
 
-static void clearsurfaces(cube *c)
+static void clearsurfaces(cube &c)
 {
-    loopi(8)
+    if(!c.ext) return;
+    loopj(6)
     {
-        if(c[i].ext)
+        surfaceinfo &surf = c.ext->surfaces[j];
+        if(!surf.used()) continue;
+        surf.clear();
+        int numverts = surf.numverts&MAXFACEVERTS;
+        if(numverts)
         {
-            loopj(6)
+            if(!(c.merged&(1<<j))) { surf.numverts &= ~MAXFACEVERTS; continue; }
+
+            vertinfo *verts = c.ext->verts() + surf.verts;
+            loopk(numverts)
             {
-                surfaceinfo &surf = c[i].ext->surfaces[j];
-                if(!surf.used()) continue;
-                surf.clear();
-                int numverts = surf.numverts&MAXFACEVERTS;
-                if(numverts)
-                {
-                    if(!(c[i].merged&(1<<j))) { surf.numverts &= ~MAXFACEVERTS; continue; }
-
-                    vertinfo *verts = c[i].ext->verts() + surf.verts;
-                    loopk(numverts)
-                    {
-                        vertinfo &v = verts[k];
-                        v.norm = 0;
-                    }
-                }
+                vertinfo &v = verts[k];
+                v.norm = 0;
             }
         }
+    }
+}
+
+static void clearsurfaces(cube *c)
+{
+    loopi(8)
+    {
+        clearsurfaces(c[i]);
         if(c[i].children) clearsurfaces(c[i].children);
     }
 }
@@ -496,6 +499,20 @@ static void calcsurfaces(cube &c, const ivec &co, int size, int usefacemask, int
     }
 }
 
+static void calcleafsurfaces(cube &c, const ivec &o, int size)
+{
+    if(c.ext)
+    {
+        loopj(6) c.ext->surfaces[j].clear();
+    }
+    int usefacemask = 0;
+    loopj(6) if(c.texture[j] != DEFAULT_SKY && (!(c.merged&(1<<j)) || (c.ext && c.ext->surfaces[j].numverts&MAXFACEVERTS)))
+    {
+        usefacemask |= visibletris(c, j, o, size)<<(4*j);
+    }
+    if(usefacemask) calcsurfaces(c, o, size, usefacemask);
+}
+
 static void calcsurfaces(cube *c, const ivec &co, int size)
 {
     CHECK_CALCLIGHT_PROGRESS(return, show_calclight_progress);
@@ -507,18 +524,21 @@ static void calcsurfaces(cube *c, const ivec &co, int size)
         ivec o(i, co, size);
         if(c[i].children)
             calcsurfaces(c[i].children, o, size >> 1);
+        else if(!isempty(c[i])) calcleafsurfaces(c[i], o, size);
+    }
+}
+
+static void calcsurfaces(cube *c, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax)
+{
+    loopoctabox(co, size, bbmin, bbmax)
+    {
+        ivec o(i, co, size);
+        if(c[i].children)
+            calcsurfaces(c[i].children, o, size >> 1, bbmin, bbmax);
         else if(!isempty(c[i]))
         {
-            if(c[i].ext)
-            {
-                loopj(6) c[i].ext->surfaces[j].clear();
-            }
-            int usefacemask = 0;
-            loopj(6) if(c[i].texture[j] != DEFAULT_SKY && (!(c[i].merged&(1<<j)) || (c[i].ext && c[i].ext->surfaces[j].numverts&MAXFACEVERTS)))
-            {
-                usefacemask |= visibletris(c[i], j, o, size)<<(4*j);
-            }
-            if(usefacemask) calcsurfaces(c[i], o, size, usefacemask);
+            clearsurfaces(c[i]);
+            calcleafsurfaces(c[i], o, size);
         }
     }
 }
@@ -606,9 +626,12 @@ void calclight()
     clearnormals();
     Uint32 end = SDL_GetTicks();
     if(timer) SDL_RemoveTimer(timer);
-    initlights();
-    renderbackground("lighting done...");
-    allchanged();
+    if(!headless)
+    {
+        initlights();
+        renderbackground("lighting done...");
+        allchanged();
+    }
     if(calclight_canceled)
         conoutf("calclight aborted");
     else
@@ -616,6 +639,14 @@ void calclight()
             (end - start) / 1000.0f);
 }
 
+// recomputes smoothed surface normals only for the cubes in bbmin..bbmax after an edit
+void calclight(const ivec &bbmin, const ivec &bbmax)
+{
+    calcnormals(bbmin, bbmax, filltjoints > 0);
+    calcsurfaces(worldroot, ivec(0, 0, 0), worldsize >> 1, bbmin, bbmax);
+    clearnormals();
+}
+
 void mpcalclight(bool local)
 {
     extern selinfo sel;
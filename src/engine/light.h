@@ -57,8 +57,11 @@ extern void brightencube(cube &c);
 extern void setsurfaces(cube &c, const surfaceinfo *surfs, const vertinfo *verts, int numverts);
 extern void setsurface(cube &c, int orient, const surfaceinfo &surf, const vertinfo *verts, int numverts);
 extern void previewblends(const ivec &bo, const ivec &bs);
+extern void calclight();
+extern void calclight(const ivec &bbmin, const ivec &bbmax);
 
 extern void calcnormals(bool lerptjoints = false);
+extern void calcnormals(const ivec &bbmin, const ivec &bbmax, bool lerptjoints = false);
 extern void clearnormals();
 extern void resetsmoothgroups();
 extern int smoothangle(int id, int angle);
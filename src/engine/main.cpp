@@ -81,6 +81,7 @@ int curtime = 0, lastmillis = 1, elapsedtime = 0, totalmillis = 1;
 dynent *player = NULL;
 
 int initing = NOT_INITING;
+bool headless = false; // only tess_mapc runs the engine without a window or GL context
 
 bool initwarning(const char *desc, int level, int type)
 {
@@ -1163,6 +1164,8 @@ int main(int argc, char **argv)
 
     initing = NOT_INITING;
 
+    printcfgstats();
+
     logoutf("init: render");
     renderbackground("initializing...");
     restoregamma();
@@ -0,0 +1,195 @@
+// mapc.cpp: headless map compiler, bakes normals, blendmaps and PVS into maps without a window or GL context
+
+#include "engine.h"
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+// stand-ins for the main.cpp state the rest of the engine links against
+int curtime = 0, lastmillis = 1, elapsedtime = 0, totalmillis = 1;
+dynent *player = NULL;
+int initing = NOT_INITING;
+bool headless = true;
+bool inbetweenframes = false, renderedframe = true, minimized = false;
+float loadprogress = 0;
+int screenw = 0, screenh = 0, scr_w = 1024, scr_h = 768;
+VAR(numcpus, 1, 1, 16);
+
+void fatal(const char *s, ...)    // failure exit
+{
+    defvformatstring(msg,s,s);
+    logoutf("%s", msg);
+    SDL_Quit();
+    exit(EXIT_FAILURE);
+}
+
+bool initwarning(const char *desc, int level, int type) { return false; }
+bool interceptkey(int sym) { return false; }
+void keyrepeat(bool on, int mask) {}
+void textinput(bool on, int mask) {}
+int getclockmillis() { return SDL_GetTicks(); }
+void getfps(int &fps, int &bestdiff, int &worstdiff) { fps = bestdiff = worstdiff = 0; }
+void renderbackground(const char *caption, Texture *mapshot, const char *mapname, const char *mapinfo, bool force) {}
+
+// sound, movie, UI and menus are left out of the map compiler entirely; these stand in for the calls the rest of the engine makes into them
+int playsound(int n, const vec *loc, extentity *ent, int flags, int loops, int fade, int chanid, int radius, int expire) { return -1; }
+void preloadsound(int n) {}
+void preloadmapsound(int n) {}
+void preloadmapsounds() {}
+void clearmapsounds() {}
+ICOMMAND(mapsound, "sii", (char *name, int *vol, int *maxuses), );
+
+int mainmenu = 0;
+void clearmainmenu() {}
+void clearchanges(int type) {}
+void notifywelcome() {}
+
+namespace UI
+{
+    bool hascursor() { return false; }
+    void getcursorpos(float &x, float &y) { x = y = 0.5f; }
+    bool keypress(int code, bool isdown) { return false; }
+    bool textinput(const char *str, int len) { return false; }
+    float abovehud() { return 1; }
+    void render() {}
+    bool toggleui(const char *name) { return false; }
+    void holdui(const char *name, bool on) {}
+    bool uivisible(const char *name) { return false; }
+}
+
+void renderprogress(float bar, const char *text, bool background)
+{
+    static string lasttext = "";
+    static int lastprogress = 0;
+    int millis = SDL_GetTicks();
+    if(!strcmp(text, lasttext) || (bar > 0 && millis - lastprogress < 1000)) return;
+    copystring(lasttext, text);
+    lastprogress = millis;
+    logoutf("  %s", text);
+}
+
+static void printmemory()
+{
+    conoutf("memory: %d cube nodes (%.1f MB)", allocnodes, allocnodes*8*sizeof(cube)/(1024.0f*1024.0f));
+#ifndef WIN32
+    struct rusage usage;
+    if(!getrusage(RUSAGE_SELF, &usage))
+    {
+    #ifdef __APPLE__
+        float peak = usage.ru_maxrss/(1024.0f*1024.0f);
+    #else
+        float peak = usage.ru_maxrss/1024.0f;
+    #endif
+        conoutf("memory: %.1f MB peak resident", peak);
+    }
+#endif
+}
+
+static inline float elapsedms(ullong start) { return (getmicroseconds() - start)/1000.0f; }
+
+static bool compilemap(const char *name, const char *steps, const char *outname, int viewcellsize, bool container)
+{
+    ullong start = getmicroseconds(), step = start;
+    if(!load_world(name)) return false;
+    conoutf("loaded %s (%.2f ms)", name, elapsedms(step));
+
+    // every step is threaded internally, but they run one after another since calclight remips the octree that PVS is built from
+    if(strchr(steps, 'n'))
+    {
+        step = getmicroseconds();
+        calclight();
+        conoutf("normals: %.2f ms", elapsedms(step));
+    }
+    if(strchr(steps, 'b'))
+    {
+        step = getmicroseconds();
+        optimizeblendmap();
+        conoutf("blendmap: %.2f ms", elapsedms(step));
+    }
+    if(strchr(steps, 'p'))
+    {
+        extern void genpvs(int *viewcellsize);
+        step = getmicroseconds();
+        genpvs(&viewcellsize);
+        conoutf("pvs: %.2f ms", elapsedms(step));
+    }
+
+    step = getmicroseconds();
+    if(!save_world(outname ? outname : name)) return false;
+    if(container)
+    {
+        extern void convertmap(const char *mname);
+        convertmap(outname ? outname : name);
+    }
+    conoutf("saved %s (%.2f ms)", outname ? outname : name, elapsedms(step));
+
+    conoutf("compiled %s in %.2f ms", name, elapsedms(start));
+    printmemory();
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    setlogfile(NULL);
+
+    const char *steps = "nbp", *outname = NULL;
+    int threads = 0, viewcellsize = 32;
+    bool container = false;
+    vector<const char *> maps;
+    for(int i = 1; i<argc; i++)
+    {
+        if(argv[i][0]=='-') switch(argv[i][1])
+        {
+            case 'u':
+            {
+                const char *dir = sethomedir(&argv[i][2]);
+                if(dir) logoutf("Using home directory: %s", dir);
+                break;
+            }
+            case 'k':
+            {
+                const char *dir = addpackagedir(&argv[i][2]);
+                if(dir) logoutf("Adding package directory: %s", dir);
+                break;
+            }
+            case 'g': logoutf("Setting log file: %s", &argv[i][2]); setlogfile(&argv[i][2]); break;
+            case 's': steps = &argv[i][2]; break;
+            case 't': threads = clamp(atoi(&argv[i][2]), 0, 16); break;
+            case 'v': viewcellsize = max(atoi(&argv[i][2]), 1); break;
+            case 'o': outname = &argv[i][2]; break;
+            case 'c': container = true; break;
+            default: logoutf("unknown option: %s", argv[i]); break;
+        }
+        else maps.add(argv[i]);
+    }
+    if(maps.empty() || (outname && maps.length() > 1))
+    {
+        logoutf("usage: tess_mapc [-u<homedir>] [-k<packagedir>] [-s<steps>] [-t<threads>] [-v<viewcellsize>] [-o<outmap>] [-c] <map>...");
+        logoutf("steps: n = normals, b = blendmap, p = pvs (default: nbp); -c also writes an .omc container");
+        return EXIT_FAILURE;
+    }
+
+    numcpus = clamp(SDL_GetCPUCount(), 1, 16);
+    if(SDL_Init(SDL_INIT_TIMER)<0) fatal("Unable to initialize SDL: %s", SDL_GetError());
+
+    game::initclient();
+    camera1 = player = game::iterdynents(0);
+
+    if(!execfile("config/stdlib.cfg", false)) fatal("cannot find data files (you are running from the wrong folder, try the main folder)");
+    if(threads)
+    {
+        setvar("normalthreads", threads);
+        setvar("pvsthreads", threads);
+    }
+
+    int failed = 0;
+    loopv(maps) if(!compilemap(maps[i], steps, outname, viewcellsize, container))
+    {
+        conoutf(CON_ERROR, "failed to compile map %s", maps[i]);
+        failed++;
+    }
+
+    SDL_Quit();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
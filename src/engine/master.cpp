@@ -1,6 +1,14 @@
 #include "cube.h"
 #include <signal.h>
 #include <enet/time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#ifndef WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #define INPUT_LIMIT 4096
 #define OUTPUT_LIMIT (64*1024)
@@ -14,6 +22,8 @@
 #define PING_RETRY 5
 #define KEEPALIVE_TIME (65*60*1000)
 #define SERVER_LIMIT (10*1024)
+#define SWEEP_TIME 1000
+#define STATS_TIME (60*1000)
 
 FILE *logfile = NULL;
 
@@ -44,17 +54,67 @@ struct baninfo
 {
     enet_uint32 ip, mask;
 };
-vector<baninfo> bans, servbans, gbans;
+
+// bans only wildcard whole octets, so there are at most 16 distinct masks; each gets its own hash of masked addresses
+struct banlist
+{
+    vector<baninfo> bans;
+    hashset<int> masked[16];
+    int usedmasks;
+
+    banlist() : usedmasks(0) {}
+
+    static enet_uint32 maskbits(int pattern)
+    {
+        union { uchar b[sizeof(enet_uint32)]; enet_uint32 i; } mask;
+        loopi(4) mask.b[i] = pattern&(1<<i) ? 0xFF : 0;
+        return mask.i;
+    }
+
+    static int maskpattern(enet_uint32 bits)
+    {
+        union { uchar b[sizeof(enet_uint32)]; enet_uint32 i; } mask;
+        mask.i = bits;
+        int pattern = 0;
+        loopi(4) if(mask.b[i]) pattern |= 1<<i;
+        return pattern;
+    }
+
+    void add(const baninfo &ban)
+    {
+        bans.add(ban);
+        int pattern = maskpattern(ban.mask);
+        masked[pattern].add(int(ban.ip & maskbits(pattern)));
+        usedmasks |= 1<<pattern;
+    }
+
+    void clear()
+    {
+        bans.shrink(0);
+        loopi(16) masked[i].clear();
+        usedmasks = 0;
+    }
+
+    bool check(enet_uint32 host)
+    {
+        loopi(16) if(usedmasks&(1<<i) && masked[i].access(int(host & maskbits(i)))) return true;
+        return false;
+    }
+
+    int length() const { return bans.length(); }
+    baninfo &operator[](int i) { return bans[i]; }
+};
+banlist bans, servbans, gbans;
 
 void clearbans()
 {
-    bans.shrink(0);
-    servbans.shrink(0);
-    gbans.shrink(0);
+    bans.clear();
+    servbans.clear();
+    gbans.clear();
 }
 COMMAND(clearbans, "");
 
-void addban(vector<baninfo> &bans, const char *name)
+void addban(banlist &bans, const char *name)
 {
     union { uchar b[sizeof(enet_uint32)]; enet_uint32 i; } ip, mask;
     ip.i = 0;
@@ -68,9 +128,10 @@ void addban(vector<baninfo> &bans, const char *name)
         name = end;
         while(*name && *name++ != '.');
     }
-    baninfo &ban = bans.add();
+    baninfo ban;
     ban.ip = ip.i;
     ban.mask = mask.i;
+    bans.add(ban);
 }
 ICOMMAND(ban, "s", (char *name), addban(bans, name));
 ICOMMAND(servban, "s", (char *name), addban(servbans, name));
@@ -92,10 +153,9 @@ char *printban(const baninfo &ban, char *buf)
     return buf;
 }
 
-bool checkban(vector<baninfo> &bans, enet_uint32 host)
+bool checkban(banlist &bans, enet_uint32 host)
 {
-    loopv(bans) if((host & bans[i].mask) == bans[i].ip) return true;
-    return false;
+    return bans.check(host);
 }
 
 struct authreq
@@ -159,10 +219,16 @@ struct client
     vector<authreq> authreqs;
     bool shouldpurge;
     bool registeredserver;
+    int index, events;
+    bool dead;
+    enet_uint32 listtime;
+    uint serial;
+
+    client() : message(NULL), inputpos(0), outputpos(0), servport(-1), lastauth(0), shouldpurge(false), registeredserver(false), index(-1), events(0), dead(false), listtime(0), serial(0) {}
 
-    client() : message(NULL), inputpos(0), outputpos(0), servport(-1), lastauth(0), shouldpurge(false), registeredserver(false) {}
+    bool wantswrite() const { return message || output.length(); }
 };
-vector<client *> clients;
+vector<client *> clients, deadclients;
 
 ENetSocket serversocket = ENET_SOCKET_NULL;
 
@@ -201,19 +267,63 @@ void conoutf(int type, const char *fmt, ...)
     va_end(args);
 }
 
+#ifdef __linux__
+int epollfd = -1;
+
+void watchsocket(ENetSocket sock, void *data, int events, int op)
+{
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = data;
+    if(epoll_ctl(epollfd, op, sock, &ev) < 0) fatal("failed to watch socket");
+}
+#endif
+
+// switches a client between waiting for input and waiting to flush output
+void updateclient(client &c)
+{
+#ifdef __linux__
+    if(epollfd < 0 || c.dead) return;
+    int events = c.wantswrite() ? EPOLLOUT : EPOLLIN;
+    if(c.events == events) return;
+    watchsocket(c.socket, &c, events, c.events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+    c.events = events;
+#endif
+}
+
+// clients are only marked here and deleted by flushclients, so that pending socket events never see a freed client
+void purgeclient(client &c)
+{
+    if(c.dead) return;
+    c.dead = true;
+    deadclients.add(&c);
+}
+
 void purgeclient(int n)
 {
-    client &c = *clients[n];
-    if(c.message) c.message->purge();
-    enet_socket_destroy(c.socket);
-    delete clients[n];
-    clients.remove(n);
+    purgeclient(*clients[n]);
+}
+
+void flushclients()
+{
+    loopv(deadclients)
+    {
+        client *c = deadclients[i];
+        if(c->message) c->message->purge();
+        enet_socket_destroy(c->socket);
+        clients.removeunordered(c->index);
+        if(clients.inrange(c->index)) clients[c->index]->index = c->index;
+        delete c;
+    }
+    deadclients.setsize(0);
 }
 
 void output(client &c, const char *msg, int len = 0)
 {
     if(!len) len = strlen(msg);
     c.output.put(msg, len);
+    updateclient(c);
 }
 
 void outputf(client &c, const char *fmt, ...)
@@ -312,10 +422,11 @@ void gengbanlist()
     loopv(clients)
     {
         client &c = *clients[i];
-        if(c.servport >= 0 && !c.message)
+        if(c.servport >= 0 && !c.message && !c.dead)
         {
             c.message = l;
             c.message->refs++;
+            updateclient(c);
         }
     }
 }
@@ -353,7 +464,7 @@ client *findclient(gameserver &s)
     loopv(clients)
     {
         client &c = *clients[i];
-        if(s.address.host == c.address.host && s.port == c.servport)
+        if(s.address.host == c.address.host && s.port == c.servport && !c.dead)
             return &c;
     }
     return NULL;
@@ -392,6 +503,7 @@ void checkserverpongs()
                         {
                             c->message = gbanlists.last();
                             c->message->refs++;
+                            updateclient(*c);
                         }
                     }
                 }
@@ -457,6 +569,104 @@ void messagebuf::purge()
     }
 }
 
+// challenges are generated on worker threads, so a burst of auth requests does not stall every other client
+VAR(auththreads, 0, 2, 16);
+
+int pendingauths = 0;
+
+#ifndef WIN32
+struct authjob
+{
+    client *c;
+    uint serial, id;
+    void *pubkey;
+    uint seed[3];
+    void *answer;
+    vector<char> challenge;
+};
+
+pthread_mutex_t authlock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t authcond = PTHREAD_COND_INITIALIZER;
+vector<authjob *> authjobs, authdone;
+int authpipe[2] = { -1, -1 }, authworkers = 0;
+
+void *authworker(void *)
+{
+    pthread_mutex_lock(&authlock);
+    for(;;)
+    {
+        while(authjobs.empty()) pthread_cond_wait(&authcond, &authlock);
+        authjob *j = authjobs.remove(0);
+        pthread_mutex_unlock(&authlock);
+        j->answer = genchallenge(j->pubkey, j->seed, sizeof(j->seed), j->challenge);
+        pthread_mutex_lock(&authlock);
+        if(authdone.empty())
+        {
+            char wake = 0;
+            if(write(authpipe[1], &wake, 1) < 0) {}
+        }
+        authdone.add(j);
+    }
+    return NULL;
+}
+
+void watchauthpipe();
+
+bool startauthworkers()
+{
+    if(authworkers) return true;
+    if(!auththreads || pipe(authpipe) < 0) return false;
+    fcntl(authpipe[0], F_SETFL, O_NONBLOCK);
+    initchallenges();
+    loopi(auththreads)
+    {
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, authworker, NULL)) break;
+        pthread_detach(thread);
+        authworkers++;
+    }
+    if(!authworkers) return false;
+    watchauthpipe();
+    return true;
+}
+
+bool queueauth(client &c, uint id, void *pubkey, const uint *seed)
+{
+    if(!startauthworkers()) return false;
+    authjob *j = new authjob;
+    j->c = &c;
+    j->serial = c.serial;
+    j->id = id;
+    j->pubkey = pubkey;
+    memcpy(j->seed, seed, sizeof(j->seed));
+    j->answer = NULL;
+    pthread_mutex_lock(&authlock);
+    authjobs.add(j);
+    pthread_cond_signal(&authcond);
+    pthread_mutex_unlock(&authlock);
+    pendingauths++;
+    return true;
+}
+
+void finishauth(authjob *j);
+
+void checkauthjobs()
+{
+    char buf[64];
+    while(read(authpipe[0], buf, sizeof(buf)) > 0);
+    static vector<authjob *> done;
+    pthread_mutex_lock(&authlock);
+    done.put(authdone.getbuf(), authdone.length());
+    authdone.setsize(0);
+    pthread_mutex_unlock(&authlock);
+    loopv(done) finishauth(done[i]);
+    pendingauths -= done.length();
+    done.setsize(0);
+}
+#else
+bool queueauth(client &c, uint id, void *pubkey, const uint *seed) { return false; }
+#endif
+
 void purgeauths(client &c)
 {
     int expired = 0;
@@ -510,7 +720,9 @@ void reqauth(client &c, uint id, char *name)
     authreq &a = c.authreqs.add();
     a.reqtime = servtime;
     a.id = id;
+    a.answer = NULL;
     uint seed[3] = { uint(starttime), servtime, randomMT() };
+    if(queueauth(c, id, u->pubkey, seed)) return;
     static vector<char> buf;
     buf.setsize(0);
     a.answer = genchallenge(u->pubkey, seed, sizeof(seed), buf);
@@ -526,7 +738,7 @@ void confauth(client &c, uint id, const char *val)
     {
         string ip;
         if(enet_address_get_host_ip(&c.address, ip, sizeof(ip)) < 0) copystring(ip, "-");
-        if(checkchallenge(val, c.authreqs[i].answer))
+        if(c.authreqs[i].answer && checkchallenge(val, c.authreqs[i].answer))
         {
             outputf(c, "succauth %u\n", id);
             conoutf("succeeded %u from %s", id, ip);
@@ -543,6 +755,23 @@ void confauth(client &c, uint id, const char *val)
     outputf(c, "failauth %u\n", id);
 }
 
+#ifndef WIN32
+void finishauth(authjob *j)
+{
+    client *c = NULL;
+    loopv(clients) if(clients[i] == j->c && clients[i]->serial == j->serial && !clients[i]->dead) { c = clients[i]; break; }
+    authreq *a = NULL;
+    if(c) loopv(c->authreqs) if(c->authreqs[i].id == j->id && !c->authreqs[i].answer) { a = &c->authreqs[i]; break; }
+    if(a)
+    {
+        a->answer = j->answer;
+        outputf(*c, "chalauth %u %s\n", j->id, j->challenge.getbuf());
+    }
+    else freechallenge(j->answer);
+    delete j;
+}
+#endif
+
 bool checkclientinput(client &c)
 {
     if(c.inputpos<0) return true;
@@ -564,6 +793,8 @@ bool checkclientinput(client &c)
             c.output.setsize(0);
             c.outputpos = 0;
             c.shouldpurge = true;
+            c.listtime = servtime ? servtime : 1;
+            updateclient(c);
             return true;
         }
         else if(sscanf(c.input, "regserv %d", &port) == 1)
@@ -592,7 +823,157 @@ bool checkclientinput(client &c)
     return c.inputpos<(int)sizeof(c.input);
 }
 
-ENetSocketSet readset, writeset;
+int liststats = 0, listlatency[65];
+enet_uint32 laststats = 0;
+
+// latency is bucketed by powers of two up to a minute; p99 is the upper bound of the bucket holding the 99th percentile
+void addlistlatency(enet_uint32 millis)
+{
+    int bucket = 0;
+    while(bucket < 16 && millis >= (1U<<bucket)) bucket++;
+    listlatency[bucket]++;
+    liststats++;
+}
+
+void logliststats()
+{
+    if(ENET_TIME_DIFFERENCE(servtime, laststats) < STATS_TIME) return;
+    if(liststats)
+    {
+        int rank = liststats - liststats/100, count = 0, bucket = 0;
+        for(; bucket < 16; bucket++) { count += listlatency[bucket]; if(count >= rank) break; }
+        conoutf("list: %d requests (%.1f/sec), p99 under %d ms, %d clients", liststats, liststats*1000.0f/ENET_TIME_DIFFERENCE(servtime, laststats), 1<<bucket, clients.length());
+    }
+    liststats = 0;
+    memset(listlatency, 0, sizeof(listlatency));
+    laststats = servtime;
+}
+
+void acceptclients()
+{
+    loopi(64)
+    {
+        ENetAddress address;
+        ENetSocket clientsocket = enet_socket_accept(serversocket, &address);
+        if(clientsocket==ENET_SOCKET_NULL) break;
+        if(clients.length()>=CLIENT_LIMIT || checkban(bans, address.host)) { enet_socket_destroy(clientsocket); continue; }
+
+        int dups = 0, oldest = -1;
+        loopv(clients) if(clients[i]->address.host == address.host && !clients[i]->dead)
+        {
+            dups++;
+            if(oldest<0 || clients[i]->connecttime < clients[oldest]->connecttime) oldest = i;
+        }
+        if(dups >= DUP_LIMIT) purgeclient(oldest);
+
+        enet_socket_set_option(clientsocket, ENET_SOCKOPT_NONBLOCK, 1);
+        client *c = new client;
+        c->address = address;
+        c->socket = clientsocket;
+        c->connecttime = servtime;
+        c->lastinput = servtime;
+        c->index = clients.length();
+        static uint serials = 0;
+        c->serial = ++serials;
+        clients.add(c);
+        updateclient(*c);
+    }
+}
+
+bool writeclient(client &c)
+{
+    const char *data = c.output.length() ? c.output.getbuf() : c.message->getbuf();
+    int len = c.output.length() ? c.output.length() : c.message->length();
+    ENetBuffer buf;
+    buf.data = (void *)&data[c.outputpos];
+    buf.dataLength = len-c.outputpos;
+    int res = enet_socket_send(c.socket, NULL, &buf, 1);
+    if(res<0) return false;
+    c.outputpos += res;
+    if(c.outputpos>=len)
+    {
+        if(c.output.length()) c.output.setsize(0);
+        else
+        {
+            c.message->purge();
+            c.message = NULL;
+            if(c.listtime) addlistlatency(ENET_TIME_DIFFERENCE(servtime, c.listtime));
+            c.listtime = 0;
+        }
+        c.outputpos = 0;
+        if(!c.message && c.output.empty() && c.shouldpurge) return false;
+    }
+    updateclient(c);
+    return true;
+}
+
+bool readclient(client &c)
+{
+    ENetBuffer buf;
+    buf.data = &c.input[c.inputpos];
+    buf.dataLength = sizeof(c.input) - c.inputpos;
+    int res = enet_socket_receive(c.socket, NULL, &buf, 1);
+    if(res<=0) return false;
+    c.inputpos += res;
+    c.input[min(c.inputpos, (int)sizeof(c.input)-1)] = '\0';
+    return checkclientinput(c) && c.output.length() <= OUTPUT_LIMIT;
+}
+
+bool checkclienttime(client &c)
+{
+    if(c.authreqs.length()) purgeauths(c);
+    if(c.output.length() > OUTPUT_LIMIT) return false;
+    return ENET_TIME_DIFFERENCE(servtime, c.lastinput) < (c.registeredserver ? KEEPALIVE_TIME : CLIENT_TIME);
+}
+
+#ifdef __linux__
+enet_uint32 lastsweep = 0;
+
+void watchauthpipe()
+{
+    if(epollfd >= 0) watchsocket(authpipe[0], authpipe, EPOLLIN, EPOLL_CTL_ADD);
+}
+
+bool setupepoll()
+{
+    epollfd = epoll_create(CLIENT_LIMIT);
+    if(epollfd < 0) return false;
+    watchsocket(serversocket, &serversocket, EPOLLIN, EPOLL_CTL_ADD);
+    watchsocket(pingsocket, &pingsocket, EPOLLIN, EPOLL_CTL_ADD);
+    return true;
+}
+
+void checkclients()
+{
+    static epoll_event events[256];
+    int n = epoll_wait(epollfd, events, sizeof(events)/sizeof(events[0]), 1000);
+    servtime = enet_time_get();
+    loopi(n)
+    {
+        void *data = events[i].data.ptr;
+        if(data == &pingsocket) checkserverpongs();
+        else if(data == authpipe) checkauthjobs();
+        else if(data == &serversocket) acceptclients();
+        else
+        {
+            client &c = *(client *)data;
+            if(c.dead) continue;
+            if(events[i].events & (EPOLLERR | EPOLLHUP)) purgeclient(c);
+            else if(c.wantswrite() ? !writeclient(c) : !readclient(c)) purgeclient(c);
+        }
+    }
+    if(ENET_TIME_DIFFERENCE(servtime, lastsweep) >= SWEEP_TIME)
+    {
+        loopv(clients) if(!clients[i]->dead && !checkclienttime(*clients[i])) purgeclient(i);
+        lastsweep = servtime;
+    }
+    flushclients();
+    logliststats();
+}
+#else
+#ifndef WIN32
+void watchauthpipe() {}
+#endif
 
 void checkclients()
 {
@@ -602,95 +983,47 @@ void checkclients()
     ENET_SOCKETSET_EMPTY(writeset);
     ENET_SOCKETSET_ADD(readset, serversocket);
     ENET_SOCKETSET_ADD(readset, pingsocket);
+#ifndef WIN32
+    if(authworkers)
+    {
+        ENET_SOCKETSET_ADD(readset, authpipe[0]);
+        maxsock = max(maxsock, authpipe[0]);
+    }
+#endif
     loopv(clients)
     {
         client &c = *clients[i];
         if(c.authreqs.length()) purgeauths(c);
-        if(c.message || c.output.length()) ENET_SOCKETSET_ADD(writeset, c.socket);
+        if(c.wantswrite()) ENET_SOCKETSET_ADD(writeset, c.socket);
         else ENET_SOCKETSET_ADD(readset, c.socket);
         maxsock = max(maxsock, c.socket);
     }
     if(enet_socketset_select(maxsock, &readset, &writeset, 1000)<=0) return;
+    servtime = enet_time_get();
 
     if(ENET_SOCKETSET_CHECK(readset, pingsocket)) checkserverpongs();
-    if(ENET_SOCKETSET_CHECK(readset, serversocket))
-    {
-        ENetAddress address;
-        ENetSocket clientsocket = enet_socket_accept(serversocket, &address);
-        if(clients.length()>=CLIENT_LIMIT || checkban(bans, address.host)) enet_socket_destroy(clientsocket);
-        else if(clientsocket!=ENET_SOCKET_NULL)
-        {
-            int dups = 0, oldest = -1;
-            loopv(clients) if(clients[i]->address.host == address.host)
-            {
-                dups++;
-                if(oldest<0 || clients[i]->connecttime < clients[oldest]->connecttime) oldest = i;
-            }
-            if(dups >= DUP_LIMIT) purgeclient(oldest);
-
-            client *c = new client;
-            c->address = address;
-            c->socket = clientsocket;
-            c->connecttime = servtime;
-            c->lastinput = servtime;
-            clients.add(c);
-        }
-    }
+    if(ENET_SOCKETSET_CHECK(readset, serversocket)) acceptclients();
+#ifndef WIN32
+    if(authworkers && ENET_SOCKETSET_CHECK(readset, authpipe[0])) checkauthjobs();
+#endif
 
     loopv(clients)
     {
         client &c = *clients[i];
-        if((c.message || c.output.length()) && ENET_SOCKETSET_CHECK(writeset, c.socket))
-        {
-            const char *data = c.output.length() ? c.output.getbuf() : c.message->getbuf();
-            int len = c.output.length() ? c.output.length() : c.message->length();
-            ENetBuffer buf;
-            buf.data = (void *)&data[c.outputpos];
-            buf.dataLength = len-c.outputpos;
-            int res = enet_socket_send(c.socket, NULL, &buf, 1);
-            if(res>=0)
-            {
-                c.outputpos += res;
-                if(c.outputpos>=len)
-                {
-                    if(c.output.length()) c.output.setsize(0);
-                    else
-                    {
-                        c.message->purge();
-                        c.message = NULL;
-                    }
-                    c.outputpos = 0;
-                    if(!c.message && c.output.empty() && c.shouldpurge)
-                    {
-                        purgeclient(i--);
-                        continue;
-                    }
-                }
-            }
-            else { purgeclient(i--); continue; }
-        }
-        if(ENET_SOCKETSET_CHECK(readset, c.socket))
-        {
-            ENetBuffer buf;
-            buf.data = &c.input[c.inputpos];
-            buf.dataLength = sizeof(c.input) - c.inputpos;
-            int res = enet_socket_receive(c.socket, NULL, &buf, 1);
-            if(res>0)
-            {
-                c.inputpos += res;
-                c.input[min(c.inputpos, (int)sizeof(c.input)-1)] = '\0';
-                if(!checkclientinput(c)) { purgeclient(i--); continue; }
-            }
-            else { purgeclient(i--); continue; }
-        }
-        if(c.output.length() > OUTPUT_LIMIT) { purgeclient(i--); continue; }
-        if(ENET_TIME_DIFFERENCE(servtime, c.lastinput) >= (c.registeredserver ? KEEPALIVE_TIME : CLIENT_TIME)) { purgeclient(i--); continue; }
+        if(c.dead) continue;
+        if(c.wantswrite() && ENET_SOCKETSET_CHECK(writeset, c.socket) && !writeclient(c)) { purgeclient(c); continue; }
+        if(ENET_SOCKETSET_CHECK(readset, c.socket) && !readclient(c)) { purgeclient(c); continue; }
+        if(!checkclienttime(c)) purgeclient(c);
     }
+    flushclients();
+    logliststats();
 }
+#endif
 
 void banclients()
 {
-    loopvrev(clients) if(checkban(bans, clients[i]->address.host)) purgeclient(i);
+    loopv(clients) if(checkban(bans, clients[i]->address.host)) purgeclient(i);
+    flushclients();
 }
 
 volatile bool reloadcfg = true;
@@ -721,9 +1054,13 @@ int main(int argc, char **argv)
     signal(SIGUSR1, reloadsignal);
 #endif
     setupserver(port, ip);
+#ifdef __linux__
+    if(!setupepoll()) fatal("failed to create epoll instance");
+#endif
     for(;;)
     {
-        if(reloadcfg)
+        // users and their keys are freed on reload, so wait until no worker still refers to them
+        if(reloadcfg && !pendingauths)
         {
             conoutf("reloading %s", cfgname);
             execfile(cfgname);
@@ -19,6 +19,69 @@ struct normalgroup
 
 static inline bool htcmp(const normalkey &k, const normalgroup &n) { return k.pos == n.pos && k.smooth == n.smooth; }
 
+// open addressing over a dense group array, so lookups probe a flat index array instead of chasing chains
+struct normaltable
+{
+    vector<normalgroup> groups;
+    int *index, bits;
+
+    normaltable() : index(NULL), bits(0) {}
+    ~normaltable() { DELETEA(index); }
+
+    uint slot(const normalkey &key) const { return (hthash(key)*0x9E3779B1U)>>(32-bits); }
+
+    void grow()
+    {
+        DELETEA(index);
+        bits = max(bits+1, 12);
+        int size = 1<<bits, mask = size-1;
+        index = new int[size];
+        memset(index, -1, size*sizeof(int));
+        loopv(groups)
+        {
+            normalkey key = { groups[i].pos, groups[i].smooth };
+            uint h = slot(key);
+            while(index[h] >= 0) h = (h+1)&mask;
+            index[h] = i;
+        }
+    }
+
+    int find(const normalkey &key) const
+    {
+        if(!index) return -1;
+        int mask = (1<<bits)-1;
+        for(uint h = slot(key);; h = (h+1)&mask)
+        {
+            int i = index[h];
+            if(i < 0 || htcmp(key, groups[i])) return i;
+        }
+    }
+
+    int access(const normalkey &key)
+    {
+        if(2*(groups.length()+1) > 1<<bits) grow();
+        int mask = (1<<bits)-1;
+        uint h = slot(key);
+        for(; index[h] >= 0; h = (h+1)&mask) if(htcmp(key, groups[index[h]])) return index[h];
+        groups.add(normalgroup(key));
+        return index[h] = groups.length()-1;
+    }
+
+    void clear()
+    {
+        groups.setsize(0);
+        DELETEA(index);
+        bits = 0;
+    }
+
+    void move(normaltable &o)
+    {
+        groups.move(o.groups);
+        swap(index, o.index);
+        swap(bits, o.bits);
+    }
+};
+
 struct normal
 {
     int next;
@@ -30,12 +93,32 @@ struct tnormal
     int next;
     float offset;
     int normals[2];
-    normalgroup *groups[2];
+    int groups[2];
+};
+
+struct normalset
+{
+    normaltable groups;
+    vector<normal> normals;
+    vector<tnormal> tnormals;
+
+    void clear()
+    {
+        groups.clear();
+        normals.setsize(0);
+        tnormals.setsize(0);
+    }
+
+    void move(normalset &o)
+    {
+        groups.move(o.groups);
+        normals.move(o.normals);
+        tnormals.move(o.tnormals);
+    }
 };
 
-hashset<normalgroup> normalgroups(1<<16);
-vector<normal> normals;
-vector<tnormal> tnormals;
+static normalset worldnormals;
+static THREADLOCAL normalset *curnormals = &worldnormals;
 vector<int> smoothgroups;
 
 VARR(lerpangle, 0, 44, 180);
@@ -44,33 +127,36 @@ static bool usetnormals = true;
 
 static int addnormal(const vec &pos, int smooth, const vec &surface)
 {
+    normalset &ns = *curnormals;
     normalkey key = { pos, smooth };
-    normalgroup &g = normalgroups.access(key, key);
-    normal &n = normals.add();
+    normalgroup &g = ns.groups.groups[ns.groups.access(key)];
+    normal &n = ns.normals.add();
     n.next = g.normals;
     n.surface = surface;
-    return g.normals = normals.length()-1;
+    return g.normals = ns.normals.length()-1;
 }
 
 static void addtnormal(const vec &pos, int smooth, float offset, int normal1, int normal2, const vec &pos1, const vec &pos2)
 {
+    normalset &ns = *curnormals;
     normalkey key = { pos, smooth };
-    normalgroup &g = normalgroups.access(key, key);
-    tnormal &n = tnormals.add();
+    normalgroup &g = ns.groups.groups[ns.groups.access(key)];
+    tnormal &n = ns.tnormals.add();
     n.next = g.tnormals;
     n.offset = offset;
     n.normals[0] = normal1;
     n.normals[1] = normal2;
     normalkey key1 = { pos1, smooth }, key2 = { pos2, smooth };
-    n.groups[0] = normalgroups.access(key1);
-    n.groups[1] = normalgroups.access(key2);
-    g.tnormals = tnormals.length()-1;
+    n.groups[0] = ns.groups.find(key1);
+    n.groups[1] = ns.groups.find(key2);
+    g.tnormals = ns.tnormals.length()-1;
 }
 
 static int addnormal(const vec &pos, int smooth, int axis)
 {
+    normalset &ns = *curnormals;
     normalkey key = { pos, smooth };
-    normalgroup &g = normalgroups.access(key, key);
+    normalgroup &g = ns.groups.groups[ns.groups.access(key)];
     g.flat += 1<<(4*axis);
     return axis - 6;
 }
@@ -87,7 +173,7 @@ static inline void findnormal(const normalgroup &g, float lerpthreshold, const v
     else if(surface.z <= -lerpthreshold) { int n = (g.flat>>16)&0xF; v.z -= n; total += n; }
     for(int cur = g.normals; cur >= 0;)
     {
-        normal &o = normals[cur];
+        normal &o = worldnormals.normals[cur];
         if(o.surface.dot(surface) >= lerpthreshold)
         {
             v.add(o.surface);
@@ -105,10 +191,10 @@ static inline bool findtnormal(const normalgroup &g, float lerpthreshold, const
     tnormal *bestnorm = NULL;
     for(int cur = g.tnormals; cur >= 0;)
     {
-        tnormal &o = tnormals[cur];
+        tnormal &o = worldnormals.tnormals[cur];
         static const vec flats[6] = { vec(-1, 0, 0), vec(1, 0, 0), vec(0, -1, 0), vec(0, 1, 0), vec(0, 0, -1), vec(0, 0, 1) };
-        vec n1 = o.normals[0] < 0 ? flats[o.normals[0]+6] : normals[o.normals[0]].surface,
-            n2 = o.normals[1] < 0 ? flats[o.normals[1]+6] : normals[o.normals[1]].surface,
+        vec n1 = o.normals[0] < 0 ? flats[o.normals[0]+6] : worldnormals.normals[o.normals[0]].surface,
+            n2 = o.normals[1] < 0 ? flats[o.normals[1]+6] : worldnormals.normals[o.normals[1]].surface,
             nt;
         nt.lerp(n1, n2, o.offset).normalize();
         float tangle = nt.dot(surface);
@@ -121,8 +207,8 @@ static inline bool findtnormal(const normalgroup &g, float lerpthreshold, const
     }
     if(!bestnorm) return false;
     vec n1, n2;
-    findnormal(*bestnorm->groups[0], lerpthreshold, surface, n1);
-    findnormal(*bestnorm->groups[1], lerpthreshold, surface, n2);
+    findnormal(worldnormals.groups.groups[bestnorm->groups[0]], lerpthreshold, surface, n1);
+    findnormal(worldnormals.groups.groups[bestnorm->groups[1]], lerpthreshold, surface, n2);
     v.lerp(n1, n2, bestnorm->offset).normalize();
     return true;
 }
@@ -130,9 +216,10 @@ static inline bool findtnormal(const normalgroup &g, float lerpthreshold, const
 void findnormal(const vec &pos, int smooth, const vec &surface, vec &v)
 {
     normalkey key = { pos, smooth };
-    const normalgroup *g = normalgroups.access(key);
-    if(g)
+    int idx = worldnormals.groups.find(key);
+    if(idx >= 0)
     {
+        const normalgroup *g = &worldnormals.groups.groups[idx];
         int angle = smoothgroups.inrange(smooth) && smoothgroups[smooth] >= 0 ? smoothgroups[smooth] : lerpangle;
         float lerpthreshold = cos360(angle) - 1e-5f;
         if(g->tnormals < 0 || !findtnormal(*g, lerpthreshold, surface, v))
@@ -152,13 +239,18 @@ void show_addnormals_progress()
     renderprogress(bar1, "computing normals...");
 }
 
+// worker threads can't render progress, they only notice when the main thread cancels
+#define CHECK_NORMALS_PROGRESS(exit) \
+    if(curnormals != &worldnormals) { if(calclight_canceled) { exit; } } \
+    else CHECK_CALCLIGHT_PROGRESS(exit, show_addnormals_progress)
+
 void addnormals(cube &c, const ivec &o, int size)
 {
-    CHECK_CALCLIGHT_PROGRESS(return, show_addnormals_progress);
+    CHECK_NORMALS_PROGRESS(return);
 
     if(c.children)
     {
-        normalprogress++;
+        if(curnormals == &worldnormals) normalprogress++;
         size >>= 1;
         loopi(8) addnormals(c.children[i], ivec(i, o, size), size);
         return;
@@ -170,7 +262,7 @@ void addnormals(cube &c, const ivec &o, int size)
     int tj = usetnormals && c.ext ? c.ext->tjoints : -1, vis;
     loopi(6) if((vis = visibletris(c, i, o, size)))
     {
-        CHECK_CALCLIGHT_PROGRESS(return, show_addnormals_progress);
+        CHECK_NORMALS_PROGRESS(return);
         if(c.texture[i] == DEFAULT_SKY) continue;
 
         vec planes[2];
@@ -248,20 +340,218 @@ void addnormals(cube &c, const ivec &o, int size)
     }
 }
 
+VARP(normalthreads, 0, 0, 16);
+
+// each job gathers one subtree into its own set; the sets are spliced into the world set in tree order,
+// which leaves every array and chain exactly as a single pass over the whole tree would have
+struct normaljob
+{
+    cube *c;
+    ivec o;
+    int size;
+    normalset normals;
+    SDL_atomic_t done;
+};
+
+static vector<normaljob *> normaljobs;
+static SDL_atomic_t nextnormaljob;
+static SDL_sem *normaljobsdone = NULL;
+static int normaljobsmerged = 0, normalthreadsused = 0;
+
+static void findnormaljobs(cube *c, const ivec &co, int size)
+{
+    loopi(8)
+    {
+        ivec o(i, co, size);
+        if(c[i].children && size > worldsize/8) findnormaljobs(c[i].children, o, size/2);
+        else if(c[i].children || !isempty(c[i]))
+        {
+            normaljob &job = *normaljobs.add(new normaljob);
+            job.c = &c[i];
+            job.o = o;
+            job.size = size;
+            SDL_AtomicSet(&job.done, 0);
+        }
+    }
+}
+
+static int normalworker(void *data)
+{
+    for(;;)
+    {
+        int i = SDL_AtomicAdd(&nextnormaljob, 1);
+        if(i >= normaljobs.length()) break;
+        normaljob &job = *normaljobs[i];
+        curnormals = &job.normals;
+        addnormals(*job.c, job.o, job.size);
+        SDL_AtomicSet(&job.done, 1);
+        SDL_SemPost(normaljobsdone);
+    }
+    return 0;
+}
+
+static void mergenormals(normalset &src)
+{
+    normalset &dst = worldnormals;
+    int nbase = dst.normals.length(), tbase = dst.tnormals.length();
+    loopv(src.normals)
+    {
+        normal &n = dst.normals.add(src.normals[i]);
+        if(n.next >= 0) n.next += nbase;
+    }
+    vector<int> remap;
+    loopv(src.groups.groups)
+    {
+        const normalgroup &g = src.groups.groups[i];
+        normalkey key = { g.pos, g.smooth };
+        remap.add(dst.groups.access(key));
+    }
+    loopv(src.tnormals)
+    {
+        tnormal &n = dst.tnormals.add(src.tnormals[i]);
+        if(n.next >= 0) n.next += tbase;
+        loopk(2)
+        {
+            if(n.normals[k] >= 0) n.normals[k] += nbase;
+            if(n.groups[k] >= 0) n.groups[k] = remap[n.groups[k]];
+        }
+    }
+    loopv(src.groups.groups)
+    {
+        const normalgroup &g = src.groups.groups[i];
+        normalgroup &d = dst.groups.groups[remap[i]];
+        d.flat += g.flat;
+        if(g.normals >= 0)
+        {
+            int tail = g.normals + nbase;
+            while(dst.normals[tail].next >= 0) tail = dst.normals[tail].next;
+            dst.normals[tail].next = d.normals;
+            d.normals = g.normals + nbase;
+        }
+        if(g.tnormals >= 0)
+        {
+            int tail = g.tnormals + tbase;
+            while(dst.tnormals[tail].next >= 0) tail = dst.tnormals[tail].next;
+            dst.tnormals[tail].next = d.tnormals;
+            d.tnormals = g.tnormals + tbase;
+        }
+    }
+}
+
+static void show_normaljobs_progress()
+{
+    renderprogress(float(normaljobsmerged) / float(normaljobs.length()), "computing normals...");
+}
+
+static bool calcnormaljobs()
+{
+    normalthreadsused = 1;
+    int numthreads = normalthreads > 0 ? normalthreads : numcpus;
+    if(numthreads <= 1) return false;
+    findnormaljobs(worldroot, ivec(0, 0, 0), worldsize/2);
+    if(normaljobs.length() <= 1) { normaljobs.deletecontents(); return false; }
+    numthreads = min(numthreads, normaljobs.length());
+    if(!normaljobsdone) normaljobsdone = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&nextnormaljob, 0);
+    vector<SDL_Thread *> workers;
+    loopi(numthreads) workers.add(SDL_CreateThread(normalworker, "normal worker", NULL));
+    for(normaljobsmerged = 0; normaljobsmerged < normaljobs.length();)
+    {
+        normaljob &job = *normaljobs[normaljobsmerged];
+        if(SDL_AtomicGet(&job.done))
+        {
+            mergenormals(job.normals);
+            job.normals.clear();
+            normaljobsmerged++;
+        }
+        else if(SDL_SemWaitTimeout(normaljobsdone, 100)) CHECK_CALCLIGHT_PROGRESS(, show_normaljobs_progress);
+    }
+    loopv(workers) SDL_WaitThread(workers[i], NULL);
+    while(!SDL_SemTryWait(normaljobsdone));
+    normaljobs.deletecontents();
+    normalthreadsused = numthreads;
+    return true;
+}
+
 void calcnormals(bool lerptjoints)
 {
     usetnormals = lerptjoints;
     if(usetnormals) findtjoints();
     normalprogress = 1;
-    loopi(8) addnormals(worldroot[i], ivec(i, ivec(0, 0, 0), worldsize/2), worldsize/2);
+    if(!calcnormaljobs())
+        loopi(8) addnormals(worldroot[i], ivec(i, ivec(0, 0, 0), worldsize/2), worldsize/2);
+}
+
+static void addnormals(cube *c, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax)
+{
+    loopoctabox(co, size, bbmin, bbmax)
+    {
+        ivec o(i, co, size);
+        if(c[i].children) addnormals(c[i].children, o, size>>1, bbmin, bbmax);
+        else addnormals(c[i], o, size);
+    }
+}
+
+// smoothing needs every face sharing a vertex with the region, so neighbours just outside are gathered too
+void calcnormals(const ivec &bbmin, const ivec &bbmax, bool lerptjoints)
+{
+    usetnormals = lerptjoints;
+    addnormals(worldroot, ivec(0, 0, 0), worldsize/2, ivec(bbmin).sub(1), ivec(bbmax).add(1));
 }
 
 void clearnormals()
 {
-    normalgroups.clear();
-    normals.setsize(0);
-    tnormals.setsize(0);
+    worldnormals.clear();
+}
+
+static bool samenormals(const normalset &a, const normalset &b)
+{
+    if(a.normals.length() != b.normals.length() || a.tnormals.length() != b.tnormals.length() || a.groups.groups.length() != b.groups.groups.length()) return false;
+    if(a.normals.length() && memcmp(a.normals.getbuf(), b.normals.getbuf(), a.normals.length()*sizeof(normal))) return false;
+    loopv(a.tnormals)
+    {
+        const tnormal &x = a.tnormals[i], &y = b.tnormals[i];
+        if(x.next != y.next || memcmp(&x.offset, &y.offset, sizeof(float)) || x.normals[0] != y.normals[0] || x.normals[1] != y.normals[1]) return false;
+        loopk(2)
+        {
+            const normalgroup &gx = a.groups.groups[x.groups[k]], &gy = b.groups.groups[y.groups[k]];
+            if(gx.pos != gy.pos || gx.smooth != gy.smooth) return false;
+        }
+    }
+    loopv(a.groups.groups)
+    {
+        const normalgroup &g = a.groups.groups[i];
+        normalkey key = { g.pos, g.smooth };
+        int j = b.groups.find(key);
+        if(j < 0) return false;
+        const normalgroup &h = b.groups.groups[j];
+        if(g.flat != h.flat || g.normals != h.normals || g.tnormals != h.tnormals) return false;
+    }
+    return true;
+}
+
+extern int filltjoints;
+
+void normalbench(int *numthreads)
+{
+    if(!worldroot) return;
+    int oldthreads = normalthreads, threads[2] = { 1, *numthreads > 0 ? *numthreads : numcpus };
+    normalset single;
+    loopi(2)
+    {
+        normalthreads = threads[i];
+        clearnormals();
+        ullong start = getmicroseconds();
+        calcnormals(filltjoints > 0);
+        conoutf("%d thread(s): %.2f ms, %d groups, %d normals, %d tnormals",
+            normalthreadsused, (getmicroseconds() - start)/1000.0f, worldnormals.groups.groups.length(), worldnormals.normals.length(), worldnormals.tnormals.length());
+        if(!i) single.move(worldnormals);
+    }
+    conoutf(samenormals(single, worldnormals) ? "normals match" : "\f3normals differ");
+    normalthreads = oldthreads;
+    clearnormals();
 }
+COMMAND(normalbench, "i");
 
 void resetsmoothgroups()
 {
@@ -16,12 +16,113 @@ static struct emptycube : cube
     }
 } emptycube;
 
+// child blocks and cube exts are carved out of chunked freelists rather than allocated one by one,
+// so blocks loaded depth-first sit next to each other in memory and freeing a map is just list pushes
+struct octapool
+{
+    enum { CHUNKSIZE = 32<<10, CHUNKHEADER = 16 };
+
+    struct item { item *next; };
+    struct chunk { chunk *next; };
+
+    int itemsize, chunkitems, numused;
+    chunk *chunks;
+    item *unused;
+
+    void init(int size)
+    {
+        itemsize = (size + 15)&~15;
+        chunkitems = max((CHUNKSIZE - CHUNKHEADER)/itemsize, 1);
+    }
+
+    void *alloc()
+    {
+        if(!unused)
+        {
+            chunk *c = (chunk *)new uchar[CHUNKHEADER + chunkitems*itemsize];
+            c->next = chunks;
+            chunks = c;
+            uchar *items = (uchar *)c + CHUNKHEADER;
+            loopi(chunkitems-1) ((item *)&items[i*itemsize])->next = (item *)&items[(i+1)*itemsize];
+            ((item *)&items[(chunkitems-1)*itemsize])->next = NULL;
+            unused = (item *)items;
+        }
+        item *i = unused;
+        unused = i->next;
+        numused++;
+        return i;
+    }
+
+    void free(void *p)
+    {
+        item *i = (item *)p;
+        i->next = unused;
+        unused = i;
+        numused--;
+    }
+
+    void trim()
+    {
+        if(numused) return;
+        for(chunk *next; chunks; chunks = next)
+        {
+            next = chunks->next;
+            delete[] (uchar *)chunks;
+        }
+        unused = NULL;
+    }
+};
+
+static octapool cubepool, extpools[256/4 + 1];
+
+// vertex arrays may be built on worker threads, which create cube exts as they go, but child blocks
+// are only ever allocated and freed on the main thread, so only the ext pools need the lock
+static SDL_SpinLock extpoollock = 0;
+
+static inline int extpoolindex(int maxverts) { return (min(maxverts, 255)+3)/4; }
+
+static void trimoctapools()
+{
+    cubepool.trim();
+    loopi(sizeof(extpools)/sizeof(extpools[0])) extpools[i].trim();
+}
+
+static inline cube *alloccubes()
+{
+    if(!cubepool.itemsize) cubepool.init(8*sizeof(cube));
+    return (cube *)cubepool.alloc();
+}
+
+static inline void freecubes(cube *c)
+{
+    cubepool.free(c);
+}
+
+static inline cubeext *allocext(int maxverts)
+{
+    int index = extpoolindex(maxverts);
+    SDL_AtomicLock(&extpoollock);
+    octapool &pool = extpools[index];
+    if(!pool.itemsize) pool.init(sizeof(cubeext) + min(index*4, 255)*sizeof(vertinfo));
+    cubeext *ext = (cubeext *)pool.alloc();
+    SDL_AtomicUnlock(&extpoollock);
+    ext->maxverts = min(index*4, 255);
+    return ext;
+}
+
+static inline void freeext(cubeext *ext)
+{
+    SDL_AtomicLock(&extpoollock);
+    extpools[extpoolindex(ext->maxverts)].free(ext);
+    SDL_AtomicUnlock(&extpoollock);
+}
+
 cube *worldroot = newcubes(F_SOLID);
 int allocnodes = 0;
 
 cubeext *growcubeext(cubeext *old, int maxverts)
 {
-    cubeext *ext = (cubeext *)new uchar[sizeof(cubeext) + maxverts*sizeof(vertinfo)];
+    cubeext *ext = allocext(maxverts);
     if(old)
     {
         ext->va = old->va;
@@ -34,7 +135,6 @@ cubeext *growcubeext(cubeext *old, int maxverts)
         ext->ents = NULL;
         ext->tjoints = -1;
     }
-    ext->maxverts = maxverts;
     return ext;
 }
 
@@ -43,7 +143,7 @@ void setcubeext(cube &c, cubeext *ext)
     cubeext *old = c.ext;
     if(old == ext) return;
     c.ext = ext;
-    if(old) delete[] (uchar *)old;
+    if(old) freeext(old);
 }
 
 cubeext *newcubeext(cube &c, int maxverts, bool init)
@@ -65,7 +165,7 @@ cubeext *newcubeext(cube &c, int maxverts, bool init)
 
 cube *newcubes(uint face, int mat)
 {
-    cube *c = new cube[8];
+    cube *c = alloccubes();
     loopi(8)
     {
         c->children = NULL;
@@ -92,15 +192,15 @@ void freeocta(cube *c)
 {
     if(!c) return;
     loopi(8) discardchildren(c[i]);
-    delete[] c;
-    allocnodes--;
+    freecubes(c);
+    if(!--allocnodes) trimoctapools();
 }
 
 void freecubeext(cube &c)
 {
     if(c.ext)
     {
-        delete[] (uchar *)c.ext;
+        freeext(c.ext);
         c.ext = NULL;
     }
 }
@@ -131,7 +231,8 @@ void discardchildren(cube &c, bool fixtex, int depth)
             loopi(6) c.texture[i] = getmippedtexture(c, i);
             if(depth > 0 && filled != F_EMPTY) c.faces[0] = F_SOLID;
         }
-        DELETEA(c.children);
+        freecubes(c.children);
+        c.children = NULL;
         allocnodes--;
     }
 }
@@ -183,6 +284,45 @@ void printcube()
 
 COMMAND(printcube, "");
 
+static inline int benchrnd(uint &seed, int x)
+{
+    seed = seed*1103515245U + 12345U;
+    return int((seed>>8)%uint(x));
+}
+
+static inline vec benchvec(uint &seed, int lo, int hi)
+{
+    vec v;
+    loopi(3) v[i] = lo + benchrnd(seed, hi - lo);
+    return v;
+}
+
+void octabench(int *n)
+{
+    int numrays = *n > 0 ? *n : 100000, nodes = 0, found = 0;
+    uint seed = 1;
+    ullong start = getmicroseconds();
+    loopi(8) nodes += familysize(worldroot[i]);
+    ullong walked = getmicroseconds();
+    loopi(numrays)
+    {
+        ivec o(benchvec(seed, 0, worldsize));
+        if(!isempty(lookupcube(o, 0))) found++;
+    }
+    ullong lookedup = getmicroseconds();
+    float dist = 0;
+    loopi(numrays)
+    {
+        vec o = benchvec(seed, 0, worldsize), ray = benchvec(seed, -1000, 1001);
+        if(!ray.iszero()) dist += raycube(o, ray.normalize(), 0, RAY_CLIPMAT|RAY_POLY);
+    }
+    ullong raycast = getmicroseconds();
+    conoutf("octabench: walked %d nodes in %.2f ms, %d lookups in %.2f ms (%d solid), %d raycasts in %.2f ms (avg dist %.1f)",
+        nodes, (walked - start)/1000.0f, numrays, (lookedup - walked)/1000.0f, found, numrays, (raycast - lookedup)/1000.0f, dist/numrays);
+    conoutf("octabench: %d child blocks in %d byte slots", cubepool.numused, cubepool.itemsize);
+}
+COMMAND(octabench, "i");
+
 bool isvalidcube(const cube &c)
 {
     clipplanes p;
@@ -273,8 +413,8 @@ int lookupmaterial(const vec &v)
     return c->material;
 }
 
-const cube *neighbourstack[32];
-int neighbourdepth = -1;
+THREADLOCAL const cube *neighbourstack[32];
+THREADLOCAL int neighbourdepth = -1;
 
 const cube &neighbourcube(const cube &c, int orient, const ivec &co, int size, ivec &ro, int &rsize)
 {
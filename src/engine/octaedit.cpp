@@ -499,6 +499,7 @@ void tryedit()
 //////////// ready changes to vertex arrays ////////////
 
 static bool haschanged = false;
+static ivec changedmin, changedmax;
 
 void readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const ivec &cor, int size)
 {
@@ -531,27 +532,42 @@ void readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const ivec &cor
     }
 }
 
+extern int filltjoints;
+VARP(editnormals, 0, 0, 1);
+
+// only the t-joints, normals, shadows and shadow meshes touching the changed box are rebuilt
 void commitchanges(bool force)
 {
     if(!force && !haschanged) return;
+    bool region = haschanged;
     haschanged = false;
 
     extern vector<vtxarray *> valist;
     int oldlen = valist.length();
     resetclipplanes();
     entitiesinoctanodes();
+    if(region)
+    {
+        if(filltjoints) findtjoints(changedmin, changedmax);
+        if(editnormals) calclight(changedmin, changedmax);
+    }
     inbetweenframes = false;
     octarender();
     inbetweenframes = true;
     setupmaterials(oldlen);
-    clearshadowcache();
+    if(region) clearshadowcache(changedmin, changedmax);
+    else clearshadowcache();
     updatevabbs();
+    if(region) updateshadowmeshes(changedmin, changedmax);
 }
 
 void changed(const block3 &sel, bool commit = true)
 {
     if(sel.s.iszero()) return;
-    readychanges(ivec(sel.o).sub(1), ivec(sel.s).mul(sel.grid).add(sel.o).add(1), worldroot, ivec(0, 0, 0), worldsize/2);
+    ivec bbmin = ivec(sel.o).sub(1), bbmax = ivec(sel.s).mul(sel.grid).add(sel.o).add(1);
+    readychanges(bbmin, bbmax, worldroot, ivec(0, 0, 0), worldsize/2);
+    if(haschanged) { changedmin.min(bbmin); changedmax.max(bbmax); }
+    else { changedmin = bbmin; changedmax = bbmax; }
     haschanged = true;
 
     if(commit) commitchanges();
@@ -1578,6 +1594,47 @@ void delcube()
 
 COMMAND(pushsel, "i");
 COMMAND(editface, "ii");
+
+static inline int stressrnd(uint &seed, int x)
+{
+    seed = seed*1103515245U + 12345U;
+    return int((seed>>16)%uint(x));
+}
+
+// replays a fixed log of push/pull edits around the selection and reports how long each edit took to commit
+void editstress(int *n)
+{
+    if(noedit() || multiplayer()) return;
+    int numedits = *n > 0 ? *n : 100, grid = havesel ? sel.grid : 8, done = 0;
+    ivec center = havesel ? ivec(sel.s).mul(sel.grid/2).add(sel.o) : ivec(worldsize/2, worldsize/2, worldsize/2);
+    uint seed = 1;
+    ullong worst = 0, total = 0;
+    loopi(numedits)
+    {
+        selinfo s;
+        s.grid = grid;
+        s.orient = stressrnd(seed, 6);
+        s.s = ivec(1 + stressrnd(seed, 4), 1 + stressrnd(seed, 4), 1 + stressrnd(seed, 4));
+        int d = dimension(s.orient);
+        s.s[d] = 1;
+        loopk(3) s.o[k] = (center[k]/grid + stressrnd(seed, 17) - 8)*grid;
+        int dir = stressrnd(seed, 2) ? 1 : -1;
+        if(!s.validate()) continue;
+        s.cxs = 2*s.s[R[d]];
+        s.cys = 2*s.s[C[d]];
+
+        ullong start = getmicroseconds();
+        makeundoex(s);
+        mpeditface(dir, 0, s, false);
+        ullong elapsed = getmicroseconds() - start;
+        worst = max(worst, elapsed);
+        total += elapsed;
+        done++;
+    }
+    if(done) editundo();
+    conoutf("editstress: %d edits, worst %.2f ms, average %.2f ms", done, worst/1000.0f, done ? total/(1000.0f*done) : 0.0f);
+}
+COMMAND(editstress, "i");
 COMMAND(delcube, "");
 
 /////////// texture editing //////////////////
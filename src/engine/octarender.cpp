@@ -198,6 +198,14 @@ static inline uint hthash(const sortkey &k)
     return k.tex;
 }
 
+// vertex and index data of a finished vertex array, waiting to be copied into the shared vbos
+struct vaupload
+{
+    vtxarray *va;
+    vector<vertex> verts;
+    vector<ushort> skyindices, indices;
+};
+
 struct vacollect : verthash
 {
     ivec origin;
@@ -213,6 +221,8 @@ struct vacollect : verthash
     vec refractmin, refractmax;
     ivec nogimin, nogimax;
 
+    vacollect() { clear(); }
+
     void clear()
     {
         clearverts();
@@ -281,7 +291,7 @@ struct vacollect : verthash
         GENVERTS(vertex, buf, { *f = v; f->norm.flip(); f->tangent.flip(); f->bitangent -= 128; });
     }
 
-    void setupdata(vtxarray *va)
+    void setupdata(vtxarray *va, vaupload &u)
     {
         va->verts = verts.length();
         va->tris = worldtris/3;
@@ -290,18 +300,7 @@ struct vacollect : verthash
         va->minvert = 0;
         va->maxvert = va->verts-1;
         va->voffset = 0;
-        if(va->verts)
-        {
-            if(vbosize[VBO_VBUF] + verts.length() > maxvbosize ||
-               vbosize[VBO_EBUF] + worldtris > USHRT_MAX ||
-               vbosize[VBO_SKYBUF] + skytris > USHRT_MAX)
-                flushvbo();
-
-            uchar *vdata = addvbo(va, VBO_VBUF, va->verts, sizeof(vertex));
-            genverts(vdata);
-            va->minvert += va->voffset;
-            va->maxvert += va->voffset;
-        }
+        if(va->verts) genverts(u.verts.pad(va->verts));
 
         va->matbuf = NULL;
         va->matsurfs = matsurfs.length();
@@ -327,12 +326,7 @@ struct vacollect : verthash
         va->skydata = 0;
         va->skyoffset = 0;
         va->sky = skyindices.length();
-        if(va->sky)
-        {
-            ushort *skydata = (ushort *)addvbo(va, VBO_SKYBUF, va->sky, sizeof(ushort));
-            memcpy(skydata, skyindices.getbuf(), va->sky*sizeof(ushort));
-            if(va->voffset) loopi(va->sky) skydata[i] += va->voffset;
-        }
+        if(va->sky) u.skyindices.put(skyindices.getbuf(), va->sky);
 
         va->eslist = NULL;
         va->texs = texs.length();
@@ -350,7 +344,7 @@ struct vacollect : verthash
         if(va->texs)
         {
             va->eslist = new elementset[va->texs];
-            ushort *edata = (ushort *)addvbo(va, VBO_EBUF, worldtris, sizeof(ushort)), *curbuf = edata;
+            ushort *curbuf = u.indices.pad(worldtris);
             loopv(texs)
             {
                 const sortkey &k = texs[i];
@@ -370,7 +364,6 @@ struct vacollect : verthash
 
                     loopvj(t.tris)
                     {
-                        curbuf[j] += va->voffset;
                         e.minvert = min(e.minvert, curbuf[j]);
                         e.maxvert = max(e.maxvert, curbuf[j]);
                     }
@@ -397,11 +390,7 @@ struct vacollect : verthash
             if(slot.shader->type&SHADER_ENVMAP) va->texmask |= 1<<TEX_ENVMAP;
         }
 
-        if(grasstris.length())
-        {
-            va->grasstris.move(grasstris);
-            useshaderbyname("grass");
-        }
+        if(grasstris.length()) va->grasstris.move(grasstris);
 
         if(mapmodels.length()) va->mapmodels.put(mapmodels.getbuf(), mapmodels.length());
     }
@@ -410,10 +399,38 @@ struct vacollect : verthash
     {
         return verts.empty() && matsurfs.empty() && skyindices.empty() && grasstris.empty() && mapmodels.empty();
     }
-} vc;
+};
+
+struct mergedface
+{
+    uchar orient, numverts;
+    ushort mat, tex, envmap;
+    vertinfo *verts;
+    int tjoints;
+};
+
+#define MAXMERGELEVEL 12
+
+vector<vtxarray *> valist, varoot;
+
+// all the state needed to generate vertex arrays for a subtree, so that worker threads can each build
+// separate subtrees while the main thread owns the GL buffers and adds the results in tree order
+struct vabuild
+{
+    vacollect vc;
+    vector<mergedface> merges[MAXMERGELEVEL+1];
+    int hasmerges, mergemax;
+    vector<vtxarray *> &roots;
+    vector<vaupload *> uploads;
+
+    vabuild(vector<vtxarray *> &roots) : hasmerges(0), mergemax(0), roots(roots) {}
+};
+
+static vabuild mainbuild(varoot);
+static THREADLOCAL vabuild *curbuild = &mainbuild;
 
 int recalcprogress = 0;
-#define progress(s)     if((recalcprogress++&0xFFF)==0) renderprogress(recalcprogress/(float)allocnodes, s);
+#define progress(s)     if(curbuild == &mainbuild && (recalcprogress++&0xFFF)==0) renderprogress(recalcprogress/(float)allocnodes, s);
 
 vector<tjoint> tjoints;
 
@@ -457,6 +474,7 @@ extern const vec orientation_bitangent[6][6] =
 
 void addtris(VSlot &vslot, int orient, const sortkey &key, vertex *verts, int *index, int numverts, int convex, int tj)
 {
+    vacollect &vc = curbuild->vc;
     int &total = key.tex==DEFAULT_SKY ? vc.skytris : vc.worldtris;
     int edge = orient*(MAXFACEVERTS+1);
     loopi(numverts-2) if(index[0]!=index[i+1] && index[i+1]!=index[i+2] && index[i+2]!=index[0])
@@ -545,6 +563,7 @@ void addtris(VSlot &vslot, int orient, const sortkey &key, vertex *verts, int *i
 
 void addgrasstri(int face, vertex *verts, int numv, ushort texture, int layer)
 {
+    vacollect &vc = curbuild->vc;
     grasstri &g = vc.grasstris.add();
     int i1, i2, i3, i4;
     if(numv <= 3 && face%2) { i1 = face+1; i2 = face+2; i3 = i4 = 0; }
@@ -651,6 +670,7 @@ void guessnormals(const vec *pos, int numverts, vec *normals)
 
 void addcubeverts(VSlot &vslot, int orient, int size, vec *pos, int convex, ushort texture, vertinfo *vinfo, int numverts, int tj = -1, ushort envmap = EMID_NONE, int grassy = 0, bool alpha = false, int layer = LAYER_TOP)
 {
+    vacollect &vc = curbuild->vc;
     vec4 sgen, tgen;
     calctexgen(vslot, orient, sgen, tgen);
     vertex verts[MAXFACEVERTS];
@@ -737,7 +757,8 @@ enum
     CE_START = 1<<0,
     CE_END   = 1<<1,
     CE_FLIP  = 1<<2,
-    CE_DUP   = 1<<3
+    CE_DUP   = 1<<3,
+    CE_FIXED = 1<<4  // edge of a cube outside the rebuilt region, only splits other edges
 };
 
 struct cubeedge
@@ -751,7 +772,7 @@ struct cubeedge
 vector<cubeedge> cubeedges;
 hashtable<edgegroup, int> edgegroups(1<<13);
 
-void gencubeedges(cube &c, const ivec &co, int size)
+void gencubeedges(cube &c, const ivec &co, int size, int flags = 0)
 {
     ivec pos[MAXFACEVERTS];
     int vis;
@@ -805,7 +826,7 @@ void gencubeedges(cube &c, const ivec &co, int size)
             ce.offset = t1;
             ce.size = t2 - t1;
             ce.index = i*(MAXFACEVERTS+1)+j;
-            ce.flags = CE_START | CE_END | (e1!=j ? CE_FLIP : 0);
+            ce.flags = CE_START | CE_END | (e1!=j ? CE_FLIP : 0) | flags;
             ce.next = -1;
 
             bool insert = true;
@@ -866,6 +887,41 @@ void gencubeedges(cube *c = worldroot, const ivec &co = ivec(0, 0, 0), int size
     --neighbourdepth;
 }
 
+// cubes touching bbmin..bbmax only contribute edges, so t-joints are found just for the cubes inside it
+static void gencubeedges(cube *c, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax, const ivec &touchmin, const ivec &touchmax, bool overlap = true)
+{
+    neighbourstack[++neighbourdepth] = c;
+    uchar inside = overlap ? octaboxoverlap(co, size, bbmin, bbmax) : 0;
+    loopoctabox(co, size, touchmin, touchmax)
+    {
+        ivec o(i, co, size);
+        if(c[i].children) gencubeedges(c[i].children, o, size>>1, bbmin, bbmax, touchmin, touchmax, (inside&(1<<i))!=0);
+        else if(isempty(c[i])) continue;
+        else if(inside&(1<<i))
+        {
+            if(c[i].ext) c[i].ext->tjoints = -1;
+            gencubeedges(c[i], o, size);
+        }
+        else gencubeedges(c[i], o, size, CE_FIXED);
+    }
+    --neighbourdepth;
+}
+
+// a cube inside bbmin..bbmax can reach far past it, and every cube along its edges has to contribute
+static void tjointbounds(cube *c, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax, ivec &touchmin, ivec &touchmax)
+{
+    loopoctabox(co, size, bbmin, bbmax)
+    {
+        ivec o(i, co, size);
+        if(c[i].children) tjointbounds(c[i].children, o, size>>1, bbmin, bbmax, touchmin, touchmax);
+        else if(!isempty(c[i]))
+        {
+            touchmin.min(o);
+            touchmax.max(ivec(o).add(size));
+        }
+    }
+}
+
 void gencubeverts(cube &c, const ivec &co, int size, int csi)
 {
     if(!(c.visible&0xC0)) return;
@@ -924,10 +980,67 @@ void gencubeverts(cube &c, const ivec &co, int size, int csi)
 
 int allocva = 0;
 int wtris = 0, wverts = 0, vtris = 0, vverts = 0, glde = 0, gbatches = 0;
-vector<vtxarray *> valist, varoot;
+
+static int vauploadtime = 0;
+
+static void uploadva(vaupload &u)
+{
+    vtxarray *va = u.va;
+    if(va->verts)
+    {
+        if(vbosize[VBO_VBUF] + va->verts > maxvbosize ||
+           vbosize[VBO_EBUF] + u.indices.length() > USHRT_MAX ||
+           vbosize[VBO_SKYBUF] + u.skyindices.length() > USHRT_MAX)
+            flushvbo();
+
+        uchar *vdata = addvbo(va, VBO_VBUF, va->verts, sizeof(vertex));
+        memcpy(vdata, u.verts.getbuf(), va->verts*sizeof(vertex));
+        va->minvert += va->voffset;
+        va->maxvert += va->voffset;
+    }
+
+    if(va->sky)
+    {
+        ushort *skydata = (ushort *)addvbo(va, VBO_SKYBUF, va->sky, sizeof(ushort));
+        memcpy(skydata, u.skyindices.getbuf(), va->sky*sizeof(ushort));
+        if(va->voffset) loopi(va->sky) skydata[i] += va->voffset;
+    }
+
+    if(u.indices.length())
+    {
+        ushort *edata = (ushort *)addvbo(va, VBO_EBUF, u.indices.length(), sizeof(ushort));
+        memcpy(edata, u.indices.getbuf(), u.indices.length()*sizeof(ushort));
+        if(va->voffset)
+        {
+            loopv(u.indices) edata[i] += va->voffset;
+            loopi(va->texs+va->blends+va->alphaback+va->alphafront+va->refract)
+            {
+                elementset &e = va->eslist[i];
+                e.minvert += va->voffset;
+                e.maxvert += va->voffset;
+            }
+        }
+    }
+
+    if(va->grasstris.length()) useshaderbyname("grass");
+
+    wverts += va->verts;
+    wtris  += va->tris + va->blends + va->alphabacktris + va->alphafronttris + va->refracttris;
+    allocva++;
+    valist.add(va);
+}
+
+static void flushvauploads(vector<vaupload *> &uploads)
+{
+    ullong start = getmicroseconds();
+    loopv(uploads) uploadva(*uploads[i]);
+    uploads.deletecontents();
+    vauploadtime += int(getmicroseconds() - start);
+}
 
 vtxarray *newva(const ivec &o, int size)
 {
+    vacollect &vc = curbuild->vc;
     vc.optimize();
 
     vtxarray *va = new vtxarray;
@@ -942,7 +1055,9 @@ vtxarray *newva(const ivec &o, int size)
     va->hasmerges = 0;
     va->mergelevel = -1;
 
-    vc.setupdata(va);
+    vaupload *u = curbuild->uploads.add(new vaupload);
+    u->va = va;
+    vc.setupdata(va, *u);
 
     if(va->alphafronttris || va->alphabacktris || va->refracttris)
     {
@@ -959,11 +1074,6 @@ vtxarray *newva(const ivec &o, int size)
     va->nogimin = vc.nogimin;
     va->nogimax = vc.nogimax;
 
-    wverts += va->verts;
-    wtris  += va->tris + va->blends + va->alphabacktris + va->alphafronttris + va->refracttris;
-    allocva++;
-    valist.add(va);
-
     return va;
 }
 
@@ -1055,20 +1165,9 @@ void updatevabbs(bool force)
     else loopv(varoot) updatevabb(varoot[i]);
 }
 
-struct mergedface
-{
-    uchar orient, numverts;
-    ushort mat, tex, envmap;
-    vertinfo *verts;
-    int tjoints;
-};
-
-#define MAXMERGELEVEL 12
-static int vahasmerges = 0, vamergemax = 0;
-static vector<mergedface> vamerges[MAXMERGELEVEL+1];
-
 int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
 {
+    vabuild &b = *curbuild;
     if(!c.ext || isempty(c)) return -1;
     int tj = c.ext->tjoints, maxlevel = -1;
     loopi(6) if(c.merged&(1<<i))
@@ -1077,7 +1176,7 @@ int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
         int numverts = surf.numverts&MAXFACEVERTS;
         if(!numverts)
         {
-            if(minlevel < 0) vahasmerges |= MERGE_PART;
+            if(minlevel < 0) b.hasmerges |= MERGE_PART;
             continue;
         }
         mergedface mf;
@@ -1102,21 +1201,21 @@ int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
                 mf.envmap = vslot.slot->texmask&(1<<TEX_ENVMAP) ? EMID_CUSTOM : closestenvmap(i, co, size);
             ushort envmap2 = layer && layer->slot->shader->type&SHADER_ENVMAP ? (layer->slot->texmask&(1<<TEX_ENVMAP) ? EMID_CUSTOM : closestenvmap(i, co, size)) : EMID_NONE;
 
-            if(surf.numverts&LAYER_TOP) vamerges[level].add(mf);
+            if(surf.numverts&LAYER_TOP) b.merges[level].add(mf);
             if(surf.numverts&LAYER_BOTTOM)
             {
                 mf.tex = vslot.layer;
                 mf.envmap = envmap2;
                 mf.numverts &= ~LAYER_BLEND;
                 mf.numverts |= surf.numverts&LAYER_TOP ? LAYER_BOTTOM : LAYER_TOP;
-                vamerges[level].add(mf);
+                b.merges[level].add(mf);
             }
         }
     }
     if(maxlevel >= 0)
     {
-        vamergemax = max(vamergemax, maxlevel);
-        vahasmerges |= MERGE_ORIGIN;
+        b.mergemax = max(b.mergemax, maxlevel);
+        b.hasmerges |= MERGE_ORIGIN;
     }
     return maxlevel;
 }
@@ -1141,7 +1240,8 @@ int findmergedfaces(cube &c, const ivec &co, int size, int csi, int minlevel)
 
 void addmergedverts(int level, const ivec &o)
 {
-    vector<mergedface> &mfl = vamerges[level];
+    vabuild &b = *curbuild;
+    vector<mergedface> &mfl = b.merges[level];
     if(mfl.empty()) return;
     vec vo(ivec(o).mask(~0xFFF));
     vec pos[MAXFACEVERTS];
@@ -1157,13 +1257,14 @@ void addmergedverts(int level, const ivec &o)
         VSlot &vslot = lookupvslot(mf.tex, true);
         int grassy = vslot.slot->grass && mf.orient!=O_BOTTOM && mf.numverts&LAYER_TOP ? 2 : 0;
         addcubeverts(vslot, mf.orient, 1<<level, pos, 0, mf.tex, mf.verts, numverts, mf.tjoints, mf.envmap, grassy, (mf.mat&MAT_ALPHA)!=0, mf.numverts&LAYER_BLEND);
-        vahasmerges |= MERGE_USE;
+        b.hasmerges |= MERGE_USE;
     }
     mfl.setsize(0);
 }
 
 void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // creates vertices and indices ready to be put into a va
 {
+    vabuild &b = *curbuild;
     //if(size<=16) return;
     if(c.ext && c.ext->va)
     {
@@ -1186,11 +1287,11 @@ void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // c
         }
         --neighbourdepth;
 
-        if(csi <= MAXMERGELEVEL && vamerges[csi].length()) addmergedverts(csi, co);
+        if(csi <= MAXMERGELEVEL && b.merges[csi].length()) addmergedverts(csi, co);
 
         if(c.ext)
         {
-            if(c.ext->ents && c.ext->ents->mapmodels.length()) vc.mapmodels.add(c.ext->ents);
+            if(c.ext->ents && c.ext->ents->mapmodels.length()) b.vc.mapmodels.add(c.ext->ents);
         }
         return;
     }
@@ -1202,24 +1303,25 @@ void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel)  // c
     }
     if(c.material != MAT_AIR)
     {
-        genmatsurfs(c, co, size, vc.matsurfs);
+        genmatsurfs(c, co, size, b.vc.matsurfs);
         if(c.material&MAT_NOGI)
         {
-            vc.nogimin.min(co);
-            vc.nogimax.max(ivec(co).add(size));
+            b.vc.nogimin.min(co);
+            b.vc.nogimax.max(ivec(co).add(size));
         }
     }
 
     if(c.ext)
     {
-        if(c.ext->ents && c.ext->ents->mapmodels.length()) vc.mapmodels.add(c.ext->ents);
+        if(c.ext->ents && c.ext->ents->mapmodels.length()) b.vc.mapmodels.add(c.ext->ents);
     }
 
-    if(csi <= MAXMERGELEVEL && vamerges[csi].length()) addmergedverts(csi, co);
+    if(csi <= MAXMERGELEVEL && b.merges[csi].length()) addmergedverts(csi, co);
 }
 
 void calcgeombb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
 {
+    vacollect &vc = curbuild->vc;
     vec vmin(co), vmax = vmin;
     vmin.add(size);
 
@@ -1236,13 +1338,14 @@ void calcgeombb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
 
 void setva(cube &c, const ivec &co, int size, int csi)
 {
+    vabuild &b = *curbuild;
     ASSERT(size <= 0x1000);
 
     int vamergeoffset[MAXMERGELEVEL+1];
-    loopi(MAXMERGELEVEL+1) vamergeoffset[i] = vamerges[i].length();
+    loopi(MAXMERGELEVEL+1) vamergeoffset[i] = b.merges[i].length();
 
-    vc.origin = co;
-    vc.size = size;
+    b.vc.origin = co;
+    b.vc.size = size;
 
     int maxlevel = -1;
     rendercube(c, co, size, csi, maxlevel);
@@ -1251,22 +1354,24 @@ void setva(cube &c, const ivec &co, int size, int csi)
 
     calcgeombb(co, size, bbmin, bbmax);
 
-    if(size == min(0x1000, worldsize/2) || !vc.emptyva())
+    if(size == min(0x1000, worldsize/2) || !b.vc.emptyva())
     {
         vtxarray *va = newva(co, size);
         ext(c).va = va;
         va->geommin = bbmin;
         va->geommax = bbmax;
-        calcmatbb(va, co, size, vc.matsurfs);
-        va->hasmerges = vahasmerges;
-        va->mergelevel = vamergemax;
+        calcmatbb(va, co, size, b.vc.matsurfs);
+        va->hasmerges = b.hasmerges;
+        va->mergelevel = b.mergemax;
     }
     else
     {
-        loopi(MAXMERGELEVEL+1) vamerges[i].setsize(vamergeoffset[i]);
+        loopi(MAXMERGELEVEL+1) b.merges[i].setsize(vamergeoffset[i]);
     }
 
-    vc.clear();
+    b.vc.clear();
+
+    if(curbuild == &mainbuild) flushvauploads(b.uploads);
 }
 
 static inline int setcubevisibility(cube &c, const ivec &co, int size)
@@ -1300,56 +1405,57 @@ VARF(vacubesize, 32, 128, 0x1000, allchanged());
 
 int updateva(cube *c, const ivec &co, int size, int csi)
 {
+    vabuild &b = *curbuild;
     progress("recalculating geometry...");
-    int ccount = 0, cmergemax = vamergemax, chasmerges = vahasmerges;
+    int ccount = 0, cmergemax = b.mergemax, chasmerges = b.hasmerges;
     neighbourstack[++neighbourdepth] = c;
     loopi(8)                                    // counting number of semi-solid/solid children cubes
     {
-        int count = 0, childpos = varoot.length();
+        int count = 0, childpos = b.roots.length();
         ivec o(i, co, size);
-        vamergemax = 0;
-        vahasmerges = 0;
+        b.mergemax = 0;
+        b.hasmerges = 0;
         if(c[i].ext && c[i].ext->va)
         {
-            varoot.add(c[i].ext->va);
+            b.roots.add(c[i].ext->va);
             if(c[i].ext->va->hasmerges&MERGE_ORIGIN) findmergedfaces(c[i], o, size, csi, csi);
         }
         else
         {
             if(c[i].children) count += updateva(c[i].children, o, size/2, csi-1);
             else if(!isempty(c[i])) count += setcubevisibility(c[i], o, size);
-            int tcount = count + (csi <= MAXMERGELEVEL ? vamerges[csi].length() : 0);
+            int tcount = count + (csi <= MAXMERGELEVEL ? b.merges[csi].length() : 0);
             if(tcount > vafacemax || (tcount >= vafacemin && size >= vacubesize) || size == min(0x1000, worldsize/2))
             {
-                loadprogress = clamp(recalcprogress/float(allocnodes), 0.0f, 1.0f);
+                if(curbuild == &mainbuild) loadprogress = clamp(recalcprogress/float(allocnodes), 0.0f, 1.0f);
                 setva(c[i], o, size, csi);
                 if(c[i].ext && c[i].ext->va)
                 {
-                    while(varoot.length() > childpos)
+                    while(b.roots.length() > childpos)
                     {
-                        vtxarray *child = varoot.pop();
+                        vtxarray *child = b.roots.pop();
                         c[i].ext->va->children.add(child);
                         child->parent = c[i].ext->va;
                     }
-                    varoot.add(c[i].ext->va);
-                    if(vamergemax > size)
+                    b.roots.add(c[i].ext->va);
+                    if(b.mergemax > size)
                     {
-                        cmergemax = max(cmergemax, vamergemax);
-                        chasmerges |= vahasmerges&~MERGE_USE;
+                        cmergemax = max(cmergemax, b.mergemax);
+                        chasmerges |= b.hasmerges&~MERGE_USE;
                     }
                     continue;
                 }
                 else count = 0;
             }
         }
-        if(csi+1 <= MAXMERGELEVEL && vamerges[csi].length()) vamerges[csi+1].move(vamerges[csi]);
-        cmergemax = max(cmergemax, vamergemax);
-        chasmerges |= vahasmerges;
+        if(csi+1 <= MAXMERGELEVEL && b.merges[csi].length()) b.merges[csi+1].move(b.merges[csi]);
+        cmergemax = max(cmergemax, b.mergemax);
+        chasmerges |= b.hasmerges;
         ccount += count;
     }
     --neighbourdepth;
-    vamergemax = cmergemax;
-    vahasmerges = chasmerges;
+    b.mergemax = cmergemax;
+    b.hasmerges = chasmerges;
 
     return ccount;
 }
@@ -1393,14 +1499,14 @@ void findtjoints(int cur, const edgegroup &g)
             else
             {
                 prevactive = curactive;
-                if(!(a.flags&CE_DUP))
+                if(!(a.flags&(CE_DUP|CE_FIXED)))
                 {
                     if(e.flags&CE_START && e.offset > a.offset && e.offset < a.offset+a.size)
                         addtjoint(g, a, e.offset);
                     if(e.flags&CE_END && e.offset+e.size > a.offset && e.offset+e.size < a.offset+a.size)
                         addtjoint(g, a, e.offset+e.size);
                 }
-                if(!(e.flags&CE_DUP))
+                if(!(e.flags&(CE_DUP|CE_FIXED)))
                 {
                     if(a.flags&CE_START && a.offset > e.offset && a.offset < e.offset+e.size)
                         addtjoint(g, e, a.offset);
@@ -1417,6 +1523,29 @@ void findtjoints(int cur, const edgegroup &g)
     }
 }
 
+// edits only ever append t-joints and leave the chains they replaced behind, so once the list has doubled
+// since it was last built or packed, the chains still referenced by cubes are copied to the front
+static int packedtjoints = 0;
+
+static void packtjoints(cube *c, vector<tjoint> &packed)
+{
+    loopi(8)
+    {
+        if(c[i].ext && c[i].ext->tjoints >= 0)
+        {
+            int tj = c[i].ext->tjoints, prev = -1;
+            c[i].ext->tjoints = packed.length();
+            for(; tj >= 0; tj = tjoints[tj].next)
+            {
+                if(prev >= 0) packed[prev].next = packed.length();
+                prev = packed.length();
+                packed.add(tjoints[tj]).next = -1;
+            }
+        }
+        if(c[i].children) packtjoints(c[i].children, packed);
+    }
+}
+
 void findtjoints()
 {
     recalcprogress = 0;
@@ -1425,6 +1554,167 @@ void findtjoints()
     enumeratekt(edgegroups, edgegroup, g, int, e, findtjoints(e, g));
     cubeedges.setsize(0);
     edgegroups.clear();
+    packedtjoints = tjoints.length();
+}
+
+void findtjoints(const ivec &bbmin, const ivec &bbmax)
+{
+    // cubes in bbmin..bbmax changed shape or visibility, so every cube touching them may gain or lose t-joints
+    ivec resetmin = bbmin, resetmax = bbmax;
+    tjointbounds(worldroot, ivec(0, 0, 0), worldsize>>1, bbmin, bbmax, resetmin, resetmax);
+    resetmin.sub(1);
+    resetmax.add(1);
+    ivec touchmin = resetmin, touchmax = resetmax;
+    tjointbounds(worldroot, ivec(0, 0, 0), worldsize>>1, resetmin, resetmax, touchmin, touchmax);
+    gencubeedges(worldroot, ivec(0, 0, 0), worldsize>>1, resetmin, resetmax, touchmin.sub(1), touchmax.add(1));
+    enumeratekt(edgegroups, edgegroup, g, int, e, findtjoints(e, g));
+    cubeedges.setsize(0);
+    edgegroups.clear();
+    if(tjoints.length() > 2*max(packedtjoints, 1024))
+    {
+        vector<tjoint> packed;
+        packtjoints(worldroot, packed);
+        tjoints.setsize(0);
+        tjoints.move(packed);
+        packedtjoints = tjoints.length();
+    }
+}
+
+VARP(vathreads, 0, 1, 16); // 0 uses one thread per cpu
+
+// cubes of size min(0x1000, worldsize/2) always get their own va, so the subtrees below them can be
+// built independently; the main thread then adds them in tree order as if it had built them itself
+struct vajob
+{
+    cube *c;
+    ivec o;
+    int size, csi, depth;
+    const cube *stack[32];
+    vector<vaupload *> uploads;
+
+    ~vajob() { uploads.deletecontents(); }
+};
+
+static vector<vajob *> vajobs;
+static SDL_atomic_t nextvajob;
+static SDL_sem *vajobsdone = NULL;
+
+static void findvajobs(cube *c, const ivec &co, int size, int csi)
+{
+    neighbourstack[++neighbourdepth] = c;
+    loopi(8)
+    {
+        if(c[i].ext && c[i].ext->va) continue;
+        ivec o(i, co, size);
+        if(size > min(0x1000, worldsize/2))
+        {
+            if(c[i].children) findvajobs(c[i].children, o, size/2, csi-1);
+            continue;
+        }
+        vajob &job = *vajobs.add(new vajob);
+        job.c = &c[i];
+        job.o = o;
+        job.size = size;
+        job.csi = csi;
+        job.depth = neighbourdepth;
+        memcpy(job.stack, neighbourstack, (neighbourdepth+1)*sizeof(cube *));
+    }
+    --neighbourdepth;
+}
+
+// worker threads may not load textures, so link every slot the subtrees will use beforehand
+static void linkvaslots(cube *c)
+{
+    loopi(8)
+    {
+        if(c[i].ext && c[i].ext->va) continue;
+        if(c[i].children) linkvaslots(c[i].children);
+        else if(!isempty(c[i])) loopj(6)
+        {
+            VSlot &vslot = lookupvslot(c[i].texture[j], true);
+            if(vslot.layer && !(c[i].material&MAT_ALPHA)) lookupvslot(vslot.layer, true);
+        }
+    }
+}
+
+static void buildvajob(vajob &job)
+{
+    vabuild &b = *curbuild;
+    memcpy(neighbourstack, job.stack, (job.depth+1)*sizeof(cube *));
+    neighbourdepth = job.depth;
+    b.mergemax = b.hasmerges = 0;
+    cube &c = *job.c;
+    if(c.children) updateva(c.children, job.o, job.size/2, job.csi-1);
+    else if(!isempty(c)) setcubevisibility(c, job.o, job.size);
+    setva(c, job.o, job.size, job.csi);
+    vtxarray *va = c.ext->va;
+    while(b.roots.length())
+    {
+        vtxarray *child = b.roots.pop();
+        va->children.add(child);
+        child->parent = va;
+    }
+    job.uploads.move(b.uploads);
+    loopi(MAXMERGELEVEL+1) b.merges[i].setsize(0);
+    neighbourdepth = -1;
+}
+
+struct vaworker
+{
+    vector<vtxarray *> roots;
+    vabuild build;
+    SDL_Thread *thread;
+
+    vaworker() : build(roots), thread(NULL) {}
+
+    static int run(void *data)
+    {
+        vaworker *w = (vaworker *)data;
+        curbuild = &w->build;
+        for(;;)
+        {
+            int i = SDL_AtomicAdd(&nextvajob, 1);
+            if(i >= vajobs.length()) break;
+            buildvajob(*vajobs[i]);
+            SDL_SemPost(vajobsdone);
+        }
+        return 0;
+    }
+};
+
+static int vabuildtime = 0, vathreadsused = 0, vajobsused = 0;
+
+static void buildvajobs(int csi)
+{
+    vathreadsused = 1;
+    vajobsused = 0;
+    int numthreads = vathreads > 0 ? vathreads : numcpus;
+    if(numthreads <= 1) return;
+    findvajobs(worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
+    if(vajobs.length() > 1)
+    {
+        linkvaslots(worldroot);
+        numthreads = min(numthreads, vajobs.length());
+        if(!vajobsdone) vajobsdone = SDL_CreateSemaphore(0);
+        SDL_AtomicSet(&nextvajob, 0);
+        vector<vaworker *> workers;
+        loopi(numthreads)
+        {
+            vaworker *w = workers.add(new vaworker);
+            w->thread = SDL_CreateThread(vaworker::run, "va worker", w);
+        }
+        for(int done = 0; done < vajobs.length();)
+        {
+            if(!SDL_SemWaitTimeout(vajobsdone, 100)) done++;
+            else renderprogress(done/float(vajobs.length()), "recalculating geometry...");
+        }
+        loopv(workers) SDL_WaitThread(workers[i]->thread, NULL);
+        workers.deletecontents();
+        loopv(vajobs) flushvauploads(vajobs[i]->uploads);
+        vathreadsused = numthreads;
+        vajobsused = vajobs.length();
+    }
+    vajobs.deletecontents();
 }
 
 void octarender()                               // creates va s for all leaf cubes that don't already have them
@@ -1432,11 +1722,16 @@ void octarender()                               // creates va s for all leaf cub
     int csi = 0;
     while(1<<csi < worldsize) csi++;
 
+    ullong start = getmicroseconds();
+    vauploadtime = 0;
+    buildvajobs(csi);
+
     recalcprogress = 0;
     varoot.setsize(0);
     updateva(worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
     loadprogress = 0;
     flushvbo();
+    vabuildtime = int(getmicroseconds() - start);
 
     explicitsky = 0;
     loopv(valist)
@@ -1508,3 +1803,24 @@ void recalc()
 
 COMMAND(recalc, "");
 
+void vabench(int *numthreads)
+{
+    if(!worldroot) return;
+    int oldthreads = vathreads, threads[2] = { 1, *numthreads > 0 ? *numthreads : numcpus };
+    loopi(2)
+    {
+        vathreads = threads[i];
+        clearvas(worldroot);
+        resetqueries();
+        tjoints.setsize(0);
+        if(filltjoints) findtjoints();
+        octarender();
+        conoutf("%d thread(s), %d jobs: %.2f ms total, %.2f ms generating, %.2f ms uploading, %d vas",
+            vathreadsused, vajobsused, vabuildtime/1000.0f, (vabuildtime - vauploadtime)/1000.0f, vauploadtime/1000.0f, allocva);
+    }
+    vathreads = oldthreads;
+    allchanged();
+}
+
+COMMAND(vabench, "i");
+
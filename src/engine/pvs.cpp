@@ -3,7 +3,8 @@
 enum
 {
     PVS_HIDE_GEOM = 1<<0,
-    PVS_HIDE_BB   = 1<<1
+    PVS_HIDE_BB   = 1<<1,
+    PVS_PRUNED    = 1<<2
 };
 
 struct pvsnode
@@ -233,6 +234,49 @@ struct shaft
         }
         return true;
     }
+
+    // same tests as outside() and inside() for all eight children of a node at once, laid out
+    // as plain loops over the children so the compiler can vectorize them
+    void classify(const ivec &co, int size, uchar &outmask, uchar &inmask) const
+    {
+        float bb[6][8];
+        uchar out[8], in[8];
+        loopi(8)
+        {
+            loopk(3)
+            {
+                int lo = co[k] + ((i>>k)&1)*size;
+                bb[k][i] = lo;
+                bb[k+3][i] = lo + size;
+            }
+            out[i] = 0;
+            in[i] = 1;
+        }
+        loopk(3)
+        {
+            float bmin = bounds.min[k], bmax = bounds.max[k];
+            loopi(8)
+            {
+                out[i] |= (bb[k][i] > bmax) | (bb[k+3][i] < bmin);
+                in[i] &= (bb[k][i] >= bmin) & (bb[k+3][i] <= bmax);
+            }
+        }
+        for(const shaftplane *p = planes; p < &planes[numplanes]; p++)
+        {
+            const float *rnear = bb[p->rnear], *cnear = bb[p->cnear], *rfar = bb[p->rfar], *cfar = bb[p->cfar];
+            loopi(8)
+            {
+                out[i] |= rnear[i]*p->r + cnear[i]*p->c + p->offset > 0;
+                in[i] &= rfar[i]*p->r + cfar[i]*p->c + p->offset <= 0;
+            }
+        }
+        outmask = inmask = 0;
+        loopi(8)
+        {
+            outmask |= out[i]<<i;
+            inmask |= in[i]<<i;
+        }
+    }
 };
 
 struct pvsdata
@@ -245,33 +289,51 @@ struct pvsdata
 
 static vector<uchar> pvsbuf;
 
-static inline uint hthash(const pvsdata &k)
+// view cell results are deduplicated as the workers produce them by publishing each one into a
+// fixed-size open-addressing table with compare-and-swap, so no worker ever waits on another
+struct pvsresult
 {
-    uint h = 5381;
-    loopi(k.len) h = ((h<<5)+h)^pvsbuf[k.offset+i];
-    return h;
-}
+    uint hash;
+    int len, index;
 
-static inline bool htcmp(const pvsdata &x, const pvsdata &y)
+    uchar *data() { return (uchar *)(this + 1); }
+};
+
+static pvsresult **pvsresults = NULL;
+static int pvsresultmask = 0;
+static SDL_atomic_t numpvsresults;
+
+static pvsresult *addpvsresult(pvsresult *r)
 {
-    return x.len==y.len && !memcmp(&pvsbuf[x.offset], &pvsbuf[y.offset], x.len);
+    for(uint h = r->hash&pvsresultmask;; h = (h+1)&pvsresultmask)
+    {
+        pvsresult *cur = (pvsresult *)SDL_AtomicGetPtr((void **)&pvsresults[h]);
+        if(!cur)
+        {
+            if(SDL_AtomicCASPtr((void **)&pvsresults[h], NULL, r)) { SDL_AtomicIncRef(&numpvsresults); return r; }
+            cur = (pvsresult *)SDL_AtomicGetPtr((void **)&pvsresults[h]);
+        }
+        if(cur->hash==r->hash && cur->len==r->len && !memcmp(cur->data(), r->data(), r->len))
+        {
+            delete[] (uchar *)r;
+            return cur;
+        }
+    }
 }
 
-static SDL_mutex *pvsmutex = NULL;
-static hashtable<pvsdata, int> pvscompress;
 static vector<pvsdata> pvs;
 
-static SDL_mutex *viewcellmutex = NULL;
 struct viewcellrequest
 {
     int *result;
     ivec o;
     int size;
+    pvsresult *pvs;
 };
 static vector<viewcellrequest> viewcellrequests;
+static SDL_atomic_t nextviewcell, numviewcells;
 
 static bool genpvs_canceled = false;
-static int numviewcells = 0;
 
 VAR(maxpvsblocker, 1, 512, 1<<16);
 VAR(pvsleafsize, 1, 64, 1024);
@@ -286,29 +348,33 @@ static struct
 static vector<materialsurface *> waterfalls;
 uint numwaterplanes = 0;
 
+// the node tree is shared read-only between workers, each of which only keeps its own flags per node
 struct pvsworker
 {
-    pvsworker() : thread(NULL), pvsnodes(new pvsnode[origpvsnodes.length()])
+    pvsworker() : thread(NULL), pvsnodes(origpvsnodes.getbuf()), pvsflags(new uchar[origpvsnodes.length()])
     {
     }
     ~pvsworker()
     {
-        delete[] pvsnodes;
+        delete[] pvsflags;
     }
 
     SDL_Thread *thread;
-    pvsnode *pvsnodes;
+    const pvsnode *pvsnodes;
+    uchar *pvsflags;
 
     shaftbb viewcellbb;
 
-    pvsnode *levels[32];
+    int levels[32];
     int curlevel;
     ivec origin;
 
+    bool haschildren(int i) const { return pvsnodes[i].children && !(pvsflags[i]&PVS_PRUNED); }
+
     void resetlevels()
     {
         curlevel = worldscale;
-        levels[curlevel] = &pvsnodes[0];
+        levels[curlevel] = 0;
         origin = ivec(0, 0, 0);
     }
 
@@ -323,10 +389,10 @@ struct pvsworker
             diff >>= 1;
         }
 
-        pvsnode *cur = levels[curlevel];
-        while(cur->children && !(cur->flags&PVS_HIDE_BB))
+        int cur = levels[curlevel];
+        while(pvsnodes[cur].children && !(pvsflags[cur]&PVS_HIDE_BB))
         {
-            cur = &pvsnodes[cur->children];
+            cur = pvsnodes[cur].children;
             curlevel--;
             cur += ((p.z>>(curlevel-2))&4) | ((p.y>>(curlevel-1))&2) | ((p.x>>curlevel)&1);
             levels[curlevel] = cur;
@@ -334,7 +400,8 @@ struct pvsworker
 
         origin = ivec(p.x&(~0<<curlevel), p.y&(~0<<curlevel), p.z&(~0<<curlevel));
 
-        if(cur->flags&PVS_HIDE_BB || cur->edges==bvec(0x80, 0x80, 0x80))
+        const bvec &edges = pvsnodes[cur].edges;
+        if(pvsflags[cur]&PVS_HIDE_BB || edges==bvec(0x80, 0x80, 0x80))
         {
             if(omin)
             {
@@ -344,21 +411,21 @@ struct pvsworker
             return origin[coord] + (dir<<curlevel) - p[coord] + dir - 1;
         }
 
-        if(cur->edges.x==0xFF) return 0;
+        if(edges.x==0xFF) return 0;
         ivec bbp(p);
         bbp.sub(origin);
         ivec bbmin, bbmax;
-        bbmin.x = ((cur->edges.x&0xF)<<curlevel)/8;
+        bbmin.x = ((edges.x&0xF)<<curlevel)/8;
         if(bbp.x < bbmin.x) return 0;
-        bbmax.x = ((cur->edges.x>>4)<<curlevel)/8;
+        bbmax.x = ((edges.x>>4)<<curlevel)/8;
         if(bbp.x >= bbmax.x) return 0;
-        bbmin.y = ((cur->edges.y&0xF)<<curlevel)/8;
+        bbmin.y = ((edges.y&0xF)<<curlevel)/8;
         if(bbp.y < bbmin.y) return 0;
-        bbmax.y = ((cur->edges.y>>4)<<curlevel)/8;
+        bbmax.y = ((edges.y>>4)<<curlevel)/8;
         if(bbp.y >= bbmax.y) return 0;
-        bbmin.z = ((cur->edges.z&0xF)<<curlevel)/8;
+        bbmin.z = ((edges.z&0xF)<<curlevel)/8;
         if(bbp.z < bbmin.z) return 0;
-        bbmax.z = ((cur->edges.z>>4)<<curlevel)/8;
+        bbmax.z = ((edges.z>>4)<<curlevel)/8;
         if(bbp.z >= bbmax.z) return 0;
 
         if(omin)
@@ -369,41 +436,53 @@ struct pvsworker
         return (dir ? bbmax[coord] : bbmin[coord]) - bbp[coord] + (dir - 1);
     }
 
-    void hidepvs(pvsnode &p)
+    void hidepvs(int i)
     {
+        const pvsnode &p = pvsnodes[i];
         if(p.children)
         {
-            pvsnode *children = &pvsnodes[p.children];
-            loopi(8) hidepvs(children[i]);
-            p.flags |= PVS_HIDE_BB;
+            loopj(8) hidepvs(p.children + j);
+            pvsflags[i] |= PVS_HIDE_BB;
             return;
         }
-        p.flags |= PVS_HIDE_BB;
-        if(p.edges.x!=0xFF) p.flags |= PVS_HIDE_GEOM;
+        pvsflags[i] |= PVS_HIDE_BB;
+        if(p.edges.x!=0xFF) pvsflags[i] |= PVS_HIDE_GEOM;
     }
 
-    void shaftcullpvs(shaft &s, pvsnode &p, const ivec &co = ivec(0, 0, 0), int size = worldsize)
+    void shaftcullchildren(const shaft &s, int i, const ivec &co, int size)
     {
-        if(p.flags&PVS_HIDE_BB) return;
-        shaftbb bb(co, size);
-        if(s.outside(bb)) return;
-        if(s.inside(bb)) { hidepvs(p); return; }
+        const pvsnode &p = pvsnodes[i];
         if(p.children)
         {
-            pvsnode *children = &pvsnodes[p.children];
+            int csize = size>>1;
+            uchar outside, inside;
+            s.classify(co, csize, outside, inside);
             uchar flags = 0xFF;
-            loopi(8)
+            loopj(8)
             {
-                ivec o(i, co, size>>1);
-                shaftcullpvs(s, children[i], o, size>>1);
-                flags &= children[i].flags;
+                int child = p.children + j;
+                if(!(pvsflags[child]&PVS_HIDE_BB) && !(outside&(1<<j)))
+                {
+                    if(inside&(1<<j)) hidepvs(child);
+                    else shaftcullchildren(s, child, ivec(j, co, csize), csize);
+                }
+                flags &= pvsflags[child];
             }
-            if(flags & PVS_HIDE_BB) p.flags |= PVS_HIDE_BB;
+            if(flags & PVS_HIDE_BB) pvsflags[i] |= PVS_HIDE_BB;
             return;
         }
         if(p.edges.x==0xFF) return;
         shaftbb geom(co, size, p.edges);
-        if(s.inside(geom)) p.flags |= PVS_HIDE_GEOM;
+        if(s.inside(geom)) pvsflags[i] |= PVS_HIDE_GEOM;
+    }
+
+    void shaftcullpvs(const shaft &s)
+    {
+        if(pvsflags[0]&PVS_HIDE_BB) return;
+        shaftbb bb(ivec(0, 0, 0), worldsize);
+        if(s.outside(bb)) return;
+        if(s.inside(bb)) { hidepvs(0); return; }
+        shaftcullchildren(s, 0, ivec(0, 0, 0), worldsize);
     }
 
     queue<shaftbb, 32> prevblockers;
@@ -416,12 +495,12 @@ struct pvsworker
         cullorder(int index, int dist) : index(index), dist(dist) {}
     };
 
-    void cullpvs(pvsnode &p, const ivec &co = ivec(0, 0, 0), int size = worldsize)
+    void cullpvs(int n, const ivec &co = ivec(0, 0, 0), int size = worldsize)
     {
-        if(p.flags&(PVS_HIDE_BB | PVS_HIDE_GEOM) || genpvs_canceled) return;
-        if(p.children && !(p.flags&PVS_HIDE_BB))
+        const pvsnode &p = pvsnodes[n];
+        if(pvsflags[n]&(PVS_HIDE_BB | PVS_HIDE_GEOM) || genpvs_canceled) return;
+        if(p.children && !(pvsflags[n]&PVS_HIDE_BB))
         {
-            pvsnode *children = &pvsnodes[p.children];
             int csize = size>>1;
             ivec dmin = ivec(co).add(csize>>1).sub(ivec(viewcellbb.min).add(ivec(viewcellbb.max)).shr(1)), dmax = ivec(dmin).add(csize);
             dmin.mul(dmin);
@@ -451,9 +530,9 @@ struct pvsworker
             {
                 int index = order[i].index^dir;
                 ivec o(index, co, csize);
-                cullpvs(children[index], o, csize);
+                cullpvs(p.children + index, o, csize);
             }
-            if(!(p.flags & PVS_HIDE_BB)) return;
+            if(!(pvsflags[n] & PVS_HIDE_BB)) return;
         }
         bvec edges = p.children ? bvec(0x80, 0x80, 0x80) : p.edges;
         if(edges.x==0xFF) return;
@@ -623,7 +702,7 @@ struct pvsworker
                 if(!dup)
                 {
                     shaft s(viewcellbb, bb);
-                    shaftcullpvs(s, pvsnodes[0]);
+                    shaftcullpvs(s);
                     prevblockers.add(bb);
                 }
                 if(bb.contains(geom)) return;
@@ -632,30 +711,29 @@ struct pvsworker
         }
     }
 
-    bool compresspvs(pvsnode &p, int size, int threshold)
+    bool compresspvs(int n, int size, int threshold)
     {
-        if(!p.children) return true;
-        if(p.flags&PVS_HIDE_BB) { p.children = 0; return true; }
-        pvsnode *children = &pvsnodes[p.children];
+        if(!haschildren(n)) return true;
+        if(pvsflags[n]&PVS_HIDE_BB) { pvsflags[n] |= PVS_PRUNED; return true; }
+        int children = pvsnodes[n].children;
         bool canreduce = true;
         loopi(8)
         {
-            if(!compresspvs(children[i], size/2, threshold)) canreduce = false;
+            if(!compresspvs(children + i, size/2, threshold)) canreduce = false;
         }
         if(canreduce)
         {
-            int hide = children[7].flags&PVS_HIDE_BB;
-            loopi(7) if((children[i].flags&PVS_HIDE_BB)!=hide) canreduce = false;
+            int hide = pvsflags[children + 7]&PVS_HIDE_BB;
+            loopi(7) if((pvsflags[children + i]&PVS_HIDE_BB)!=hide) canreduce = false;
             if(canreduce)
             {
-                p.flags = (p.flags & ~PVS_HIDE_BB) | hide;
-                p.children = 0;
+                pvsflags[n] = (pvsflags[n] & ~PVS_HIDE_BB) | hide | PVS_PRUNED;
                 return true;
             }
         }
         if(size <= threshold)
         {
-            p.children = 0;
+            pvsflags[n] |= PVS_PRUNED;
             return true;
         }
         return false;
@@ -663,25 +741,25 @@ struct pvsworker
 
     vector<uchar> outbuf;
 
-    bool serializepvs(pvsnode &p, int storage = -1)
+    bool serializepvs(int n, int storage = -1)
     {
-        if(!p.children)
+        if(!haschildren(n))
         {
             outbuf.add(0xFF);
-            loopi(8) outbuf.add(p.flags&PVS_HIDE_BB ? 0xFF : 0);
+            loopi(8) outbuf.add(pvsflags[n]&PVS_HIDE_BB ? 0xFF : 0);
             return true;
         }
         int index = outbuf.length();
-        pvsnode *children = &pvsnodes[p.children];
+        int children = pvsnodes[n].children;
         int i = 0;
         uchar leafvalues = 0;
         if(storage>=0)
         {
             for(; i < 8; i++)
             {
-                pvsnode &child = children[i];
-                if(child.flags&PVS_HIDE_BB) leafvalues |= 1<<i;
-                else if(child.children) break;
+                int child = children + i;
+                if(pvsflags[child]&PVS_HIDE_BB) leafvalues |= 1<<i;
+                else if(haschildren(child)) break;
             }
             if(i==8) { outbuf[storage] = leafvalues; return false; }
             // if offset won't fit, just mark the space as a visible to avoid problems
@@ -694,29 +772,29 @@ struct pvsworker
         uchar leafmask = (1<<i)-1;
         for(; i < 8; i++)
         {
-            pvsnode &child = children[i];
-            if(child.children) { if(!serializepvs(child, index+1+i)) leafmask |= 1<<i; }
-            else { leafmask |= 1<<i; outbuf[index+1+i] = child.flags&PVS_HIDE_BB ? 0xFF : 0; }
+            int child = children + i;
+            if(haschildren(child)) { if(!serializepvs(child, index+1+i)) leafmask |= 1<<i; }
+            else { leafmask |= 1<<i; outbuf[index+1+i] = pvsflags[child]&PVS_HIDE_BB ? 0xFF : 0; }
         }
         outbuf[index] = leafmask;
         return true;
     }
 
-    bool materialoccluded(pvsnode &p, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax)
+    bool materialoccluded(int n, const ivec &co, int size, const ivec &bbmin, const ivec &bbmax)
     {
-        pvsnode *children = &pvsnodes[p.children];
+        int children = pvsnodes[n].children;
         loopoctabox(co, size, bbmin, bbmax)
         {
             ivec o(i, co, size);
-            if(children[i].flags & PVS_HIDE_BB) continue;
-            if(!children[i].children || !materialoccluded(children[i], o, size/2, bbmin, bbmax)) return false;
+            if(pvsflags[children + i] & PVS_HIDE_BB) continue;
+            if(!pvsnodes[children + i].children || !materialoccluded(children + i, o, size/2, bbmin, bbmax)) return false;
         }
         return true;
     }
 
     bool materialoccluded(vector<materialsurface *> &matsurfs)
     {
-        if(pvsnodes[0].flags & PVS_HIDE_BB) return true;
+        if(pvsflags[0] & PVS_HIDE_BB) return true;
         if(!pvsnodes[0].children) return false;
         loopv(matsurfs)
         {
@@ -726,7 +804,7 @@ struct pvsworker
             bbmin[dim] += dimcoord(m.orient) ? -2 : 2;
             bbmax[C[dim]] += m.csize;
             bbmax[R[dim]] += m.rsize;
-            if(!materialoccluded(pvsnodes[0], vec(0, 0, 0), worldsize/2, bbmin, bbmax)) return false;
+            if(!materialoccluded(0, vec(0, 0, 0), worldsize/2, bbmin, bbmax)) return false;
         }
         return true;
     }
@@ -740,9 +818,9 @@ struct pvsworker
             viewcellbb.min[k] = co[k];
             viewcellbb.max[k] = co[k]+size;
         }
-        memcpy(pvsnodes, origpvsnodes.getbuf(), origpvsnodes.length()*sizeof(pvsnode));
+        memset(pvsflags, 0, origpvsnodes.length());
         prevblockers.clear();
-        cullpvs(pvsnodes[0]);
+        cullpvs(0);
 
         wateroccluded = 0;
         loopi(numwaterplanes)
@@ -756,9 +834,9 @@ struct pvsworker
         waterbytes = 0;
         loopi(4) if(wateroccluded&(0xFF<<(i*8))) waterbytes = i+1;
 
-        compresspvs(pvsnodes[0], worldsize, pvsleafsize);
+        compresspvs(0, worldsize, pvsleafsize);
         outbuf.setsize(0);
-        serializepvs(pvsnodes[0]);
+        serializepvs(0);
     }
 
     uchar *testviewcell(const ivec &co, int size, int *waterpvs = NULL, int *len = NULL)
@@ -772,40 +850,31 @@ struct pvsworker
         return buf;
     }
 
-    int genviewcell(const ivec &co, int size)
+    bool genviewcell()
     {
-        calcpvs(co, size);
-
-        if(pvsmutex) SDL_LockMutex(pvsmutex);
-        numviewcells++;
-        pvsdata key(pvsbuf.length(), waterbytes + outbuf.length());
-        loopi(waterbytes) pvsbuf.add((wateroccluded>>(i*8))&0xFF);
-        pvsbuf.put(outbuf.getbuf(), outbuf.length());
-        int *val = pvscompress.access(key);
-        if(val) pvsbuf.setsize(key.offset);
-        else
-        {
-            val = &pvscompress[key];
-            *val = pvs.length();
-            pvs.add(key);
-        }
-        if(pvsmutex) SDL_UnlockMutex(pvsmutex);
-        return *val;
+        int i = SDL_AtomicAdd(&nextviewcell, 1);
+        if(i >= viewcellrequests.length()) return false;
+        viewcellrequest &req = viewcellrequests[i];
+        calcpvs(req.o, req.size);
+
+        int len = waterbytes + outbuf.length();
+        pvsresult *r = (pvsresult *)new uchar[sizeof(pvsresult) + len];
+        r->len = len;
+        r->index = -1;
+        uchar *data = r->data();
+        loopj(waterbytes) data[j] = (wateroccluded>>(j*8))&0xFF;
+        memcpy(&data[waterbytes], outbuf.getbuf(), outbuf.length());
+        r->hash = 5381;
+        loopj(len) r->hash = ((r->hash<<5)+r->hash)^data[j];
+        req.pvs = addpvsresult(r);
+        SDL_AtomicIncRef(&numviewcells);
+        return true;
     }
 
     static int run(void *data)
     {
         pvsworker *w = (pvsworker *)data;
-        SDL_LockMutex(viewcellmutex);
-        while(viewcellrequests.length())
-        {
-            viewcellrequest req = viewcellrequests.pop();
-            SDL_UnlockMutex(viewcellmutex);
-            int result = w->genviewcell(req.o, req.size);
-            SDL_LockMutex(viewcellmutex);
-            *req.result = result;
-        }
-        SDL_UnlockMutex(viewcellmutex);
+        while(!genpvs_canceled && w->genviewcell());
         return 0;
     }
 };
@@ -830,7 +899,6 @@ struct viewcellnode
 };
 
 VARP(pvsthreads, 0, 0, 16);
-static vector<pvsworker *> pvsworkers;
 
 static volatile bool check_genpvs_progress = false;
 
@@ -842,8 +910,9 @@ static Uint32 genpvs_timer(Uint32 interval, void *param)
 
 static int totalviewcells = 0;
 
-static void show_genpvs_progress(int unique = pvs.length(), int processed = numviewcells)
+static void show_genpvs_progress()
 {
+    int unique = SDL_AtomicGet(&numpvsresults), processed = SDL_AtomicGet(&numviewcells);
     float bar1 = float(processed) / float(totalviewcells>0 ? totalviewcells : 1);
 
     defformatstring(text1, "%d%% - %d of %d view cells (%d unique)", int(bar1 * 100), processed, totalviewcells, unique);
@@ -855,11 +924,54 @@ static void show_genpvs_progress(int unique = pvs.length(), int processed = numv
 }
 
 static shaftbb pvsbounds;
+static vector<materialsurface> pvsmatsurfs;
+
+static void addpvsbounds(const ivec &bbmin, const ivec &bbmax)
+{
+    loopk(3)
+    {
+        pvsbounds.min[k] = min(pvsbounds.min[k], (ushort)bbmin[k]);
+        pvsbounds.max[k] = max(pvsbounds.max[k], (ushort)bbmax[k]);
+    }
+}
+
+// headless builds have no vertex arrays, so geometry bounds and material surfaces come straight from the octree
+static void genpvsgeom(cube *c, const ivec &co, int size)
+{
+    loopi(8)
+    {
+        ivec o(i, co, size);
+        cube &ch = c[i];
+        if(ch.children) { genpvsgeom(ch.children, o, size>>1); continue; }
+        if(ch.material != MAT_AIR) genmatsurfs(ch, o, size, pvsmatsurfs);
+        if(isempty(ch)) continue;
+        ivec bbmin(USHRT_MAX, USHRT_MAX, USHRT_MAX), bbmax(0, 0, 0);
+        loopj(6) if(visibletris(ch, j, o, size))
+        {
+            ivec v[4];
+            genfaceverts(ch, j, v);
+            loopk(4)
+            {
+                ivec pos = v[k].mul(size).add(ivec(o).shl(3));
+                bbmin.min(ivec(pos).shr(3));
+                bbmax.max(pos.add(7).shr(3));
+            }
+        }
+        if(bbmin.x <= bbmax.x) addpvsbounds(bbmin, bbmax);
+    }
+}
 
 static void calcpvsbounds()
 {
     loopk(3) pvsbounds.min[k] = USHRT_MAX;
     loopk(3) pvsbounds.max[k] = 0;
+    pvsmatsurfs.setsize(0);
+    if(headless)
+    {
+        genpvsgeom(worldroot, ivec(0, 0, 0), worldsize>>1);
+        loopv(pvsmatsurfs) pvsmatsurfs[i].skip = 0;
+        return;
+    }
     extern vector<vtxarray *> valist;
     loopv(valist)
     {
@@ -927,19 +1039,11 @@ static void genviewcells(viewcellnode &p, cube *c, const ivec &co, int size, int
             if(isallclip(h.children)) continue;
         }
         else if(isentirelysolid(h) || (h.material&MATF_CLIP)==MAT_CLIP) continue;
-        if(pvsworkers.length())
-        {
-            if(genpvs_canceled) return;
-            p.children[i].pvs = pvsworkers[0]->genviewcell(o, size);
-            if(check_genpvs_progress) show_genpvs_progress();
-        }
-        else
-        {
-            viewcellrequest &req = viewcellrequests.add();
-            req.result = &p.children[i].pvs;
-            req.o = o;
-            req.size = size;
-        }
+        viewcellrequest &req = viewcellrequests.add();
+        req.result = &p.children[i].pvs;
+        req.o = o;
+        req.size = size;
+        req.pvs = NULL;
     }
 }
 
@@ -1019,6 +1123,32 @@ void clearpvs()
 
 COMMAND(clearpvs, "");
 
+static void addwaterplanes(materialsurface *matbuf, int matsurfs)
+{
+    loopj(matsurfs)
+    {
+        materialsurface &m = matbuf[j];
+        if((m.material&MATF_VOLUME)!=MAT_WATER || m.orient==O_BOTTOM) { j += m.skip; continue; }
+        if(m.orient!=O_TOP)
+        {
+            waterfalls.add(&m);
+            continue;
+        }
+        loopk(numwaterplanes) if(waterplanes[k].height == m.o.z)
+        {
+            waterplanes[k].matsurfs.add(&m);
+            goto nextmatsurf;
+        }
+        if(numwaterplanes < MAXWATERPVS)
+        {
+            waterplanes[numwaterplanes].height = m.o.z;
+            waterplanes[numwaterplanes].matsurfs.add(&m);
+            numwaterplanes++;
+        }
+    nextmatsurf:;
+    }
+}
+
 static void findwaterplanes()
 {
     extern vector<vtxarray *> valist;
@@ -1029,32 +1159,8 @@ static void findwaterplanes()
     }
     waterfalls.setsize(0);
     numwaterplanes = 0;
-    loopv(valist)
-    {
-        vtxarray *va = valist[i];
-        loopj(va->matsurfs)
-        {
-            materialsurface &m = va->matbuf[j];
-            if((m.material&MATF_VOLUME)!=MAT_WATER || m.orient==O_BOTTOM) { j += m.skip; continue; }
-            if(m.orient!=O_TOP)
-            {
-                waterfalls.add(&m);
-                continue;
-            }
-            loopk(numwaterplanes) if(waterplanes[k].height == m.o.z)
-            {
-                waterplanes[k].matsurfs.add(&m);
-                goto nextmatsurf;
-            }
-            if(numwaterplanes < MAXWATERPVS)
-            {
-                waterplanes[numwaterplanes].height = m.o.z;
-                waterplanes[numwaterplanes].matsurfs.add(&m);
-                numwaterplanes++;
-            }
-        nextmatsurf:;
-        }
-    }
+    if(headless) addwaterplanes(pvsmatsurfs.getbuf(), pvsmatsurfs.length());
+    else loopv(valist) addwaterplanes(valist[i]->matbuf, valist[i]->matsurfs);
     if(waterfalls.length() > 0 && numwaterplanes < MAXWATERPVS) numwaterplanes++;
 }
 
@@ -1096,20 +1202,31 @@ void testpvs(int *vcsize)
 
 COMMAND(testpvs, "i");
 
-void genpvs(int *viewcellsize)
+// results are numbered in view cell order once all workers are done, so the output doesn't depend on the thread count
+static void mergeviewcells()
 {
-    if(worldsize > 1<<15)
+    loopv(viewcellrequests)
     {
-        conoutf(CON_ERROR, "map is too large for PVS");
-        return;
+        viewcellrequest &req = viewcellrequests[i];
+        if(!req.pvs) continue;
+        if(req.pvs->index < 0)
+        {
+            req.pvs->index = pvs.length();
+            pvs.add(pvsdata(pvsbuf.length(), req.pvs->len));
+            pvsbuf.put(req.pvs->data(), req.pvs->len);
+        }
+        *req.result = req.pvs->index;
     }
+    viewcellrequests.setsize(0);
+    loopi(pvsresultmask+1) if(pvsresults[i]) delete[] (uchar *)pvsresults[i];
+    DELETEA(pvsresults);
+}
 
-    renderbackground("generating PVS (esc to abort)");
-    genpvs_canceled = false;
-    Uint32 start = SDL_GetTicks();
-
-    renderprogress(0, "finding view cells");
+static int pvsthreadsused = 0;
 
+// never renders anything unless progress is requested, so it can also run without a window
+static void buildpvs(int viewcellsize, int numthreads, bool progress)
+{
     clearpvs();
     calcpvsbounds();
     findwaterplanes();
@@ -1120,65 +1237,118 @@ void genpvs(int *viewcellsize)
     root.children = 0;
     genpvsnodes(worldroot);
 
-    totalviewcells = countviewcells(worldroot, ivec(0, 0, 0), worldsize>>1, *viewcellsize>0 ? *viewcellsize : 32);
-    numviewcells = 0;
+    totalviewcells = countviewcells(worldroot, ivec(0, 0, 0), worldsize>>1, viewcellsize);
     genpvs_canceled = false;
     check_genpvs_progress = false;
-    SDL_TimerID timer = 0;
-    int numthreads = pvsthreads > 0 ? pvsthreads : numcpus;
-    if(numthreads<=1)
-    {
-        pvsworkers.add(new pvsworker);
-        timer = SDL_AddTimer(500, genpvs_timer, NULL);
-    }
     viewcells = new viewcellnode;
-    genviewcells(*viewcells, worldroot, ivec(0, 0, 0), worldsize>>1, *viewcellsize>0 ? *viewcellsize : 32);
+    genviewcells(*viewcells, worldroot, ivec(0, 0, 0), worldsize>>1, viewcellsize);
+
+    int tablesize = 1;
+    while(tablesize < 2*viewcellrequests.length()) tablesize <<= 1;
+    pvsresults = new pvsresult *[tablesize];
+    memset(pvsresults, 0, tablesize*sizeof(pvsresult *));
+    pvsresultmask = tablesize-1;
+    SDL_AtomicSet(&numpvsresults, 0);
+    SDL_AtomicSet(&nextviewcell, 0);
+    SDL_AtomicSet(&numviewcells, 0);
+
+    pvsthreadsused = numthreads = clamp(numthreads, 1, max(viewcellrequests.length(), 1));
     if(numthreads<=1)
     {
-        SDL_RemoveTimer(timer);
+        SDL_TimerID timer = progress ? SDL_AddTimer(500, genpvs_timer, NULL) : 0;
+        pvsworker w;
+        while(!genpvs_canceled && w.genviewcell())
+        {
+            if(check_genpvs_progress) show_genpvs_progress();
+        }
+        if(timer) SDL_RemoveTimer(timer);
     }
     else
     {
-        renderprogress(0, "creating threads");
-        if(!pvsmutex) pvsmutex = SDL_CreateMutex();
-        if(!viewcellmutex) viewcellmutex = SDL_CreateMutex();
+        if(progress) renderprogress(0, "creating threads");
+        vector<pvsworker *> workers;
         loopi(numthreads)
         {
-            pvsworker *w = pvsworkers.add(new pvsworker);
+            pvsworker *w = workers.add(new pvsworker);
             w->thread = SDL_CreateThread(pvsworker::run, "pvs worker", w);
         }
-        show_genpvs_progress(0, 0);
-        while(!genpvs_canceled)
+        if(progress)
         {
-            SDL_Delay(500);
-            SDL_LockMutex(viewcellmutex);
-            int unique = pvs.length(), processed = numviewcells, remaining = viewcellrequests.length();
-            SDL_UnlockMutex(viewcellmutex);
-            show_genpvs_progress(unique, processed);
-            if(!remaining) break;
+            show_genpvs_progress();
+            while(!genpvs_canceled && SDL_AtomicGet(&numviewcells) < viewcellrequests.length())
+            {
+                SDL_Delay(500);
+                show_genpvs_progress();
+            }
         }
-        SDL_LockMutex(viewcellmutex);
-        viewcellrequests.setsize(0);
-        SDL_UnlockMutex(viewcellmutex);
-        loopv(pvsworkers) SDL_WaitThread(pvsworkers[i]->thread, NULL);
+        loopv(workers) SDL_WaitThread(workers[i]->thread, NULL);
+        workers.deletecontents();
     }
-    pvsworkers.deletecontents();
+    mergeviewcells();
 
     origpvsnodes.setsize(0);
-    pvscompress.clear();
 
-    Uint32 end = SDL_GetTicks();
-    if(genpvs_canceled)
+    if(genpvs_canceled) clearpvs();
+}
+
+void genpvs(int *viewcellsize)
+{
+    if(worldsize > 1<<15)
     {
-        clearpvs();
-        conoutf("genpvs aborted");
+        conoutf(CON_ERROR, "map is too large for PVS");
+        return;
     }
+
+    renderbackground("generating PVS (esc to abort)");
+    Uint32 start = SDL_GetTicks();
+
+    renderprogress(0, "finding view cells");
+
+    buildpvs(*viewcellsize>0 ? *viewcellsize : 32, pvsthreads > 0 ? pvsthreads : numcpus, true);
+
+    Uint32 end = SDL_GetTicks();
+    if(genpvs_canceled) conoutf("genpvs aborted");
     else conoutf("generated %d unique view cells totaling %.1f kB and averaging %d B (%.1f seconds)",
             pvs.length(), pvsbuf.length()/1024.0f, pvsbuf.length()/max(pvs.length(), 1), (end - start) / 1000.0f);
 }
 
 COMMAND(genpvs, "i");
 
+static void flattenviewcells(viewcellnode &p, vector<int> &cells)
+{
+    loopi(8)
+    {
+        if(p.leafmask&(1<<i)) cells.add(p.children[i].pvs);
+        else flattenviewcells(*p.children[i].node, cells);
+    }
+}
+
+void pvsbench(int *viewcellsize, int *numthreads)
+{
+    if(worldsize > 1<<15)
+    {
+        conoutf(CON_ERROR, "map is too large for PVS");
+        return;
+    }
+    int size = *viewcellsize>0 ? *viewcellsize : 32, threads[2] = { 1, *numthreads > 0 ? *numthreads : numcpus };
+    vector<uchar> firstbuf;
+    vector<int> firstcells, cells;
+    loopi(2)
+    {
+        ullong start = getmicroseconds();
+        buildpvs(size, threads[i], false);
+        conoutf("%d thread(s): %d view cells, %d unique, %.1f kB in %.2f ms",
+            pvsthreadsused, totalviewcells, pvs.length(), pvsbuf.length()/1024.0f, (getmicroseconds() - start)/1000.0f);
+        flattenviewcells(*viewcells, i ? cells : firstcells);
+        if(!i) firstbuf.put(pvsbuf.getbuf(), pvsbuf.length());
+    }
+    bool same = firstbuf.length() == pvsbuf.length() && !memcmp(firstbuf.getbuf(), pvsbuf.getbuf(), pvsbuf.length()) &&
+                firstcells.length() == cells.length() && !memcmp(firstcells.getbuf(), cells.getbuf(), cells.length()*sizeof(int));
+    conoutf(same ? "pvs match" : "\f3pvs differ");
+}
+
+COMMAND(pvsbench, "ii");
+
 void pvsstats()
 {
     conoutf("%d unique view cells totaling %.1f kB and averaging %d B",
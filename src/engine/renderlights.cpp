@@ -1687,6 +1687,22 @@ void clearshadowcache()
     clearshadowmeshes();
 }
 
+// drops only the cached shadowmaps and radiance hints that geometry in bbmin..bbmax can affect
+void clearshadowcache(const ivec &bbmin, const ivec &bbmax)
+{
+    vec emin(bbmin), emax(bbmax);
+    loopv(shadowmaps)
+    {
+        shadowmapinfo &sm = shadowmaps[i];
+        if(sm.light < 0) continue;
+        lightinfo &l = lights[sm.light];
+        vec closest = vec(l.o).max(emin).min(emax);
+        if(closest.squaredist(l.o) < l.radius*l.radius) sm.light = -1;
+    }
+
+    invalidateradiancehints(emin, emax);
+}
+
 static shadowmapinfo *addshadowmap(ushort x, ushort y, int size, int &idx)
 {
     idx = shadowmaps.length();
@@ -2044,9 +2060,9 @@ struct radiancehints
         void clearcache() { bounds = -1e16f; }
     } splits[RH_MAXSPLITS];
 
-    vec dynmin, dynmax, prevdynmin, prevdynmax;
+    vec dynmin, dynmax, prevdynmin, prevdynmax, editmin, editmax;
 
-    radiancehints() : dynmin(1e16f, 1e16f, 1e16f), dynmax(-1e16f, -1e16f, -1e16f), prevdynmin(1e16f, 1e16f, 1e16f), prevdynmax(-1e16f, -1e16f, -1e16f) {}
+    radiancehints() : dynmin(1e16f, 1e16f, 1e16f), dynmax(-1e16f, -1e16f, -1e16f), prevdynmin(1e16f, 1e16f, 1e16f), prevdynmax(-1e16f, -1e16f, -1e16f), editmin(1e16f, 1e16f, 1e16f), editmax(-1e16f, -1e16f, -1e16f) {}
 
     void setup();
     void updatesplitdist();
@@ -2063,6 +2079,12 @@ void clearradiancehintscache()
     memset(rhclearmasks, 0, sizeof(rhclearmasks));
 }
 
+void invalidateradiancehints(const vec &bbmin, const vec &bbmax)
+{
+    rh.editmin.min(bbmin);
+    rh.editmax.max(bbmax);
+}
+
 void radiancehints::updatesplitdist()
 {
     float lambda = rhsplitweight, nd = rhnearplane, fd = rhfarplane, ratio = fd/nd;
@@ -3461,6 +3483,13 @@ void renderradiancehints()
     rh.dynmax = vec(-1e16f, -1e16f, -1e16f);
     if(rhdyntex) dynamicshadowvabounds(1<<shadowside, rh.dynmin, rh.dynmax);
     if(rhdynmm) batcheddynamicmodelbounds(1<<shadowside, rh.dynmin, rh.dynmax);
+    if(rh.editmin.z < rh.editmax.z)
+    {
+        rh.dynmin.min(rh.editmin);
+        rh.dynmax.max(rh.editmax);
+        rh.editmin = vec(1e16f, 1e16f, 1e16f);
+        rh.editmax = vec(-1e16f, -1e16f, -1e16f);
+    }
 
     if(rhforce || rh.prevdynmin.z < rh.prevdynmax.z || rh.dynmin.z < rh.dynmax.z || !rh.allcached())
     {
@@ -7,6 +7,45 @@ static int fontdeftex = 0;
 font *curfont = NULL;
 int curfonttex = 0;
 
+// laid out strings are cached by string, font and wrap width, so unchanged text skips the per-character walk
+VAR(textcache, 0, 1, 1);
+
+struct textglyph
+{
+    float x, y;
+    ushort info;
+    uchar tex;
+    char color;
+};
+
+struct textrun
+{
+    char *str;
+    font *f;
+    int maxwidth, numtexs;
+    float width, height;
+    vector<textglyph> glyphs;
+
+    textrun() : str(NULL) {}
+    ~textrun() { DELETEA(str); }
+};
+
+struct textrunkey
+{
+    const char *str;
+    font *f;
+    int maxwidth;
+
+    textrunkey(const char *str, font *f, int maxwidth) : str(str), f(f), maxwidth(maxwidth) {}
+};
+
+static inline uint hthash(const textrunkey &k) { return hthash(k.str) ^ uint(k.maxwidth); }
+static inline bool htcmp(const textrunkey &k, const textrun &r) { return k.f == r.f && k.maxwidth == r.maxwidth && !strcmp(k.str, r.str); }
+
+#define MAXTEXTRUNS 4096
+
+static hashset<textrun> textruns(1<<10);
+
 void newfont(char *name, char *tex, int *defaultw, int *defaulth, int *scale)
 {
     font *f = &fonts[name];
@@ -25,6 +64,7 @@ void newfont(char *name, char *tex, int *defaultw, int *defaulth, int *scale)
 
     fontdef = f;
     fontdeftex = 0;
+    textruns.clear();
 }
 
 void fontborder(float *bordermin, float *bordermax)
@@ -48,6 +88,7 @@ void fontoffset(char *c)
     if(!fontdef) return;
 
     fontdef->charoffset = c[0];
+    textruns.clear();
 }
 
 void fontscale(int *scale)
@@ -55,6 +96,7 @@ void fontscale(int *scale)
     if(!fontdef) return;
 
     fontdef->scale = *scale > 0 ? *scale : fontdef->defaulth;
+    textruns.clear();
 }
 
 void fonttex(char *s)
@@ -80,6 +122,7 @@ void fontchar(float *x, float *y, float *w, float *h, float *offsetx, float *off
     c.offsety = *offsety;
     c.advance = *advance ? *advance : c.offsetx + c.w;
     c.tex = fontdeftex;
+    textruns.clear();
 }
 
 void fontskip(int *n)
@@ -91,6 +134,7 @@ void fontskip(int *n)
         c.x = c.y = c.w = c.h = c.offsetx = c.offsety = c.advance = 0;
         c.tex = 0;
     }
+    textruns.clear();
 }
 
 COMMANDN(font, newfont, "ssiii");
@@ -121,6 +165,7 @@ void fontalias(const char *dst, const char *src)
 
     fontdef = d;
     fontdeftex = d->texs.length()-1;
+    textruns.clear();
 }
 
 COMMAND(fontalias, "ss");
@@ -245,6 +290,27 @@ static float draw_char(Texture *&tex, int c, float x, float y, float scale)
 
 VARP(textbright, 0, 85, 100);
 
+static inline bvec text_codecolor(char c, const bvec &color)
+{
+    bvec code;
+    switch(c)
+    {
+        case '0': code = bvec( 64, 255, 128); break;   // green: player talk
+        case '1': code = bvec( 96, 160, 255); break;   // blue: "echo" command
+        case '2': code = bvec(255, 192,  64); break;   // yellow: gameplay messages
+        case '3': code = bvec(255,  64,  64); break;   // red: important errors
+        case '4': code = bvec(128, 128, 128); break;   // gray
+        case '5': code = bvec(192,  64, 192); break;   // magenta
+        case '6': code = bvec(255, 128,   0); break;   // orange
+        case '7': code = bvec(255, 255, 255); break;   // white
+        case '8': code = bvec( 80, 207, 229); break;   // "Tesseract Blue"
+        case '9': code = bvec(160, 240, 120); break;
+        default: return color;                         // provided color: everything else
+    }
+    if(textbright != 100) code.scale(textbright, 100);
+    return code;
+}
+
 //stack[sp] is current color index
 static void text_color(char c, char *stack, int size, int &sp, bvec color, int a)
 {
@@ -258,22 +324,7 @@ static void text_color(char c, char *stack, int size, int &sp, bvec color, int a
         xtraverts += gle::end();
         if(c=='r') c = stack[(sp > 0) ? --sp : sp]; // restore color
         else stack[sp] = c;
-        switch(c)
-        {
-            case '0': color = bvec( 64, 255, 128); break;   // green: player talk
-            case '1': color = bvec( 96, 160, 255); break;   // blue: "echo" command
-            case '2': color = bvec(255, 192,  64); break;   // yellow: gameplay messages
-            case '3': color = bvec(255,  64,  64); break;   // red: important errors
-            case '4': color = bvec(128, 128, 128); break;   // gray
-            case '5': color = bvec(192,  64, 192); break;   // magenta
-            case '6': color = bvec(255, 128,   0); break;   // orange
-            case '7': color = bvec(255, 255, 255); break;   // white
-            case '8': color = bvec( 80, 207, 229); break;   // "Tesseract Blue"
-            case '9': color = bvec(160, 240, 120); break;
-            default: gle::color(color, a); return;          // provided color: everything else
-        }
-        if(textbright != 100) color.scale(textbright, 100);
-        gle::color(color, a);
+        gle::color(text_codecolor(c, color), a);
     }
 }
 
@@ -362,7 +413,7 @@ void text_posf(const char *str, int cursor, float &cx, float &cy, int maxwidth)
     #undef TEXTWORD
 }
 
-void text_boundsf(const char *str, float &width, float &height, int maxwidth)
+static void measuretext(const char *str, float &width, float &height, int maxwidth)
 {
     #define TEXTINDEX(idx)
     #define TEXTWHITE(idx)
@@ -382,6 +433,115 @@ void text_boundsf(const char *str, float &width, float &height, int maxwidth)
     #undef TEXTWORD
 }
 
+static textrun &gettextrun(const char *str, int maxwidth)
+{
+    textrunkey key(str, curfont, maxwidth);
+    textrun *run = textruns.access(key);
+    if(run) return *run;
+    if(textruns.numelems >= MAXTEXTRUNS) textruns.clear();
+    run = &textruns[key];
+    run->str = newstring(str);
+    run->f = curfont;
+    run->maxwidth = maxwidth;
+    run->numtexs = 0;
+    measuretext(str, run->width, run->height, maxwidth);
+
+    #define TEXTINDEX(idx)
+    #define TEXTWHITE(idx)
+    #define TEXTLINE(idx)
+    #define TEXTCOLOR(idx) \
+        switch(str[idx]) \
+        { \
+            case 's': if(colorpos < int(sizeof(colorstack))-1) { colorstack[colorpos+1] = colorstack[colorpos]; colorpos++; } break; \
+            case 'r': if(colorpos > 0) colorpos--; break; \
+            default: colorstack[colorpos] = str[idx]; break; \
+        }
+    #define TEXTCHAR(idx) \
+        { \
+            textglyph &g = run->glyphs.add(); \
+            g.x = x; \
+            g.y = y; \
+            g.info = c-curfont->charoffset; \
+            g.tex = curfont->chars[g.info].tex; \
+            g.color = colorstack[colorpos]; \
+            run->numtexs = max(run->numtexs, g.tex+1); \
+        } \
+        x += cw;
+    #define TEXTWORD TEXTWORDSKELETON
+    char colorstack[10];
+    colorstack[0] = '\0';
+    int colorpos = 0;
+    TEXTSKELETON
+    #undef TEXTINDEX
+    #undef TEXTWHITE
+    #undef TEXTLINE
+    #undef TEXTCOLOR
+    #undef TEXTCHAR
+    #undef TEXTWORD
+    return *run;
+}
+
+void text_boundsf(const char *str, float &width, float &height, int maxwidth)
+{
+    if(textcache)
+    {
+        textrun &run = gettextrun(str, maxwidth);
+        width = run.width;
+        height = run.height;
+    }
+    else measuretext(str, width, height, maxwidth);
+}
+
+// colors are per vertex, so each font texture needs only a single batch no matter how often the color changes
+static void draw_textrun(const textrun &run, float left, float top, const bvec &color, int a, bool usecolor)
+{
+    float scale = textscale*curfont->scale/float(curfont->defaulth);
+    bvec glyphcolor = color;
+    loopk(run.numtexs)
+    {
+        Texture *tex = curfont->texs[k];
+        glBindTexture(GL_TEXTURE_2D, tex->id);
+        gle::begin(GL_QUADS);
+        char code = '\0';
+        glyphcolor = color;
+        loopv(run.glyphs)
+        {
+            const textglyph &g = run.glyphs[i];
+            if(g.tex != k) continue;
+            if(usecolor && g.color != code) { code = g.color; glyphcolor = text_codecolor(code, color); }
+
+            const font::charinfo &info = curfont->chars[g.info];
+            float x = (left + g.x)*textscale, y = (top + g.y)*textscale,
+                  x1 = x + scale*info.offsetx,
+                  y1 = y + scale*info.offsety,
+                  x2 = x + scale*(info.offsetx + info.w),
+                  y2 = y + scale*(info.offsety + info.h),
+                  tx1 = info.x / tex->xs,
+                  ty1 = info.y / tex->ys,
+                  tx2 = (info.x + info.w) / tex->xs,
+                  ty2 = (info.y + info.h) / tex->ys;
+
+            if(textmatrix)
+            {
+                gle::attrib(textmatrix->transform(vec2(x1, y1))); gle::attribf(tx1, ty1); gle::attrib(glyphcolor, a);
+                gle::attrib(textmatrix->transform(vec2(x2, y1))); gle::attribf(tx2, ty1); gle::attrib(glyphcolor, a);
+                gle::attrib(textmatrix->transform(vec2(x2, y2))); gle::attribf(tx2, ty2); gle::attrib(glyphcolor, a);
+                gle::attrib(textmatrix->transform(vec2(x1, y2))); gle::attribf(tx1, ty2); gle::attrib(glyphcolor, a);
+            }
+            else
+            {
+                gle::attribf(x1, y1); gle::attribf(tx1, ty1); gle::attrib(glyphcolor, a);
+                gle::attribf(x2, y1); gle::attribf(tx2, ty1); gle::attrib(glyphcolor, a);
+                gle::attribf(x2, y2); gle::attribf(tx2, ty2); gle::attrib(glyphcolor, a);
+                gle::attribf(x1, y2); gle::attribf(tx1, ty2); gle::attrib(glyphcolor, a);
+            }
+        }
+        xtraverts += gle::end();
+    }
+    // leave the current color as the uncached path would
+    gle::color(glyphcolor, a);
+}
+
 Shader *textshader = NULL;
 
 void draw_text(const char *str, float left, float top, int r, int g, int b, int a, int cursor, int maxwidth)
@@ -409,16 +569,24 @@ void draw_text(const char *str, float left, float top, int r, int g, int b, int
     gle::color(color, a);
     gle::defvertex(textmatrix ? 3 : 2);
     gle::deftexcoord0();
-    gle::begin(GL_QUADS);
-    TEXTSKELETON
-    TEXTEND(cursor)
-    xtraverts += gle::end();
-    if(cursor >= 0 && (totalmillis/250)&1)
+    if(cursor < 0 && textcache)
     {
-        gle::color(color, a);
-        if(maxwidth >= 0 && cx >= maxwidth && cx > 0) { cx = 0; cy += FONTH; }
-        draw_char(tex, '_', left+cx, top+cy, scale);
+        gle::defcolor(4, GL_UNSIGNED_BYTE);
+        draw_textrun(gettextrun(str, maxwidth), left, top, color, a, usecolor);
+    }
+    else
+    {
+        gle::begin(GL_QUADS);
+        TEXTSKELETON
+        TEXTEND(cursor)
         xtraverts += gle::end();
+        if(cursor >= 0 && (totalmillis/250)&1)
+        {
+            gle::color(color, a);
+            if(maxwidth >= 0 && cx >= maxwidth && cx > 0) { cx = 0; cy += FONTH; }
+            draw_char(tex, '_', left+cx, top+cy, scale);
+            xtraverts += gle::end();
+        }
     }
     gle::disable();
     if(oldshader == hudshader->detailshader)
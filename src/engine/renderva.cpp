@@ -2209,8 +2209,11 @@ static void genshadowmesh(int idx, extentity &e)
     shadowmapping = 0;
 }
 
+static int staleshadowdraws = 0;
+
 void clearshadowmeshes()
 {
+    staleshadowdraws = 0;
     if(shadowvbos.length()) { glDeleteBuffers_(shadowvbos.length(), shadowvbos.getbuf()); shadowvbos.setsize(0); }
     if(shadowmeshes.numelems)
     {
@@ -2244,6 +2247,51 @@ void genshadowmeshes()
     }
 }
 
+static void removeshadowmesh(int idx)
+{
+    shadowmesh *m = shadowmeshes.access(idx);
+    if(!m) return;
+    vector<GLuint> bufs;
+    loopi(6) for(int cur = m->draws[i]; cur >= 0;)
+    {
+        shadowdraw &d = shadowdraws[cur];
+        if(bufs.find(d.ebuf) < 0) { bufs.add(d.ebuf); bufs.add(d.vbuf); }
+        staleshadowdraws++;
+        cur = d.next;
+    }
+    loopv(bufs) shadowvbos.removeobj(bufs[i]);
+    if(bufs.length()) glDeleteBuffers_(bufs.length(), bufs.getbuf());
+    shadowmeshes.remove(idx);
+}
+
+// regenerates only the meshes of lights reaching into bbmin..bbmax, compacting the draws once most are stale
+void updateshadowmeshes(const ivec &bbmin, const ivec &bbmax)
+{
+    if(!smmesh || !shadowmeshes.numelems) return;
+
+    if(staleshadowdraws > shadowdraws.length()/2)
+    {
+        clearshadowmeshes();
+        vector<extentity *> &ents = entities::getents();
+        loopv(ents) if(ents[i]->type == ET_LIGHT) genshadowmesh(i, *ents[i]);
+        return;
+    }
+
+    vector<int> regen;
+    enumeratekt(shadowmeshes, int, idx, shadowmesh, m,
+    {
+        vec closest = vec(m.origin).max(vec(bbmin)).min(vec(bbmax));
+        if(closest.squaredist(m.origin) < m.radius*m.radius) regen.add(idx);
+    });
+
+    vector<extentity *> &ents = entities::getents();
+    loopv(regen)
+    {
+        removeshadowmesh(regen[i]);
+        if(ents.inrange(regen[i]) && ents[regen[i]]->type == ET_LIGHT) genshadowmesh(regen[i], *ents[regen[i]]);
+    }
+}
+
 shadowmesh *findshadowmesh(int idx, extentity &e)
 {
     shadowmesh *m = shadowmeshes.access(idx);
@@ -107,6 +107,8 @@ void conoutf(int type, const char *fmt, ...)
 
 enum { ST_EMPTY, ST_LOCAL, ST_TCPIP };
 
+enum { MAXSTATCHANS = 4 };
+
 struct client                   // server side version of "dynent" type
 {
     int type;
@@ -114,6 +116,7 @@ struct client                   // server side version of "dynent" type
     ENetPeer *peer;
     string hostname;
     void *info;
+    uint bytesin[MAXSTATCHANS], bytesout[MAXSTATCHANS], resends, lastresends, lastpacketslost, lastlossepoch;
 };
 
 vector<client *> clients;
@@ -143,6 +146,9 @@ client &addclient(int type)
     }
     c->info = server::newclientinfo();
     c->type = type;
+    memset(c->bytesin, 0, sizeof(c->bytesin));
+    memset(c->bytesout, 0, sizeof(c->bytesout));
+    c->resends = c->lastresends = c->lastpacketslost = c->lastlossepoch = 0;
     switch(type)
     {
         case ST_TCPIP: nonlocalclients++; break;
@@ -188,20 +194,26 @@ int getservermtu() { return serverhost ? serverhost->mtu : -1; }
 void *getclientinfo(int i) { return !clients.inrange(i) || clients[i]->type==ST_EMPTY ? NULL : clients[i]->info; }
 ENetPeer *getclientpeer(int i) { return clients.inrange(i) && clients[i]->type==ST_TCPIP ? clients[i]->peer : NULL; }
 int getnumclients()        { return clients.length(); }
+
+// reliable bytes handed to a peer that have not been acknowledged yet, for callers that pace bulk transfers
+int getclientbacklog(int i)
+{
+    ENetPeer *peer = getclientpeer(i);
+    if(!peer) return 0;
+    int backlog = peer->reliableDataInTransit;
+    for(ENetListIterator cur = enet_list_begin(&peer->outgoingReliableCommands); cur != enet_list_end(&peer->outgoingReliableCommands); cur = enet_list_next(cur))
+        backlog += ((ENetOutgoingCommand *)cur)->fragmentLength;
+    return backlog;
+}
 uint getclientip(int n)    { return clients.inrange(n) && clients[n]->type==ST_TCPIP ? clients[n]->peer->address.host : 0; }
 
-void sendpacket(int n, int chan, ENetPacket *packet, int exclude)
+static void sendpeerpacket(int n, int chan, ENetPacket *packet)
 {
-    if(n<0)
-    {
-        server::recordpacket(chan, packet->data, packet->dataLength);
-        loopv(clients) if(i!=exclude && server::allowbroadcast(i)) sendpacket(i, chan, packet);
-        return;
-    }
     switch(clients[n]->type)
     {
         case ST_TCPIP:
         {
+            clients[n]->bytesout[min(chan, int(MAXSTATCHANS)-1)] += packet->dataLength;
             enet_peer_send(clients[n]->peer, chan, packet);
             break;
         }
@@ -214,6 +226,157 @@ void sendpacket(int n, int chan, ENetPacket *packet, int exclude)
     }
 }
 
+// reliable messages sent while the game updates are packed per channel and go out as one packet per recipient
+struct batchedmessage
+{
+    int offset, len, cn, exclude;
+};
+
+struct messagebatch
+{
+    vector<uchar> data;
+    vector<batchedmessage> msgs;
+    bool mixed;
+
+    messagebatch() : mixed(false) {}
+};
+
+enum { MAXBATCHCHANS = 3, MAXBATCHSIZE = 16<<10 };
+
+static messagebatch batches[MAXBATCHCHANS];
+static bool batching = false;
+static int batchedmsgs = 0, batchedpackets = 0;
+VAR(batchmessages, 0, 1, 1);
+
+static void flushbatch(int chan)
+{
+    messagebatch &b = batches[chan];
+    if(b.msgs.empty()) return;
+    ENetPacket *shared = NULL;
+    static vector<uchar> special;
+    special.setsize(0);
+    if(b.mixed)
+    {
+        loopi(clients.length()) special.add(0);
+        loopv(b.msgs)
+        {
+            const batchedmessage &m = b.msgs[i];
+            int cn = m.cn >= 0 ? m.cn : m.exclude;
+            if(special.inrange(cn)) special[cn] = 1;
+        }
+    }
+    loopv(clients) if(clients[i]->type!=ST_EMPTY)
+    {
+        if(!special.inrange(i) || !special[i])
+        {
+            if(!server::allowbroadcast(i)) continue;
+            if(!shared)
+            {
+                if(b.mixed)
+                {
+                    int len = 0;
+                    loopvj(b.msgs) if(b.msgs[j].cn < 0) len += b.msgs[j].len;
+                    if(!len) continue;
+                    shared = enet_packet_create(NULL, len, ENET_PACKET_FLAG_RELIABLE);
+                    len = 0;
+                    loopvj(b.msgs) if(b.msgs[j].cn < 0) { memcpy(&shared->data[len], &b.data[b.msgs[j].offset], b.msgs[j].len); len += b.msgs[j].len; }
+                }
+                else shared = enet_packet_create(b.data.getbuf(), b.data.length(), ENET_PACKET_FLAG_RELIABLE);
+                batchedpackets++;
+            }
+            sendpeerpacket(i, chan, shared);
+            continue;
+        }
+        bool broadcast = server::allowbroadcast(i);
+        int len = 0;
+        loopvj(b.msgs)
+        {
+            const batchedmessage &m = b.msgs[j];
+            if(m.cn==i || (m.cn<0 && m.exclude!=i && broadcast)) len += m.len;
+        }
+        if(!len) continue;
+        ENetPacket *packet = enet_packet_create(NULL, len, ENET_PACKET_FLAG_RELIABLE);
+        batchedpackets++;
+        len = 0;
+        loopvj(b.msgs)
+        {
+            const batchedmessage &m = b.msgs[j];
+            if(m.cn==i || (m.cn<0 && m.exclude!=i && broadcast)) { memcpy(&packet->data[len], &b.data[m.offset], m.len); len += m.len; }
+        }
+        sendpeerpacket(i, chan, packet);
+        if(!packet->referenceCount) enet_packet_destroy(packet);
+    }
+    if(shared && !shared->referenceCount) enet_packet_destroy(shared);
+    b.data.setsize(0);
+    b.msgs.setsize(0);
+    b.mixed = false;
+}
+
+static void flushbatches()
+{
+    loopi(MAXBATCHCHANS) flushbatch(i);
+}
+
+static bool batchmessage(int cn, int chan, const uchar *data, int len, int exclude)
+{
+    if(!batching || !batchmessages || chan < 0 || chan >= MAXBATCHCHANS || len <= 0) return false;
+    if(cn >= 0 && (!clients.inrange(cn) || clients[cn]->type==ST_EMPTY)) return false;
+    messagebatch &b = batches[chan];
+    if(b.data.length() + len > MAXBATCHSIZE) flushbatch(chan);
+    if(cn < 0) server::recordpacket(chan, (void *)data, len);
+    batchedmessage *last = b.msgs.empty() ? NULL : &b.msgs.last();
+    if(last && cn < 0 && exclude < 0 && last->cn < 0 && last->exclude < 0) last->len += len;
+    else
+    {
+        batchedmessage &m = b.msgs.add();
+        m.offset = b.data.length();
+        m.len = len;
+        m.cn = cn;
+        m.exclude = cn < 0 ? exclude : -1;
+        if(cn >= 0 || exclude >= 0) b.mixed = true;
+    }
+    b.data.put(data, len);
+    batchedmsgs++;
+    return true;
+}
+
+void sendpacket(int n, int chan, ENetPacket *packet, int exclude)
+{
+    // small reliable packets nobody holds a reference to are copied into the batch, the caller frees them as usual
+    if(!packet->referenceCount && packet->flags&ENET_PACKET_FLAG_RELIABLE && packet->dataLength <= MAXTRANS &&
+       batchmessage(n, chan, packet->data, int(packet->dataLength), exclude))
+        return;
+    if(chan >= 0 && chan < MAXBATCHCHANS) flushbatch(chan);
+    if(n<0)
+    {
+        server::recordpacket(chan, packet->data, packet->dataLength);
+        loopv(clients) if(i!=exclude && server::allowbroadcast(i)) sendpeerpacket(i, chan, packet);
+        return;
+    }
+    sendpeerpacket(n, chan, packet);
+}
+
+// netmsg buffers are pooled, so building a message never allocates and a batched one never becomes a packet of its own
+static vector<uchar *> messagebufs;
+
+uchar *newmessagebuf()
+{
+    return messagebufs.length() ? messagebufs.pop() : new uchar[MAXTRANS];
+}
+
+void freemessagebuf(uchar *buf)
+{
+    messagebufs.add(buf);
+}
+
+void sendmessage(int cn, int chan, const uchar *data, int len, int exclude)
+{
+    if(batchmessage(cn, chan, data, len, exclude)) return;
+    ENetPacket *packet = enet_packet_create(data, len, ENET_PACKET_FLAG_RELIABLE);
+    sendpacket(cn, chan, packet, exclude);
+    if(!packet->referenceCount) enet_packet_destroy(packet);
+}
+
 ENetPacket *sendf(int cn, int chan, const char *format, ...)
 {
     int exclude = -1;
@@ -257,6 +420,7 @@ ENetPacket *sendf(int cn, int chan, const char *format, ...)
         }
     }
     va_end(args);
+    if(reliable && batchmessage(cn, chan, p.buf, p.len, exclude)) return NULL;
     ENetPacket *packet = p.finalize();
     sendpacket(cn, chan, packet, exclude);
     return packet->referenceCount > 0 ? packet : NULL;
@@ -624,6 +788,108 @@ void updatetime()
     }
 }
 
+// periodic per-peer link stats, appended as key=value lines so they can be graphed or grepped for bandwidth hogs
+VAR(netstats, 0, 0, 3600);
+SVAR(netstatsfile, "netstats.log");
+
+int lastnetstats = 0;
+
+struct netstathist
+{
+    const char *name;
+    int bounds[6];
+    int counts[7];
+
+    void reset() { memset(counts, 0, sizeof(counts)); }
+
+    void add(int val)
+    {
+        int i = 0;
+        while(i < 6 && bounds[i] && val >= bounds[i]) i++;
+        counts[i]++;
+    }
+
+    void write(stream *f)
+    {
+        f->printf("hist %s", name);
+        loopi(7)
+        {
+            if(i < 6 && bounds[i]) f->printf(" <%d:%d", bounds[i], counts[i]);
+            else { f->printf(" inf:%d", counts[i]); break; }
+        }
+        f->printf("\n");
+    }
+};
+
+static netstathist rtthist = { "rtt", { 25, 50, 100, 200, 400, 0 } },
+                   jitterhist = { "jitter", { 5, 10, 25, 50, 100, 0 } },
+                   losshist = { "loss", { 1, 2, 5, 10, 25, 0 } };
+
+static void writechanstats(stream *f, const char *name, uint *bytes, float secs)
+{
+    f->printf(" %s=", name);
+    loopi(MAXSTATCHANS)
+    {
+        f->printf(i ? ",%d" : "%d", int(bytes[i]/secs));
+        bytes[i] = 0;
+    }
+}
+
+// ENet zeroes packetsLost whenever it starts a new loss interval, so the resends are accumulated here after every service call;
+// only resends from the very pass that starts a new interval can be missed
+static void countresends()
+{
+    loopv(clients) if(clients[i]->type==ST_TCPIP && clients[i]->peer)
+    {
+        client &c = *clients[i];
+        ENetPeer *p = c.peer;
+        if(p->packetLossEpoch != c.lastlossepoch) { c.lastlossepoch = p->packetLossEpoch; c.lastpacketslost = 0; }
+        if(p->packetsLost > c.lastpacketslost) c.resends += p->packetsLost - c.lastpacketslost;
+        c.lastpacketslost = p->packetsLost;
+    }
+}
+
+void writenetstats()
+{
+    float secs = max(totalmillis-lastnetstats, 1)/1000.0f;
+    lastnetstats = totalmillis;
+    stream *f = openfile(netstatsfile, "a");
+    if(!f) { conoutf(CON_ERROR, "could not open %s", netstatsfile); return; }
+    rtthist.reset();
+    jitterhist.reset();
+    losshist.reset();
+    uint totalin = 0, totalout = 0, resends = 0;
+    int peers = 0;
+    loopv(clients) if(clients[i]->type==ST_TCPIP && clients[i]->peer)
+    {
+        client &c = *clients[i];
+        ENetPeer *p = c.peer;
+        loopj(MAXSTATCHANS) { totalin += c.bytesin[j]; totalout += c.bytesout[j]; }
+        uint peerresends = c.resends - c.lastresends;
+        c.lastresends = c.resends;
+        resends += peerresends;
+        int loss = int(p->packetLoss*100/ENET_PEER_PACKET_LOSS_SCALE);
+        rtthist.add(p->roundTripTime);
+        jitterhist.add(p->roundTripTimeVariance);
+        losshist.add(loss);
+        peers++;
+        f->printf("peer time=%u cn=%d ip=%s rtt=%u jitter=%u loss=%d throttle=%u resends=%u queued=%d inflight=%u",
+            totalsecs, c.num, c.hostname, p->roundTripTime, p->roundTripTimeVariance, loss, p->packetThrottle, peerresends,
+            int(enet_list_size(&p->outgoingReliableCommands) + enet_list_size(&p->outgoingUnreliableCommands)), p->reliableDataInTransit);
+        writechanstats(f, "in", c.bytesin, secs);
+        writechanstats(f, "out", c.bytesout, secs);
+        f->printf("\n");
+    }
+    f->printf("host time=%u secs=%.1f peers=%d in=%d out=%d resends=%u\n", totalsecs, secs, peers, int(totalin/secs), int(totalout/secs), resends);
+    if(peers)
+    {
+        rtthist.write(f);
+        jitterhist.write(f);
+        losshist.write(f);
+    }
+    delete f;
+}
+
 void serverslice(bool dedicated, uint timeout)   // main server update, called from main loop in sp, or from below in dedicated server
 {
     if(!serverhost)
@@ -648,7 +914,10 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
         totalmillis = millis;
         updatetime();
     }
+    batching = true;
     server::serverupdate();
+    flushbatches();
+    batching = false;
 
     flushmasteroutput();
     checkserversockets();
@@ -660,16 +929,22 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
     {
         laststatus = totalmillis;
         if(nonlocalclients || serverhost->totalSentData || serverhost->totalReceivedData) logoutf("status: %d remote clients, %.1f send, %.1f rec (K/sec)", nonlocalclients, serverhost->totalSentData/60.0f/1024, serverhost->totalReceivedData/60.0f/1024);
+        if(batchedmsgs) logoutf("batching: %d messages in %d packets", batchedmsgs, batchedpackets);
         serverhost->totalSentData = serverhost->totalReceivedData = 0;
+        batchedmsgs = batchedpackets = 0;
     }
 
+    if(netstats && totalmillis-lastnetstats >= netstats*1000) writenetstats();
+
     ENetEvent event;
     bool serviced = false;
     while(!serviced)
     {
         if(enet_host_check_events(serverhost, &event) <= 0)
         {
-            if(enet_host_service(serverhost, &event, timeout) <= 0) break;
+            int serviceresult = enet_host_service(serverhost, &event, timeout);
+            if(netstats) countresends();
+            if(serviceresult <= 0) break;
             serviced = true;
         }
         switch(event.type)
@@ -689,7 +964,11 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
             case ENET_EVENT_TYPE_RECEIVE:
             {
                 client *c = (client *)event.peer->data;
-                if(c) process(event.packet, c->num, event.channelID);
+                if(c)
+                {
+                    c->bytesin[min(int(event.channelID), int(MAXSTATCHANS)-1)] += event.packet->dataLength;
+                    process(event.packet, c->num, event.channelID);
+                }
                 if(event.packet->referenceCount==0) enet_packet_destroy(event.packet);
                 break;
             }
@@ -707,6 +986,7 @@ void serverslice(bool dedicated, uint timeout)   // main server update, called f
         }
     }
     if(server::sendpackets()) enet_host_flush(serverhost);
+    if(netstats) countresends();
 }
 
 void flushserver(bool force)
@@ -1015,6 +1295,27 @@ static bool dedicatedserver = false;
 
 bool isdedicatedserver() { return dedicatedserver; }
 
+#ifndef WIN32
+#include <signal.h>
+
+// a standalone server finishes its current slice and returns from main on SIGINT/SIGTERM so that exit reports
+// get written, a second signal kills it as before
+static volatile sig_atomic_t serverstop = 0;
+
+static void stopserver(int sig) { serverstop = 1; }
+
+void setupserversignals()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopserver;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+#endif
+
 void rundedicatedserver()
 {
     dedicatedserver = true;
@@ -1033,7 +1334,7 @@ void rundedicatedserver()
         serverslice(true, 5);
     }
 #else
-    for(;;) serverslice(true, 5);
+    while(!serverstop) serverslice(true, 5);
 #endif
     dedicatedserver = false;
 }
@@ -1096,7 +1397,7 @@ void initserver(bool listen, bool dedicated)
     {
         dedicatedserver = dedicated;
         updatemasterserver();
-        if(dedicated) rundedicatedserver(); // never returns
+        if(dedicated) rundedicatedserver(); // only returns when a standalone server is stopped
 #ifndef STANDALONE
         else conoutf("listen server started");
 #endif
@@ -1152,6 +1453,10 @@ int main(int argc, char **argv)
     setlogfile(NULL);
     if(enet_initialize()<0) fatal("Unable to initialise network module");
     atexit(enet_deinitialize);
+    atexit(dumpscriptprof);
+#ifndef WIN32
+    setupserversignals();
+#endif
     enet_time_set(0);
     for(int i = 1; i<argc; i++) if(argv[i][0]!='-' || !serveroption(argv[i])) gameargs.add(argv[i]);
     game::parseoptions(gameargs);
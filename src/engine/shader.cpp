@@ -1161,7 +1161,7 @@ void setshader(char *name)
     Shader *s = shaders.access(name);
     if(!s)
     {
-        conoutf(CON_ERROR, "no such shader: %s", name);
+        if(!headless) conoutf(CON_ERROR, "no such shader: %s", name); // no shaders are loaded without a GL context
     }
     else slotshader = s;
 }
@@ -1452,6 +1452,7 @@ Texture *textureload(const char *name, int clamp, bool mipit, bool msg)
     copystring(tname, name);
     Texture *t = textures.access(path(tname));
     if(t) return t;
+    if(headless) return notexture;
     int compress = 0;
     ImageData s;
     if(texturedata(s, tname, NULL, msg, &compress, &clamp)) return newtexture(NULL, tname, s, clamp, mipit, false, false, compress);
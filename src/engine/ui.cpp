@@ -129,10 +129,19 @@ namespace UI
         STATE_HOLD_MASK = STATE_HOLD | STATE_ALT_HOLD | STATE_ESC_HOLD
     };
 
+    enum
+    {
+        LAYOUT_DIRTY = 1<<0, // layout of this object must be recomputed
+        LAYOUT_DEEP  = 1<<1  // ... and so must that of all its descendants
+    };
+
+    // objects persist across frames and only redo layout when a rebuild changed them or their children
+    VAR(uilayoutcache, 0, 1, 1);
+
     struct Object;
 
     static Object *buildparent = NULL;
-    static int buildchild = -1;
+    static int buildchild = -1, numlayouts = 0;
 
     #define BUILD(type, o, setup, contents) do { \
         if(buildparent) \
@@ -149,9 +158,11 @@ namespace UI
         float x, y, w, h;
         uchar adjust;
         ushort state, childstate;
+        uchar layoutflags;
+        float lx, ly, lw, lh;
         vector<Object *> children;
 
-        Object() : state(0), childstate(0) {}
+        Object() : state(0), childstate(0), layoutflags(LAYOUT_DIRTY|LAYOUT_DEEP), lx(0), ly(0), lw(0), lh(0) {}
         virtual ~Object()
         {
             clearchildren();
@@ -182,6 +193,14 @@ namespace UI
         {
         }
 
+        // setup stores every field that layout() reads through this, so that only a changed value dirties the layout
+        template<class T> void setlayout(T &val, T newval)
+        {
+            if(val == newval) return;
+            val = newval;
+            layoutflags |= LAYOUT_DIRTY;
+        }
+
         void clearchildren()
         {
             children.deletecontents();
@@ -241,12 +260,43 @@ namespace UI
             loopchildren(o,
             {
                 o->x = o->y = 0;
-                o->layout();
+                o->dolayout();
                 w = max(w, o->x + o->w);
                 h = max(h, o->y + o->h);
             });
         }
 
+        // adjustment clobbers the positions and sizes computed by layout, so they are saved here and
+        // restored for subtrees that did not change since the last frame
+        void restorelayout()
+        {
+            w = lw;
+            h = lh;
+            loopchildren(o,
+            {
+                o->x = o->lx;
+                o->y = o->ly;
+                o->restorelayout();
+            });
+        }
+
+        void dolayout()
+        {
+            if(!uilayoutcache) layoutflags |= LAYOUT_DIRTY;
+            if(!(layoutflags&LAYOUT_DIRTY)) { restorelayout(); return; }
+            if(layoutflags&LAYOUT_DEEP) loopchildren(o, o->layoutflags |= LAYOUT_DIRTY|LAYOUT_DEEP);
+            layout();
+            lw = w;
+            lh = h;
+            loopchildren(o,
+            {
+                o->lx = o->x;
+                o->ly = o->y;
+            });
+            layoutflags = 0;
+            numlayouts++;
+        }
+
         void adjustchildrento(float px, float py, float pw, float ph)
         {
             loopchildren(o, o->adjustlayout(px, py, pw, ph));
@@ -482,9 +532,24 @@ namespace UI
             return t;
         }
 
+        void finishchildren()
+        {
+            if(children.length() > buildchild)
+            {
+                while(children.length() > buildchild)
+                    delete children.pop();
+                layoutflags |= LAYOUT_DIRTY;
+            }
+            loopchildren(o, { if(o->layoutflags&LAYOUT_DIRTY) { layoutflags |= LAYOUT_DIRTY; break; } });
+        }
+
         void buildchildren(uint *contents)
         {
-            if((*contents&CODE_OP_MASK) == CODE_EXIT) children.deletecontents();
+            if((*contents&CODE_OP_MASK) == CODE_EXIT)
+            {
+                if(children.length()) layoutflags |= LAYOUT_DIRTY;
+                children.deletecontents();
+            }
             else
             {
                 Object *oldparent = buildparent;
@@ -492,8 +557,7 @@ namespace UI
                 buildparent = this;
                 buildchild = 0;
                 executeret(contents);
-                while(children.length() > buildchild)
-                    delete children.pop();
+                finishchildren();
                 buildparent = oldparent;
                 buildchild = oldchild;
             }
@@ -514,6 +578,8 @@ namespace UI
         bool allowinput, eschide, abovehud;
         float px, py, pw, ph;
         vec2 sscale, soffset;
+        ullong buildtime, layouttime;
+        int layouts;
 
         Window(const char *name, const char *contents, const char *onshow, const char *onhide) :
             name(newstring(name)),
@@ -522,7 +588,8 @@ namespace UI
             onhide(onhide && onhide[0] ? compilecode(onhide) : NULL),
             allowinput(true), eschide(true), abovehud(false),
             px(0), py(0), pw(0), ph(0),
-            sscale(1, 1), soffset(0, 0)
+            sscale(1, 1), soffset(0, 0),
+            buildtime(0), layouttime(0), layouts(0)
         {
         }
         ~Window()
@@ -561,10 +628,14 @@ namespace UI
 
         void layout()
         {
-            if(state&STATE_HIDDEN) { w = h = 0; return; }
+            if(state&STATE_HIDDEN) { w = h = layouttime = layouts = 0; return; }
+            ullong start = getmicroseconds();
+            int oldlayouts = numlayouts;
             window = this;
             Object::layout();
             window = NULL;
+            layouttime = getmicroseconds() - start;
+            layouts = numlayouts - oldlayouts;
         }
 
         void draw(float sx, float sy)
@@ -656,6 +727,10 @@ namespace UI
 
     struct World : Object
     {
+        ::font *layoutfont;
+
+        World() : layoutfont(NULL) {}
+
         static const char *typestr() { return "#World"; }
         const char *gettype() const { return typestr(); }
 
@@ -675,6 +750,17 @@ namespace UI
             } \
         } while(0)
 
+        void layout()
+        {
+            // windows are laid out starting from the current font, so nothing measured with another is valid
+            if(layoutfont != curfont)
+            {
+                layoutfont = curfont;
+                loopwindows(w, w->layoutflags |= LAYOUT_DIRTY|LAYOUT_DEEP);
+            }
+            Object::layout();
+        }
+
         void adjustchildren()
         {
             loopwindows(w, w->adjustlayout());
@@ -778,11 +864,14 @@ namespace UI
 
     void Window::build()
     {
+        ullong start = getmicroseconds();
         reset(world);
         setup();
+        layoutflags |= LAYOUT_DIRTY;
         window = this;
         buildchildren(contents);
         window = NULL;
+        buildtime = getmicroseconds() - start;
     }
 
     struct HorizontalList : Object
@@ -795,7 +884,7 @@ namespace UI
         void setup(float space_ = 0)
         {
             Object::setup();
-            space = space_;
+            setlayout(space, space_);
         }
 
         uchar childalign() const { return ALIGN_VCENTER; }
@@ -807,7 +896,7 @@ namespace UI
             {
                 o->x = subw;
                 o->y = 0;
-                o->layout();
+                o->dolayout();
                 subw += o->w;
                 h = max(h, o->y + o->h);
             });
@@ -841,7 +930,7 @@ namespace UI
         void setup(float space_ = 0)
         {
             Object::setup();
-            space = space_;
+            setlayout(space, space_);
         }
 
         uchar childalign() const { return ALIGN_HCENTER; }
@@ -853,7 +942,7 @@ namespace UI
             {
                 o->x = 0;
                 o->y = subh;
-                o->layout();
+                o->dolayout();
                 subh += o->h;
                 w = max(w, o->x + o->w);
             });
@@ -888,9 +977,9 @@ namespace UI
         void setup(int columns_, float spacew_ = 0, float spaceh_ = 0)
         {
             Object::setup();
-            columns = columns_;
-            spacew = spacew_;
-            spaceh = spaceh_;
+            setlayout(columns, columns_);
+            setlayout(spacew, spacew_);
+            setlayout(spaceh, spaceh_);
         }
 
         uchar childalign() const { return 0; }
@@ -903,7 +992,7 @@ namespace UI
             int column = 0, row = 0;
             loopchildren(o,
             {
-                o->layout();
+                o->dolayout();
                 if(column >= widths.length()) widths.add(o->w);
                 else if(o->w > widths[column]) widths[column] = o->w;
                 if(row >= heights.length()) heights.add(o->h);
@@ -968,10 +1057,14 @@ namespace UI
             buildparent = this;
             buildchild = 0;
             executeret(columndata);
-            if(columns != buildchild) while(children.length() > buildchild) delete children.pop();
+            if(columns != buildchild)
+            {
+                while(children.length() > buildchild) delete children.pop();
+                layoutflags |= LAYOUT_DIRTY;
+            }
             columns = buildchild;
             if((*contents&CODE_OP_MASK) != CODE_EXIT) executeret(contents);
-            while(children.length() > buildchild) delete children.pop();
+            finishchildren();
             buildparent = oldparent;
             buildchild = oldchild;
             resetstate();
@@ -1028,8 +1121,8 @@ namespace UI
         void setup(float spacew_ = 0, float spaceh_ = 0)
         {
             Object::setup();
-            spacew = spacew_;
-            spaceh = spaceh_;
+            setlayout(spacew, spacew_);
+            setlayout(spaceh, spaceh_);
         }
 
         uchar childalign() const { return 0; }
@@ -1041,7 +1134,7 @@ namespace UI
             w = subh = 0;
             loopchildren(o,
             {
-                o->layout();
+                o->dolayout();
                 int cols = o->childcolumns();
                 while(widths.length() < cols) widths.add(0);
                 loopj(cols)
@@ -1101,8 +1194,8 @@ namespace UI
         void setup(float spacew_, float spaceh_)
         {
             Object::setup();
-            spacew = spacew_;
-            spaceh = spaceh_;
+            setlayout(spacew, spacew_);
+            setlayout(spaceh, spaceh_);
         }
 
         static const char *typestr() { return "#Spacer"; }
@@ -1116,7 +1209,7 @@ namespace UI
             {
                 o->x = spacew;
                 o->y = spaceh;
-                o->layout();
+                o->dolayout();
                 w = max(w, o->x + o->w);
                 h = max(h, o->y + o->h);
             });
@@ -1137,8 +1230,8 @@ namespace UI
         void setup(float offsetx_, float offsety_)
         {
             Object::setup();
-            offsetx = offsetx_;
-            offsety = offsety_;
+            setlayout(offsetx, offsetx_);
+            setlayout(offsety, offsety_);
         }
 
         static const char *typestr() { return "#Offsetter"; }
@@ -1171,8 +1264,8 @@ namespace UI
         void setup(float minw_, float minh_)
         {
             Object::setup();
-            minw = minw_;
-            minh = minh_;
+            setlayout(minw, minw_);
+            setlayout(minh, minh_);
         }
 
         static const char *typestr() { return "#Filler"; }
@@ -1749,8 +1842,9 @@ namespace UI
     VARP(uitextrows, 1, 24, 200);
     FVAR(uitextscale, 1, 0, 0);
 
+    // the new string is allocated before the old one is freed, so a changed string always changes address
     #define SETSTR(dst, src) do { \
-        if(dst) { if(dst != src && strcmp(dst, src)) { delete[] dst; dst = newstring(src); } } \
+        if(dst) { if(dst != src && strcmp(dst, src)) { char *olddst = dst; dst = newstring(src); delete[] olddst; } } \
         else dst = newstring(src); \
     } while(0)
 
@@ -1758,14 +1852,20 @@ namespace UI
     {
         float scale, wrap;
         Color color;
+        // bounds of the string as last measured, in font units, valid while the font and wrap width match
+        const ::font *measuredfont;
+        int measuredwrap;
+        float measuredw, measuredh;
+
+        Text() : measuredfont(NULL), measuredwrap(-1), measuredw(0), measuredh(0) {}
 
         void setup(float scale_ = 1, const Color &color_ = Color(255, 255, 255), float wrap_ = -1)
         {
             Object::setup();
 
-            scale = scale_;
+            setlayout(scale, scale_);
             color = color_;
-            wrap = wrap_;
+            setlayout(wrap, wrap_);
         }
 
         static const char *typestr() { return "#Text"; }
@@ -1789,11 +1889,19 @@ namespace UI
         {
             Object::layout();
 
-            float k = drawscale(), tw, th;
-            text_boundsf(getstr(), tw, th, wrap >= 0 ? int(wrap/k) : -1);
-            w = max(w, tw*k);
-            h = max(h, th*k);
+            float k = drawscale();
+            int maxwidth = wrap >= 0 ? int(wrap/k) : -1;
+            if(measuredfont != curfont || measuredwrap != maxwidth)
+            {
+                text_boundsf(getstr(), measuredw, measuredh, maxwidth);
+                measuredfont = curfont;
+                measuredwrap = maxwidth;
+            }
+            w = max(w, measuredw*k);
+            h = max(h, measuredh*k);
         }
+
+        void clearmeasure() { measuredfont = NULL; layoutflags |= LAYOUT_DIRTY; }
     };
 
     struct TextString : Text
@@ -1807,7 +1915,9 @@ namespace UI
         {
             Text::setup(scale_, color_, wrap_);
 
+            char *oldstr = str;
             SETSTR(str, str_);
+            if(str != oldstr) clearmeasure();
         }
 
         static const char *typestr() { return "#TextString"; }
@@ -1827,7 +1937,7 @@ namespace UI
         {
             Text::setup(scale_, color_, wrap_);
 
-            if(val != val_) { val = val_; intformat(str, val, sizeof(str)); }
+            if(val != val_) { val = val_; intformat(str, val, sizeof(str)); clearmeasure(); }
         }
 
         static const char *typestr() { return "#TextInt"; }
@@ -1847,7 +1957,7 @@ namespace UI
         {
             Text::setup(scale_, color_, wrap_);
 
-            if(val != val_) { val = val_; floatformat(str, val, sizeof(str)); }
+            if(val != val_) { val = val_; floatformat(str, val, sizeof(str)); clearmeasure(); }
         }
 
         static const char *typestr() { return "#TextFloat"; }
@@ -1866,7 +1976,10 @@ namespace UI
         {
             Object::setup();
 
+            ::font *oldfont = font;
             if(!font || !strcmp(font->name, name)) font = findfont(name);
+            // everything below is measured with this font
+            if(font != oldfont) layoutflags |= LAYOUT_DIRTY|LAYOUT_DEEP;
         }
 
         void layout()
@@ -1965,12 +2078,13 @@ namespace UI
     {
         float clipw, cliph, virtw, virth;
 
+        Clipper() : virtw(0), virth(0) {}
+
         void setup(float clipw_ = 0, float cliph_ = 0)
         {
             Object::setup();
-            clipw = clipw_;
-            cliph = cliph_;
-            virtw = virth = 0;
+            setlayout(clipw, clipw_);
+            setlayout(cliph, cliph_);
         }
 
         static const char *typestr() { return "#Clipper"; }
@@ -2483,6 +2597,8 @@ namespace UI
             scale = scale_;
             if(keyfilter_) SETSTR(keyfilter, keyfilter_);
             else DELETEA(keyfilter);
+            // size depends on the editor contents, which change outside of setup
+            layoutflags |= LAYOUT_DIRTY;
         }
         ~TextEditor()
         {
@@ -3002,6 +3118,16 @@ namespace UI
     ICOMMAND(uivisible, "s", (char *name), intret(uivisible(name) ? 1 : 0));
     ICOMMAND(uiname, "", (), { if(window) result(window->name); });
 
+    void uistats()
+    {
+        loopv(world->children)
+        {
+            Window *w = (Window *)world->children[i];
+            conoutf("%s: build %.2f ms, layout %.2f ms, %d objects laid out", w->name, w->buildtime/1000.0, w->layouttime/1000.0, w->layouts);
+        }
+    }
+    COMMAND(uistats, "");
+
     #define IFSTATEVAL(state,t,f) { if(state) { if(t->type == VAL_NULL) intret(1); else result(*t); } else if(f->type == VAL_NULL) intret(0); else result(*f); }
     #define DOSTATE(flags, func) \
         ICOMMANDNS("ui!" #func, uinot##func##_, "ee", (uint *t, uint *f), \
@@ -82,13 +82,14 @@ bool loadents(const char *fname, vector<entity> &ents, uint *crc)
 }
 
 #ifndef STANDALONE
-string ogzname, bakname, cfgname, picname;
+string ogzname, omcname, bakname, cfgname, picname;
 
 VARP(savebak, 0, 2, 2);
 
 void setmapfilenames(const char *fname, const char *cname = NULL)
 {
     formatstring(ogzname, "media/map/%s.ogz", fname);
+    formatstring(omcname, "media/map/%s.omc", fname);
     if(savebak==1) formatstring(bakname, "media/map/%s.BAK", fname);
     else
     {
@@ -102,6 +103,7 @@ void setmapfilenames(const char *fname, const char *cname = NULL)
     formatstring(picname, "media/map/%s.png", fname);
 
     path(ogzname);
+    path(omcname);
     path(bakname);
     path(cfgname);
     path(picname);
@@ -383,6 +385,220 @@ cube *loadchildren(stream *f, const ivec &co, int size, bool &failed)
     return c;
 }
 
+// .omc: uncompressed map container with the same sections as the .ogz, each addressable on its own,
+// and the octree flattened into breadth-first blocks of 8 that refer to their children by index
+enum { OMC_HEADER = 0, OMC_VARS, OMC_ENTS, OMC_VSLOTS, OMC_OCTREE, OMC_CUBEEXT, OMC_PVS, OMC_BLENDMAP, OMC_NUMSECTIONS };
+
+#define OMCVERSION 2
+#define OMCALIGN 16
+
+struct omcsection
+{
+    int offset, size;           // byte range within the file
+};
+
+struct omcheader
+{
+    char magic[4];              // "OMAP"
+    int version;                // any >8bit quantity is little endian
+    int headersize;             // sizeof(header)
+    uint ogzsize;               // size of the .ogz it was converted from
+    uint ogztime;               // mtime of that .ogz, both must match or the container is stale
+    int numgroups;              // child blocks in OMC_OCTREE, worldroot first
+    omcsection sections[OMC_NUMSECTIONS];
+};
+
+struct omccube
+{
+    int children;               // index of the child block, or -1 for a leaf
+    int ext;                    // byte offset into OMC_CUBEEXT, or -1
+    uchar edges[12];
+    ushort texture[6];
+    ushort material;
+    uchar merged, pad;
+};
+
+struct omcext
+{
+    uchar numverts, pad[3];     // followed by numverts vertinfos
+    surfaceinfo surfaces[6];
+};
+
+static void saveomcext(cubeext &ext, vector<uchar> &buf)
+{
+    omcext e;
+    memset(&e, 0, sizeof(e));
+    int numverts = 0;
+    loopi(6)
+    {
+        const surfaceinfo &surf = ext.surfaces[i];
+        if(!surf.used()) continue;
+        e.surfaces[i].numverts = surf.numverts;
+        if(surf.totalverts()) { e.surfaces[i].verts = numverts; numverts += surf.totalverts(); }
+    }
+    e.numverts = numverts;
+    buf.put((const uchar *)&e, sizeof(e));
+    loopi(6)
+    {
+        const surfaceinfo &surf = ext.surfaces[i];
+        if(!surf.used()) continue;
+        const vertinfo *verts = ext.verts() + surf.verts;
+        loopj(surf.totalverts())
+        {
+            vertinfo v = verts[j];
+            lilswap(&v.x, 4);
+            buf.put((const uchar *)&v, sizeof(v));
+        }
+    }
+}
+
+static int saveomcoctree(stream *f, vector<uchar> &extbuf)
+{
+    vector<cube *> groups;
+    groups.add(worldroot);
+    for(int g = 0; g < groups.length(); g++)
+    {
+        cube *c = groups[g];
+        if((savemapprogress++&0xFFF)==0) renderprogress(float(savemapprogress)/allocnodes, "saving octree...");
+        loopi(8)
+        {
+            omccube oc;
+            memset(&oc, 0, sizeof(oc));
+            oc.children = -1;
+            oc.ext = -1;
+            if(c[i].children)
+            {
+                oc.children = groups.length();
+                groups.add(c[i].children);
+            }
+            else
+            {
+                memcpy(oc.edges, c[i].edges, sizeof(oc.edges));
+                memcpy(oc.texture, c[i].texture, sizeof(oc.texture));
+                oc.material = c[i].material;
+                oc.merged = c[i].merged;
+                if(c[i].ext) loopj(6) if(c[i].ext->surfaces[j].used())
+                {
+                    oc.ext = extbuf.length();
+                    saveomcext(*c[i].ext, extbuf);
+                    break;
+                }
+            }
+            lilswap(&oc.children, 2);
+            lilswap(oc.texture, 7);
+            f->write(&oc, sizeof(oc));
+        }
+    }
+    return groups.length();
+}
+
+static bool loadomcext(cube &c, const uchar *buf, int len, int offset)
+{
+    if(offset < 0 || offset > len - int(sizeof(omcext))) return false;
+    const omcext &e = *(const omcext *)&buf[offset];
+    if(offset + int(sizeof(omcext)) + e.numverts*int(sizeof(vertinfo)) > len) return false;
+    newcubeext(c, e.numverts, false);
+    memcpy(c.ext->surfaces, e.surfaces, sizeof(c.ext->surfaces));
+    vertinfo *verts = c.ext->verts();
+    memcpy(verts, &e + 1, e.numverts*sizeof(vertinfo));
+    lilswap(&verts->x, 4*e.numverts);
+    loopi(6)
+    {
+        const surfaceinfo &surf = c.ext->surfaces[i];
+        if(surf.verts + surf.totalverts() > e.numverts) return false;
+    }
+    return true;
+}
+
+struct omcoctree
+{
+    const omccube *cubes;
+    int numgroups;
+    const uchar *exts;
+    int extlen;
+    uchar *loaded;
+};
+
+// the file is breadth-first, but blocks are allocated depth-first so each subtree ends up contiguous in the cube pool
+static cube *loadomcgroup(omcoctree &t, int g, bool &failed)
+{
+    cube *c = newcubes();
+    t.loaded[g] = 1;
+    loopi(8)
+    {
+        const omccube &oc = t.cubes[g*8 + i];
+        int children = lilswap(oc.children), ext = lilswap(oc.ext);
+        if(children >= 0)
+        {
+            if(children <= g || children >= t.numgroups || t.loaded[children]) { failed = true; break; }
+            c[i].children = loadomcgroup(t, children, failed);
+            if(failed) break;
+            continue;
+        }
+        memcpy(c[i].edges, oc.edges, sizeof(c[i].edges));
+        loopj(6) c[i].texture[j] = lilswap(oc.texture[j]);
+        c[i].material = lilswap(oc.material);
+        c[i].merged = oc.merged;
+        if(ext >= 0 && !loadomcext(c[i], t.exts, t.extlen, ext)) { failed = true; break; }
+    }
+    return c;
+}
+
+static cube *loadomcoctree(const omccube *cubes, int numgroups, const uchar *exts, int extlen, bool &failed)
+{
+    omcoctree t = { cubes, numgroups, exts, extlen, new uchar[numgroups] };
+    memset(t.loaded, 0, numgroups);
+    cube *root = loadomcgroup(t, 0, failed);
+    delete[] t.loaded;
+    return root;
+}
+
+struct omcfile
+{
+    uchar *buf;
+    size_t len;
+    omcheader hdr;
+
+    omcfile() : buf(NULL), len(0) {}
+    ~omcfile() { close(); }
+
+    bool open(const char *name, uint ogztime, uint ogzsize)
+    {
+        buf = (uchar *)mapfile(name, len);
+        if(!buf) return false;
+        if(len < sizeof(hdr)) { close(); return false; }
+        memcpy(&hdr, buf, sizeof(hdr));
+        lilswap(&hdr.version, sizeof(hdr)/sizeof(int) - 1);
+        if(memcmp(hdr.magic, "OMAP", 4) || hdr.version != OMCVERSION || hdr.headersize != sizeof(hdr) || hdr.ogztime != ogztime || hdr.ogzsize != ogzsize) { close(); return false; }
+        loopi(OMC_NUMSECTIONS)
+        {
+            const omcsection &sec = hdr.sections[i];
+            if(sec.offset < int(sizeof(hdr)) || sec.size < 0 || size_t(sec.offset) + size_t(sec.size) > len) { close(); return false; }
+        }
+        if(hdr.numgroups <= 0 || hdr.sections[OMC_OCTREE].size != hdr.numgroups*8*int(sizeof(omccube)) || hdr.sections[OMC_HEADER].size != sizeof(octaheader)) { close(); return false; }
+        octaheader ohdr;
+        memcpy(&ohdr, data(OMC_HEADER), sizeof(ohdr));
+        if(memcmp(ohdr.magic, "OCTA", 4) || lilswap(ohdr.version) != MAPVERSION) { close(); return false; }
+        return true;
+    }
+
+    void close()
+    {
+        if(buf) { unmapfile(buf, len); buf = NULL; len = 0; }
+    }
+
+    const uchar *data(int sec) const { return &buf[hdr.sections[sec].offset]; }
+    int size(int sec) const { return hdr.sections[sec].size; }
+    stream *section(int sec) const { return openmemstream(data(sec), size(sec)); }
+};
+
+static inline void nextmapsection(stream *&f, const omcfile &omc, int sec)
+{
+    if(!omc.buf) return;
+    delete f;
+    f = omc.section(sec);
+}
+
 VAR(dbgvars, 0, 0, 1);
 
 void savevslot(stream *f, VSlot &vs, int prev)
@@ -528,25 +744,8 @@ void loadvslots(stream *f, int numvslots)
     delete[] prev;
 }
 
-bool save_world(const char *mname, bool nolms)
+static void initmapheader(octaheader &hdr, int numvslots, bool nolms)
 {
-    if(!*mname) mname = game::getclientmap();
-    setmapfilenames(*mname ? mname : "untitled");
-    if(savebak) backup(ogzname, bakname);
-    stream *f = opengzfile(ogzname, "wb");
-    if(!f) { conoutf(CON_WARN, "could not write map to %s", ogzname); return false; }
-
-    int numvslots = vslots.length();
-    if(!nolms && !multiplayer(false))
-    {
-        numvslots = compactvslots();
-        allchanged();
-    }
-
-    savemapprogress = 0;
-    renderprogress(0, "saving map...");
-
-    octaheader hdr;
     memcpy(hdr.magic, "OCTA", 4);
     hdr.version = MAPVERSION;
     hdr.headersize = sizeof(hdr);
@@ -564,11 +763,15 @@ bool save_world(const char *mname, bool nolms)
         if((id.type == ID_VAR || id.type == ID_FVAR || id.type == ID_SVAR) && id.flags&IDF_OVERRIDE && !(id.flags&IDF_READONLY) && id.flags&IDF_OVERRIDDEN) hdr.numvars++;
     });
     lilswap(&hdr.version, 9);
-    f->write(&hdr, sizeof(hdr));
+}
 
+static void savemapvars(stream *f)
+{
+    int numvars = 0;
     enumerate(idents, ident, id,
     {
         if((id.type!=ID_VAR && id.type!=ID_FVAR && id.type!=ID_SVAR) || !(id.flags&IDF_OVERRIDE) || id.flags&IDF_READONLY || !(id.flags&IDF_OVERRIDDEN)) continue;
+        numvars++;
         f->putchar(id.type);
         f->putlil<ushort>(strlen(id.name));
         f->write(id.name, strlen(id.name));
@@ -592,7 +795,7 @@ bool save_world(const char *mname, bool nolms)
         }
     });
 
-    if(dbgvars) conoutf(CON_DEBUG, "wrote %d vars", hdr.numvars);
+    if(dbgvars) conoutf(CON_DEBUG, "wrote %d vars", numvars);
 
     f->putchar((int)strlen(game::gameident()));
     f->write(game::gameident(), (int)strlen(game::gameident())+1);
@@ -604,6 +807,11 @@ bool save_world(const char *mname, bool nolms)
 
     f->putlil<ushort>(texmru.length());
     loopv(texmru) f->putlil<ushort>(texmru[i]);
+}
+
+static void savemapents(stream *f, bool nolms)
+{
+    const vector<extentity *> &ents = entities::getents();
     char *ebuf = new char[entities::extraentinfosize()];
     loopv(ents)
     {
@@ -618,7 +826,32 @@ bool save_world(const char *mname, bool nolms)
         }
     }
     delete[] ebuf;
+}
+
+bool save_world(const char *mname, bool nolms)
+{
+    if(!*mname) mname = game::getclientmap();
+    setmapfilenames(*mname ? mname : "untitled");
+    if(savebak) backup(ogzname, bakname);
+    stream *f = opengzfile(ogzname, "wb");
+    if(!f) { conoutf(CON_WARN, "could not write map to %s", ogzname); return false; }
+
+    int numvslots = vslots.length();
+    if(!nolms && !multiplayer(false))
+    {
+        numvslots = compactvslots();
+        if(!headless) allchanged();
+    }
+
+    savemapprogress = 0;
+    renderprogress(0, "saving map...");
+
+    octaheader hdr;
+    initmapheader(hdr, numvslots, nolms);
+    f->write(&hdr, sizeof(hdr));
 
+    savemapvars(f);
+    savemapents(f, nolms);
     savevslots(f, numvslots);
 
     renderprogress(0, "saving octree...");
@@ -635,16 +868,111 @@ bool save_world(const char *mname, bool nolms)
     return true;
 }
 
+static void beginomcsection(stream *f, omcheader &hdr, int sec)
+{
+    static const uchar zeros[OMCALIGN] = { 0 };
+    int pad = -int(f->tell())&(OMCALIGN-1);
+    if(pad) f->write(zeros, pad);
+    hdr.sections[sec].offset = int(f->tell());
+}
+
+static void endomcsection(stream *f, omcheader &hdr, int sec)
+{
+    hdr.sections[sec].size = int(f->tell()) - hdr.sections[sec].offset;
+}
+
+static bool save_omc(uint ogztime, uint ogzsize)
+{
+    stream *f = openrawfile(omcname, "wb");
+    if(!f) { conoutf(CON_WARN, "could not write map container to %s", omcname); return false; }
+
+    savemapprogress = 0;
+    renderprogress(0, "converting map...");
+
+    omcheader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "OMAP", 4);
+    hdr.version = OMCVERSION;
+    hdr.headersize = sizeof(hdr);
+    hdr.ogzsize = ogzsize;
+    hdr.ogztime = ogztime;
+    f->write(&hdr, sizeof(hdr)); // rewritten once the section table is known
+
+    beginomcsection(f, hdr, OMC_HEADER);
+    octaheader ohdr;
+    initmapheader(ohdr, vslots.length(), false);
+    f->write(&ohdr, sizeof(ohdr));
+    endomcsection(f, hdr, OMC_HEADER);
+
+    beginomcsection(f, hdr, OMC_VARS);
+    savemapvars(f);
+    endomcsection(f, hdr, OMC_VARS);
+
+    beginomcsection(f, hdr, OMC_ENTS);
+    savemapents(f, false);
+    endomcsection(f, hdr, OMC_ENTS);
+
+    beginomcsection(f, hdr, OMC_VSLOTS);
+    savevslots(f, vslots.length());
+    endomcsection(f, hdr, OMC_VSLOTS);
+
+    vector<uchar> extbuf;
+    beginomcsection(f, hdr, OMC_OCTREE);
+    hdr.numgroups = saveomcoctree(f, extbuf);
+    endomcsection(f, hdr, OMC_OCTREE);
+
+    beginomcsection(f, hdr, OMC_CUBEEXT);
+    f->write(extbuf.getbuf(), extbuf.length());
+    endomcsection(f, hdr, OMC_CUBEEXT);
+
+    beginomcsection(f, hdr, OMC_PVS);
+    if(getnumviewcells()>0) savepvs(f);
+    endomcsection(f, hdr, OMC_PVS);
+
+    beginomcsection(f, hdr, OMC_BLENDMAP);
+    if(shouldsaveblendmap()) saveblendmap(f);
+    endomcsection(f, hdr, OMC_BLENDMAP);
+
+    lilswap(&hdr.version, sizeof(hdr)/sizeof(int) - 1);
+    f->seek(0, SEEK_SET);
+    f->write(&hdr, sizeof(hdr));
+    delete f;
+    conoutf("wrote map container %s", omcname);
+    return true;
+}
+
+static uint getrawfilesize(const char *name)
+{
+    stream *f = openrawfile(name, "rb");
+    if(!f) return 0;
+    uint size = uint(f->size());
+    delete f;
+    return size;
+}
+
 static uint mapcrc = 0;
 
 uint getmapcrc() { return mapcrc; }
 void clearmapcrc() { mapcrc = 0; }
 
+VARP(mapcontainers, 0, 1, 1);
+
+static bool convertingmap = false;
+static bool mapreadomc = false;
+static int maploadmillis = 0, mapreadmicros = 0;
+
 bool load_world(const char *mname, const char *cname)        // still supports all map formats that have existed since the earliest cube betas!
 {
     int loadingstart = SDL_GetTicks();
+    ullong readstart = getmicroseconds();
     setmapfilenames(mname, cname);
-    stream *f = opengzfile(ogzname, "rb");
+    // a container is only used next to an .ogz on disk whose mtime and size it was made from, and never in multiplayer,
+    // since the map crc sent to the server has to come from the .ogz itself
+    uint ogztime = uint(getfilemtime(ogzname)), ogzsize = ogztime ? getrawfilesize(ogzname) : 0;
+    omcfile omc;
+    if(mapcontainers && !convertingmap && ogztime && !multiplayer(false)) omc.open(omcname, ogztime, ogzsize);
+    const char *mapfilename = omc.buf ? omcname : ogzname;
+    stream *f = omc.buf ? omc.section(OMC_HEADER) : opengzfile(ogzname, "rb");
     if(!f) { conoutf(CON_ERROR, "could not read map %s", ogzname); return false; }
     octaheader hdr;
     if(f->read(&hdr, 7*sizeof(int))!=int(7*sizeof(int))) { conoutf(CON_ERROR, "map %s has malformatted header", ogzname); delete f; return false; }
@@ -674,6 +1002,7 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     setvar("mapscale", worldscale, true, false);
 
     renderprogress(0, "loading vars...");
+    nextmapsection(f, omc, OMC_VARS);
 
     loopi(hdr.numvars)
     {
@@ -751,6 +1080,7 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     loopi(nummru) texmru.add(f->getlil<ushort>());
 
     renderprogress(0, "loading entities...");
+    nextmapsection(f, omc, OMC_ENTS);
 
     vector<extentity *> &ents = entities::getents();
     int einfosize = entities::extraentinfosize();
@@ -794,11 +1124,13 @@ bool load_world(const char *mname, const char *cname)        // still supports a
     }
 
     renderprogress(0, "loading slots...");
+    nextmapsection(f, omc, OMC_VSLOTS);
     loadvslots(f, hdr.numvslots);
 
     renderprogress(0, "loading octree...");
     bool failed = false;
-    worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
+    if(omc.buf) worldroot = loadomcoctree((const omccube *)omc.data(OMC_OCTREE), omc.hdr.numgroups, omc.data(OMC_CUBEEXT), omc.size(OMC_CUBEEXT), failed);
+    else worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
     if(failed) conoutf(CON_ERROR, "garbage in map");
 
     renderprogress(0, "validating...");
@@ -819,22 +1151,38 @@ bool load_world(const char *mname, const char *cname)        // still supports a
             f->seek(bpp*LM_PACKW*LM_PACKH, SEEK_CUR);
         }
 
-        if(hdr.numpvs > 0) loadpvs(f, hdr.numpvs);
-        if(hdr.blendmap) loadblendmap(f, hdr.blendmap);
+        if(hdr.numpvs > 0) { nextmapsection(f, omc, OMC_PVS); loadpvs(f, hdr.numpvs); }
+        if(hdr.blendmap) { nextmapsection(f, omc, OMC_BLENDMAP); loadblendmap(f, hdr.blendmap); }
     }
 
-    mapcrc = f->getcrc();
+    mapcrc = omc.buf ? 0 : f->getcrc();
     delete f;
+    omc.close();
+    mapreadmicros = int(getmicroseconds() - readstart);
+    mapreadomc = mapfilename == omcname;
 
-    conoutf("read map %s (%.1f seconds)", ogzname, (SDL_GetTicks()-loadingstart)/1000.0f);
+    if(convertingmap && !failed)
+    {
+        if(ogztime) save_omc(ogztime, ogzsize);
+        else conoutf(CON_WARN, "map %s is not a file on disk, not writing a container", ogzname);
+    }
+
+    conoutf("read map %s (%.1f seconds)", mapfilename, (SDL_GetTicks()-loadingstart)/1000.0f);
 
-    clearmainmenu();
+    if(!headless) clearmainmenu();
 
     identflags |= IDF_OVERRIDDEN;
     execfile("config/default_map_settings.cfg", false);
     execfile(cfgname, false);
     identflags &= ~IDF_OVERRIDDEN;
 
+    if(headless)
+    {
+        // the map compiler only needs the octree and slot settings, not models, sounds or vertex arrays
+        maploadmillis = SDL_GetTicks()-loadingstart;
+        return true;
+    }
+
     preloadusedmapmodels(true);
 
     game::preload();
@@ -853,9 +1201,44 @@ bool load_world(const char *mname, const char *cname)        // still supports a
 
     startmap(cname ? cname : mname);
 
+    maploadmillis = SDL_GetTicks()-loadingstart;
+
     return true;
 }
 
+void convertmap(const char *mname)
+{
+    if(multiplayer()) return;
+    if(!*mname) mname = game::getclientmap();
+    if(!*mname) { conoutf(CON_ERROR, "no map to convert"); return; }
+    string name;
+    copystring(name, mname);
+    convertingmap = true;
+    load_world(name);
+    convertingmap = false;
+}
+COMMAND(convertmap, "s");
+
+void mapbench(const char *mname)
+{
+    if(multiplayer()) return;
+    if(!*mname) mname = game::getclientmap();
+    if(!*mname) { conoutf(CON_ERROR, "no map to benchmark"); return; }
+    string name;
+    copystring(name, mname);
+    int oldcontainers = mapcontainers;
+    mapcontainers = 0;
+    if(!load_world(name)) { mapcontainers = oldcontainers; return; }
+    int ogzread = mapreadmicros, ogzload = maploadmillis;
+    mapcontainers = 1;
+    bool hasomc = load_world(name) && mapreadomc;
+    mapcontainers = oldcontainers;
+    conoutf("map %s: .ogz read %.2f ms, load %d ms", name, ogzread/1000.0f, ogzload);
+    if(hasomc) conoutf("map %s: .omc read %.2f ms, load %d ms", name, mapreadmicros/1000.0f, maploadmillis);
+    else conoutf(CON_WARN, "map %s has no current .omc container, run convertmap first", name);
+}
+COMMAND(mapbench, "s");
+
 void savecurrentmap() { save_world(game::getclientmap()); }
 void savemap(char *mname) { save_world(mname); }
 
@@ -1883,6 +1883,49 @@ namespace game
         }
     }
 
+    // a partial download is kept across disconnects so "getmap" can ask the server to resume from the next chunk
+    struct mapdownloadinfo
+    {
+        int id, chunk;
+        string name, fname;
+        stream *file;
+
+        mapdownloadinfo() : id(0), chunk(0), file(NULL) { name[0] = fname[0] = '\0'; }
+
+        void clear()
+        {
+            DELETEP(file);
+            if(fname[0]) remove(findfile(fname, "rb"));
+            id = chunk = 0;
+            name[0] = fname[0] = '\0';
+        }
+
+        void start(int newid)
+        {
+            clear();
+            formatstring(name, "getmap_%d", lastmillis);
+            formatstring(fname, "media/map/%s.ogz", name);
+            file = openrawfile(path(fname), "wb");
+            if(file) id = newid;
+            else fname[0] = '\0';
+        }
+    } mapdownload;
+
+    struct demodownloadinfo
+    {
+        string fname;
+        stream *file;
+
+        demodownloadinfo() : file(NULL) { fname[0] = '\0'; }
+
+        void start()
+        {
+            DELETEP(file);
+            formatstring(fname, "%d.dmo", lastmillis);
+            file = openrawfile(fname, "wb");
+        }
+    } demodownload;
+
     void receivefile(packetbuf &p)
     {
         int type;
@@ -1891,32 +1934,34 @@ namespace game
             case N_DEMOPACKET: return;
             case N_SENDDEMO:
             {
-                defformatstring(fname, "%d.dmo", lastmillis);
-                stream *demo = openrawfile(fname, "wb");
-                if(!demo) return;
-                conoutf("received demo \"%s\"", fname);
+                int offset = getint(p), size = getint(p);
                 ucharbuf b = p.subbuf(p.remaining());
-                demo->write(b.buf, b.maxlen);
-                delete demo;
+                if(!offset) demodownload.start();
+                if(!demodownload.file || offset != demodownload.file->tell()) return;
+                demodownload.file->write(b.buf, b.maxlen);
+                if(demodownload.file->tell() < size) break;
+                conoutf("received demo \"%s\"", demodownload.fname);
+                DELETEP(demodownload.file);
                 break;
             }
 
-            case N_SENDMAP:
+            case N_MAPCHUNK:
             {
+                int id = getint(p), chunk = getint(p), size = getint(p);
+                ucharbuf b = p.subbuf(p.remaining());
                 if(!m_edit) return;
+                if(!chunk || id != mapdownload.id) mapdownload.start(id);
+                if(!mapdownload.file || chunk != mapdownload.chunk) return;
+                mapdownload.file->write(b.buf, b.maxlen);
+                mapdownload.chunk++;
+                if(mapdownload.file->tell() < size) break;
+                conoutf("received map");
+                DELETEP(mapdownload.file);
                 string oldname;
                 copystring(oldname, getclientmap());
-                defformatstring(mname, "getmap_%d", lastmillis);
-                defformatstring(fname, "media/map/%s.ogz", mname);
-                stream *map = openrawfile(path(fname), "wb");
-                if(!map) return;
-                conoutf("received map");
-                ucharbuf b = p.subbuf(p.remaining());
-                map->write(b.buf, b.maxlen);
-                delete map;
-                if(load_world(mname, oldname[0] ? oldname : NULL))
+                if(load_world(mapdownload.name, oldname[0] ? oldname : NULL))
                     entities::spawnitems(true);
-                remove(findfile(fname, "rb"));
+                mapdownload.clear();
                 break;
             }
         }
@@ -1944,8 +1989,9 @@ namespace game
     void getmap()
     {
         if(!m_edit) { conoutf(CON_ERROR, "\"getmap\" only works in coop edit mode"); return; }
-        conoutf("getting map...");
-        addmsg(N_GETMAP, "r");
+        if(mapdownload.file && mapdownload.chunk > 0) conoutf("resuming map download...");
+        else conoutf("getting map...");
+        addmsg(N_GETMAP, "rii", mapdownload.id, mapdownload.file ? mapdownload.chunk : 0);
     }
     COMMAND(getmap, "");
 
@@ -30,21 +30,16 @@ namespace server
 
     struct clientinfo;
 
-    struct gameevent
-    {
-        virtual ~gameevent() {}
-
-        virtual bool flush(clientinfo *ci, int fmillis);
-        virtual void process(clientinfo *ci) {}
+    enum { GE_SHOT = 0, GE_EXPLODE, GE_SUICIDE, GE_PICKUP, NUMGAMEEVENTS };
 
-        virtual bool keepable() const { return false; }
-    };
-
-    struct timedevent : gameevent
+    // events live by value in a fixed ring per client, their hits follow in order in a second ring
+    struct gameevent
     {
-        int millis;
+        int type, millis, id, atk, numhits;
+        vec from, to;
 
-        bool flush(clientinfo *ci, int fmillis);
+        bool timed() const { return type==GE_SHOT || type==GE_EXPLODE; }
+        bool keepable() const { return type==GE_EXPLODE; }
     };
 
     struct hitinfo
@@ -56,35 +51,22 @@ namespace server
         vec dir;
     };
 
-    struct shotevent : timedevent
+    struct eventbucket
     {
-        int id, atk;
-        vec from, to;
-        vector<hitinfo> hits;
+        int tokens, lastmillis;
 
-        void process(clientinfo *ci);
-    };
-
-    struct explodeevent : timedevent
-    {
-        int id, atk;
-        vector<hitinfo> hits;
+        void reset() { tokens = -1; lastmillis = 0; }
 
-        bool keepable() const { return true; }
-
-        void process(clientinfo *ci);
-    };
-
-    struct suicideevent : gameevent
-    {
-        void process(clientinfo *ci);
-    };
-
-    struct pickupevent : gameevent
-    {
-        int ent;
-
-        void process(clientinfo *ci);
+        // token bucket in thousandths of an event, refilled at rate events per second up to burst
+        bool consume(int millis, int rate, int burst)
+        {
+            if(tokens < 0 || millis - lastmillis > 1000*burst) tokens = 1000*burst;
+            else tokens = min(tokens + (millis - lastmillis)*rate, 1000*burst);
+            lastmillis = millis;
+            if(tokens < 1000) return false;
+            tokens -= 1000;
+            return true;
+        }
     };
 
     template <int N>
@@ -203,6 +185,93 @@ namespace server
 
     extern int gamemillis, nextexceeded;
 
+    // positions of every live player over the last second, used to rewind hitscan shots to what the shooter saw
+    struct hitboxhistory
+    {
+        enum
+        {
+            FRAMES = 64,
+            STEP = 16,
+            SLOTS = MAXCLIENTS + MAXBOTS
+        };
+
+        int cur, num;
+        int millis[FRAMES];
+        float x[FRAMES][SLOTS], y[FRAMES][SLOTS], z[FRAMES][SLOTS];
+        uchar life[FRAMES][SLOTS];
+
+        hitboxhistory() { reset(); }
+
+        void reset() { cur = num = 0; }
+
+        void newframe(int when)
+        {
+            if(!num || when - millis[cur] >= STEP)
+            {
+                cur = (cur + 1) % FRAMES;
+                num = min(num + 1, int(FRAMES));
+            }
+            millis[cur] = when;
+            memset(life[cur], 0, sizeof(life[cur]));
+        }
+
+        void add(int cn, const vec &o, int lifesequence)
+        {
+            if(cn < 0 || cn >= SLOTS) return;
+            x[cur][cn] = o.x;
+            y[cur][cn] = o.y;
+            z[cur][cn] = o.z;
+            life[cur][cn] = uchar(lifesequence + 1);
+        }
+
+        static bool segmentbox(const vec &from, const vec &to, const vec &bbmin, const vec &bbmax)
+        {
+            float tmin = 0, tmax = 1;
+            loopk(3)
+            {
+                float d = to[k] - from[k];
+                if(fabs(d) < 1e-6f)
+                {
+                    if(from[k] < bbmin[k] || from[k] > bbmax[k]) return false;
+                    continue;
+                }
+                float t1 = (bbmin[k] - from[k])/d, t2 = (bbmax[k] - from[k])/d;
+                if(t1 > t2) swap(t1, t2);
+                tmin = max(tmin, t1);
+                tmax = min(tmax, t2);
+                if(tmin > tmax) return false;
+            }
+            return true;
+        }
+
+        // only rejects a hit if the target was recorded around that time and the ray missed every recorded box
+        bool checkhit(int cn, int lifesequence, const vec &from, const vec &to, int when, int window, float radius, float height, float margin) const
+        {
+            if(cn < 0 || cn >= SLOTS) return true;
+            uchar wantlife = uchar(lifesequence + 1);
+            bool seen = false;
+            loopi(num)
+            {
+                int f = (cur - i + FRAMES) % FRAMES, offset = millis[f] - when;
+                if(offset > window) continue;
+                if(offset < -window) break;
+                if(life[f][cn] != wantlife) continue;
+                seen = true;
+                vec bbmin(x[f][cn] - radius - margin, y[f][cn] - radius - margin, z[f][cn] - margin),
+                    bbmax(x[f][cn] + radius + margin, y[f][cn] + radius + margin, z[f][cn] + height + margin);
+                if(segmentbox(from, to, bbmin, bbmax)) return true;
+            }
+            return !seen;
+        }
+    };
+    hitboxhistory hitboxes;
+
+    struct worldstateview
+    {
+        uint seq, hash;
+        int tick;
+    };
+
     struct clientinfo
     {
         int clientnum, ownernum, connectmillis, sessionid, overflow;
@@ -213,8 +282,14 @@ namespace server
         bool connected, local, timesync;
         int gameoffset, lastevent, pushed, exceeded;
         servstate state;
-        vector<gameevent *> events;
+        enum { MAXEVENTS = 64, MAXEVENTHITS = 256 };
+        queue<gameevent, MAXEVENTS> events;
+        queue<hitinfo, MAXEVENTHITS> eventhits;
+        eventbucket eventbuckets[NUMGAMEEVENTS];
+        int droppedevents;
         vector<uchar> position, messages;
+        uint posseq, poshash;
+        vector<worldstateview> wsviews;
         uchar *wsdata;
         int wslen;
         vector<clientinfo *> bots;
@@ -222,7 +297,8 @@ namespace server
         string clientmap;
         int mapcrc;
         bool warned, gameclip;
-        ENetPacket *getdemo, *getmap, *clipboard;
+        ENetPacket *clipboard;
+        int getdemo, getdemooffset, getmapchunk;
         int lastclipboard, needclipboard;
         int connectauth;
         uint authreq;
@@ -231,13 +307,20 @@ namespace server
         int authkickvictim;
         char *authkickreason;
 
-        clientinfo() : getdemo(NULL), getmap(NULL), clipboard(NULL), authchallenge(NULL), authkickreason(NULL) { reset(); }
-        ~clientinfo() { events.deletecontents(); cleanclipboard(); cleanauth(); }
+        clientinfo() : clipboard(NULL), authchallenge(NULL), authkickreason(NULL) { reset(); }
+        ~clientinfo() { cleanclipboard(); cleanauth(); }
+
+        void clearevents()
+        {
+            events.clear();
+            eventhits.clear();
+        }
 
-        void addevent(gameevent *e)
+        hitinfo *addhit(gameevent *e)
         {
-            if(state.state==CS_SPECTATOR || events.length()>100) delete e;
-            else events.add(e);
+            if(!e || eventhits.full()) return NULL;
+            e->numhits++;
+            return &eventhits.add();
         }
 
         enum
@@ -285,7 +368,9 @@ namespace server
             mapvote[0] = 0;
             modevote = INT_MAX;
             state.reset();
-            events.deletecontents();
+            clearevents();
+            loopi(NUMGAMEEVENTS) eventbuckets[i].reset();
+            droppedevents = 0;
             overflow = 0;
             timesync = false;
             lastevent = 0;
@@ -300,7 +385,7 @@ namespace server
         void reassign()
         {
             state.reassign();
-            events.deletecontents();
+            clearevents();
             timesync = false;
             lastevent = 0;
         }
@@ -335,8 +420,12 @@ namespace server
             connectauth = 0;
             position.setsize(0);
             messages.setsize(0);
+            posseq = poshash = 0;
+            wsviews.setsize(0);
             ping = 0;
             aireinit = 0;
+            getdemo = getdemooffset = 0;
+            getmapchunk = -1;
             needclipboard = 0;
             cleanclipboard();
             cleanauth();
@@ -391,6 +480,9 @@ namespace server
     enet_uint32 lastsend = 0;
     int mastermode = MM_OPEN, mastermask = MM_PRIVSERV;
     stream *mapdata = NULL;
+    int mapdataid = 0;
+    extern void sendmapchunks();
+    extern void senddemochunks();
 
     vector<uint> allowedips;
     vector<ban> bannedips;
@@ -591,18 +683,20 @@ namespace server
     struct demofile
     {
         string info;
-        uchar *data;
-        int len;
+        stream *file;
+        int id, len;
     };
 
     vector<demofile> demos;
 
     bool demonextmatch = false;
-    stream *demotmp = NULL, *demorecord = NULL, *demoplayback = NULL;
-    int nextplayback = 0, demomillis = 0;
+    stream *demotmp = NULL, *demorecord = NULL, *demoplayback = NULL, *demoplaybackfile = NULL;
+    int nextplayback = 0, demomillis = 0, lastdemokeyframe = 0, demotmpseq = 0, demoid = 0;
+    vector<demokeyframe> demokeys;
 
     VAR(maxdemos, 0, 5, 25);
     VAR(maxdemosize, 0, 16, 64);
+    VAR(demokeyframes, 0, 10, 300);
     VAR(restrictdemos, 0, 1, 1);
 
     VAR(restrictpausegame, 0, 1, 1);
@@ -760,6 +854,89 @@ namespace server
          sendf(-1, 1, "ris", N_SERVMSG, s);
     }
 
+    // server mods bind script commands or aliases to game events, which get called with typed arguments;
+    // an event nobody hooked costs a single check
+    enum { HOOK_CONNECT = 0, HOOK_DISCONNECT, HOOK_FRAG, HOOK_SHOT, HOOK_TEXT, NUMHOOKS };
+
+    static const char * const hooknames[NUMHOOKS] = { "connect", "disconnect", "frag", "shot", "text" };
+    static ident *hooks[NUMHOOKS] = { NULL, NULL, NULL, NULL, NULL };
+
+    #define SERVERHOOK(type, numargs, setargs) do { \
+        if(hooks[type]) \
+        { \
+            tagval args[numargs]; \
+            setargs; \
+            execute(hooks[type], args, numargs); \
+        } \
+    } while(0)
+
+    void serverhook(const char *event, const char *name)
+    {
+        loopi(NUMHOOKS) if(!strcmp(hooknames[i], event))
+        {
+            hooks[i] = name[0] ? newident(name) : NULL;
+            return;
+        }
+        conoutf(CON_ERROR, "unknown server event: %s", event);
+    }
+    COMMAND(serverhook, "ss");
+
+    ICOMMAND(serverclients, "", (),
+    {
+        vector<char> buf;
+        loopv(clients)
+        {
+            if(buf.length()) buf.add(' ');
+            defformatstring(cn, "%d", clients[i]->clientnum);
+            buf.put(cn, strlen(cn));
+        }
+        buf.add('\0');
+        result(buf.getbuf());
+    });
+    ICOMMAND(serverclientname, "i", (int *cn), { clientinfo *ci = getinfo(*cn); result(ci ? ci->name : ""); });
+    #define SERVERCLIENTINT(name, val) \
+        ICOMMAND(serverclient##name, "i", (int *cn), { clientinfo *ci = getinfo(*cn); intret(ci ? (val) : -1); })
+    SERVERCLIENTINT(team, ci->team)
+    SERVERCLIENTINT(privilege, ci->privilege)
+    SERVERCLIENTINT(ping, ci->ping)
+    SERVERCLIENTINT(state, ci->state.state)
+    SERVERCLIENTINT(frags, ci->state.frags)
+    SERVERCLIENTINT(flags, ci->state.flags)
+    SERVERCLIENTINT(deaths, ci->state.deaths)
+    SERVERCLIENTINT(teamkills, ci->state.teamkills)
+    SERVERCLIENTINT(damage, ci->state.damage)
+    SERVERCLIENTINT(shotdamage, ci->state.shotdamage)
+
+    ICOMMAND(servermsg, "C", (char *msg), sendservmsg(msg));
+    ICOMMAND(servermsgto, "iC", (int *cn, char *msg), { if(getinfo(*cn)) sendf(*cn, 1, "ris", N_SERVMSG, msg); });
+
+    // compares hook dispatch with typed arguments against building the equivalent command string
+    void serverhookbench(int *numevents)
+    {
+        ident *id = hooks[HOOK_FRAG];
+        if(!id) { conoutf(CON_ERROR, "no frag hook to benchmark"); return; }
+        int events = *numevents > 0 ? *numevents : 100000;
+        ullong start = getmicroseconds();
+        loopi(events) SERVERHOOK(HOOK_FRAG, 3, { args[0].setint(i%16); args[1].setint((i+1)%16); args[2].setint(i%NUMATKS); });
+        ullong typed = getmicroseconds() - start;
+        start = getmicroseconds();
+        loopi(events)
+        {
+            defformatstring(cmd, "%s %d %d %d", id->name, i%16, (i+1)%16, i%NUMATKS);
+            execute(cmd);
+        }
+        ullong formatted = getmicroseconds() - start;
+        ident *oldhook = hooks[HOOK_FRAG];
+        hooks[HOOK_FRAG] = NULL;
+        start = getmicroseconds();
+        loopi(events) SERVERHOOK(HOOK_FRAG, 3, { args[0].setint(i%16); args[1].setint((i+1)%16); args[2].setint(i%NUMATKS); });
+        ullong unhooked = getmicroseconds() - start;
+        hooks[HOOK_FRAG] = oldhook;
+        conoutf("server hooks: %d frag events, typed %.1f ns/event, formatted %.1f ns/event, unhooked %.1f ns/event",
+            events, typed*1e3/events, formatted*1e3/events, unhooked*1e3/events);
+    }
+    COMMAND(serverhookbench, "i");
+
     void resetitems()
     {
         mcrc = 0;
@@ -873,7 +1050,7 @@ namespace server
         if(!ci || (!ci->local && !ci->state.canpickup(sents[i].type))) return false;
         sents[i].spawned = false;
         sents[i].spawntime = spawntime(sents[i].type);
-        sendf(-1, 1, "ri3", N_ITEMACC, i, sender);
+        netmsg(-1, 1).i(N_ITEMACC).i(i).i(sender).send();
         ci->state.pickup(sents[i].type);
         return true;
     }
@@ -971,25 +1148,72 @@ namespace server
     {
         int n = clamp(demos.length() + extra - maxdemos, 0, demos.length());
         if(n <= 0) return;
-        loopi(n) delete[] demos[i].data;
+        loopi(n) delete demos[i].file;
         demos.remove(0, n);
     }
 
+    void writedemoindex()
+    {
+        if(!demotmp->seek(0, SEEK_END)) return;
+        loopv(demokeys)
+        {
+            demokeyframe k = demokeys[i];
+            lilswap(&k.millis, 3);
+            demotmp->write(&k, sizeof(k));
+        }
+        demoindex idx;
+        idx.numkeys = demokeys.length();
+        lilswap(&idx.numkeys, 1);
+        memcpy(idx.magic, DEMO_INDEXMAGIC, sizeof(idx.magic));
+        demotmp->write(&idx, sizeof(idx));
+    }
+
+    void readdemoindex(stream *f)
+    {
+        demokeys.setsize(0);
+        demoindex idx;
+        if(!f->seek(-int(sizeof(idx)), SEEK_END) || f->read(&idx, sizeof(idx))!=sizeof(idx) || memcmp(idx.magic, DEMO_INDEXMAGIC, sizeof(idx.magic)))
+        {
+            f->seek(0, SEEK_SET);
+            return;
+        }
+        lilswap(&idx.numkeys, 1);
+        // the index comes from the file, so a key count or keyframe that doesn't fit the file discards the whole index
+        stream::offset end = f->size() - stream::offset(sizeof(idx));
+        if(idx.numkeys > 0 && idx.numkeys <= end/stream::offset(sizeof(demokeyframe)))
+        {
+            int len = idx.numkeys*sizeof(demokeyframe);
+            end -= len;
+            if(!f->seek(end, SEEK_SET) || f->read(demokeys.pad(idx.numkeys), len)!=len) demokeys.setsize(0);
+            else loopv(demokeys)
+            {
+                demokeyframe &k = demokeys[i];
+                lilswap(&k.millis, 3);
+                if(k.millis < (i ? demokeys[i-1].millis : 0) || k.rawoffset < 0 || k.rawoffset >= end || k.offset < 0)
+                {
+                    demokeys.setsize(0);
+                    break;
+                }
+            }
+        }
+        f->seek(0, SEEK_SET);
+    }
+
     void adddemo()
     {
         if(!demotmp) return;
-        int len = (int)min(demotmp->size(), stream::offset((maxdemosize<<20) + 0x10000));
+        writedemoindex();
+        int len = (int)min(demotmp->size(), stream::offset(INT_MAX));
         demofile &d = demos.add();
         time_t t = time(NULL);
         char *timestr = ctime(&t), *trim = timestr + strlen(timestr);
         while(trim>timestr && iscubespace(*--trim)) *trim = '\0';
         formatstring(d.info, "%s: %s, %s, %.2f%s", timestr, modeprettyname(gamemode), smapname, len > 1024*1024 ? len/(1024*1024.f) : len/1024.0f, len > 1024*1024 ? "MB" : "kB");
         sendservmsgf("demo \"%s\" recorded", d.info);
-        d.data = new uchar[len];
+        d.file = demotmp;
+        d.id = ++demoid;
         d.len = len;
-        demotmp->seek(0, SEEK_SET);
-        demotmp->read(d.data, len);
-        DELETEP(demotmp);
+        demotmp = NULL;
     }
 
     void enddemorecord()
@@ -998,11 +1222,13 @@ namespace server
 
         DELETEP(demorecord);
 
-        if(!demotmp) return;
-        if(!maxdemos || !maxdemosize) { DELETEP(demotmp); return; }
-
-        prunedemos(1);
-        adddemo();
+        if(demotmp && maxdemos && maxdemosize)
+        {
+            prunedemos(1);
+            adddemo();
+        }
+        DELETEP(demotmp);
+        demokeys.setsize(0);
     }
 
     void writedemo(int chan, void *data, int len)
@@ -1023,11 +1249,32 @@ namespace server
     int welcomepacket(packetbuf &p, clientinfo *ci);
     void sendwelcome(clientinfo *ci);
 
+    void writedemokeyframe()
+    {
+        stream::offset rawoffset = demorecord->syncpoint();
+        if(rawoffset < 0 || rawoffset > INT_MAX) return;
+        demokeyframe &k = demokeys.add();
+        k.millis = gamemillis;
+        k.rawoffset = int(rawoffset);
+        k.offset = int(demorecord->tell());
+        lastdemokeyframe = gamemillis;
+
+        packetbuf p(MAXTRANS, ENET_PACKET_FLAG_RELIABLE);
+        welcomepacket(p, NULL);
+        writedemo(DEMO_KEYFRAME, p.buf, p.len);
+    }
+
+    void updatedemorecord()
+    {
+        if(demorecord && demokeyframes && gamemillis - lastdemokeyframe >= demokeyframes*1000) writedemokeyframe();
+    }
+
     void setupdemorecord()
     {
         if(!m_mp(gamemode) || m_edit) return;
 
-        demotmp = opentempfile("demorecord", "w+b");
+        defformatstring(tmpname, "demorecord%d", demotmpseq++);
+        demotmp = opentempfile(tmpname, "w+b");
         if(!demotmp) return;
 
         stream *f = opengzfile(NULL, "wb", demotmp);
@@ -1047,6 +1294,9 @@ namespace server
         packetbuf p(MAXTRANS, ENET_PACKET_FLAG_RELIABLE);
         welcomepacket(p, NULL);
         writedemo(1, p.buf, p.len);
+
+        demokeys.setsize(0);
+        if(demokeyframes) writedemokeyframe();
     }
 
     void listdemos(int cn)
@@ -1062,50 +1312,34 @@ namespace server
     {
         if(!n)
         {
-            loopv(demos) delete[] demos[i].data;
+            loopv(demos) delete demos[i].file;
             demos.shrink(0);
             sendservmsg("cleared all demos");
         }
         else if(demos.inrange(n-1))
         {
-            delete[] demos[n-1].data;
+            delete demos[n-1].file;
             demos.remove(n-1);
             sendservmsgf("cleared demo %d", n);
         }
     }
 
-    static void freegetmap(ENetPacket *packet)
-    {
-        loopv(clients)
-        {
-            clientinfo *ci = clients[i];
-            if(ci->getmap == packet) ci->getmap = NULL;
-        }
-    }
-
-    static void freegetdemo(ENetPacket *packet)
-    {
-        loopv(clients)
-        {
-            clientinfo *ci = clients[i];
-            if(ci->getdemo == packet) ci->getdemo = NULL;
-        }
-    }
-
+    // demos are streamed from their file alongside the map chunks, see senddemochunks
     void senddemo(clientinfo *ci, int num)
     {
         if(ci->getdemo) return;
         if(!num) num = demos.length();
         if(!demos.inrange(num-1)) return;
-        demofile &d = demos[num-1];
-        if((ci->getdemo = sendf(ci->clientnum, 2, "rim", N_SENDDEMO, d.len, d.data)))
-            ci->getdemo->freeCallback = freegetdemo;
+        ci->getdemo = demos[num-1].id;
+        ci->getdemooffset = 0;
     }
 
     void enddemoplayback()
     {
         if(!demoplayback) return;
         DELETEP(demoplayback);
+        DELETEP(demoplaybackfile);
+        demokeys.setsize(0);
 
         loopv(clients) sendf(clients[i]->clientnum, 1, "ri3", N_DEMOPLAYBACK, 0, clients[i]->clientnum);
 
@@ -1121,19 +1355,26 @@ namespace server
         string msg;
         msg[0] = '\0';
         defformatstring(file, "%s.dmo", smapname);
-        demoplayback = opengzfile(file, "rb");
+        demoplaybackfile = openfile(file, "rb");
+        if(demoplaybackfile)
+        {
+            readdemoindex(demoplaybackfile);
+            demoplayback = opengzfile(NULL, "rb", demoplaybackfile);
+        }
         if(!demoplayback) formatstring(msg, "could not read demo \"%s\"", file);
         else if(demoplayback->read(&hdr, sizeof(demoheader))!=sizeof(demoheader) || memcmp(hdr.magic, DEMO_MAGIC, sizeof(hdr.magic)))
             formatstring(msg, "\"%s\" is not a demo file", file);
         else
         {
             lilswap(&hdr.version, 2);
-            if(hdr.version!=DEMO_VERSION) formatstring(msg, "demo \"%s\" requires an %s version of Tesseract", file, hdr.version<DEMO_VERSION ? "older" : "newer");
-            else if(hdr.protocol!=PROTOCOL_VERSION) formatstring(msg, "demo \"%s\" requires an %s version of Tesseract", file, hdr.protocol<PROTOCOL_VERSION ? "older" : "newer");
+            if(hdr.version<1 || hdr.version>DEMO_VERSION) formatstring(msg, "demo \"%s\" requires an %s version of Tesseract", file, hdr.version<1 ? "older" : "newer");
+            else if(hdr.protocol<DEMO_PROTOCOL_MIN || hdr.protocol>PROTOCOL_VERSION) formatstring(msg, "demo \"%s\" requires an %s version of Tesseract", file, hdr.protocol<DEMO_PROTOCOL_MIN ? "older" : "newer");
         }
         if(msg[0])
         {
             DELETEP(demoplayback);
+            DELETEP(demoplaybackfile);
+            demokeys.setsize(0);
             sendservmsg(msg);
             return;
         }
@@ -1151,40 +1392,86 @@ namespace server
         lilswap(&nextplayback, 1);
     }
 
-    void readdemo()
+    // reads the record stamped nextplayback and the stamp of the one after it
+    bool playdemorecord(bool positions = true, bool keyframe = false)
     {
-        if(!demoplayback) return;
-        demomillis += curtime;
-        while(demomillis>=nextplayback)
+        int chan, len;
+        if(demoplayback->read(&chan, sizeof(chan))!=sizeof(chan) ||
+           demoplayback->read(&len, sizeof(len))!=sizeof(len))
         {
-            int chan, len;
-            if(demoplayback->read(&chan, sizeof(chan))!=sizeof(chan) ||
-               demoplayback->read(&len, sizeof(len))!=sizeof(len))
+            enddemoplayback();
+            return false;
+        }
+        lilswap(&chan, 1);
+        lilswap(&len, 1);
+        if(chan==DEMO_KEYFRAME ? !keyframe : !chan && !positions)
+        {
+            if(len < 0 || !demoplayback->seek(len, SEEK_CUR))
             {
                 enddemoplayback();
-                return;
+                return false;
             }
-            lilswap(&chan, 1);
-            lilswap(&len, 1);
+        }
+        else
+        {
             ENetPacket *packet = enet_packet_create(NULL, len+1, 0);
             if(!packet || demoplayback->read(packet->data+1, len)!=len)
             {
                 if(packet) enet_packet_destroy(packet);
                 enddemoplayback();
-                return;
+                return false;
             }
             packet->data[0] = N_DEMOPACKET;
-            sendpacket(-1, chan, packet);
+            sendpacket(-1, chan==DEMO_KEYFRAME ? 1 : chan, packet);
             if(!packet->referenceCount) enet_packet_destroy(packet);
-            if(!demoplayback) break;
-            if(demoplayback->read(&nextplayback, sizeof(nextplayback))!=sizeof(nextplayback))
+            if(!demoplayback) return false;
+        }
+        if(demoplayback->read(&nextplayback, sizeof(nextplayback))!=sizeof(nextplayback))
+        {
+            enddemoplayback();
+            return false;
+        }
+        lilswap(&nextplayback, 1);
+        return true;
+    }
+
+    void readdemo()
+    {
+        if(!demoplayback) return;
+        demomillis += curtime;
+        while(demomillis>=nextplayback) if(!playdemorecord()) return;
+    }
+
+    // restarts playback from the last keyframe at or before the target and catches up without sending positions
+    void seekdemo(int *secs)
+    {
+        if(!demoplayback) return;
+        int target = max(*secs, 0)*1000, key = -1;
+        loopv(demokeys) if(demokeys[i].millis <= target) key = i;
+        if(key < 0 && demokeys.length()) key = 0;
+        if(key >= 0 && (target < demomillis || demokeys[key].millis > demomillis))
+        {
+            demokeyframe &k = demokeys[key];
+            if(!demoplayback->seeksync(k.rawoffset, k.offset) ||
+               demoplayback->read(&nextplayback, sizeof(nextplayback))!=sizeof(nextplayback))
             {
                 enddemoplayback();
                 return;
             }
             lilswap(&nextplayback, 1);
+            loopv(clients) sendf(clients[i]->clientnum, 1, "ri3", N_DEMOPLAYBACK, 0, clients[i]->clientnum);
+            sendf(-1, 1, "ri3", N_DEMOPLAYBACK, 1, -1);
+            if(!playdemorecord(false, true)) return;
+        }
+        else if(target < demomillis)
+        {
+            sendservmsg("demo has no keyframes, cannot seek backwards");
+            return;
         }
+        while(nextplayback <= target) if(!playdemorecord(false)) return;
+        demomillis = target;
     }
+    COMMAND(seekdemo, "i");
 
     void stopdemo()
     {
@@ -1455,7 +1742,7 @@ namespace server
         }
 
         uchar operator[](int msg) const { return msg >= 0 && msg < NUMMSG ? msgmask[msg] : 0; }
-    } msgfilter(-1, N_CONNECT, N_SERVINFO, N_INITCLIENT, N_WELCOME, N_MAPCHANGE, N_SERVMSG, N_DAMAGE, N_HITPUSH, N_SHOTFX, N_EXPLODEFX, N_DIED, N_SPAWNSTATE, N_FORCEDEATH, N_TEAMINFO, N_ITEMACC, N_ITEMSPAWN, N_TIMEUP, N_CDIS, N_CURRENTMASTER, N_PONG, N_RESUME, N_SENDDEMOLIST, N_SENDDEMO, N_DEMOPLAYBACK, N_SENDMAP, N_DROPFLAG, N_SCOREFLAG, N_RETURNFLAG, N_RESETFLAG, N_CLIENT, N_AUTHCHAL, N_INITAI, N_DEMOPACKET, -2, N_CALCLIGHT, N_REMIP, N_NEWMAP, N_GETMAP, N_SENDMAP, N_CLIPBOARD, -3, N_EDITENT, N_EDITF, N_EDITT, N_EDITM, N_FLIP, N_COPY, N_PASTE, N_ROTATE, N_REPLACE, N_DELCUBE, N_EDITVAR, -4, N_POS, NUMMSG),
+    } msgfilter(-1, N_CONNECT, N_SERVINFO, N_INITCLIENT, N_WELCOME, N_MAPCHANGE, N_SERVMSG, N_DAMAGE, N_HITPUSH, N_SHOTFX, N_EXPLODEFX, N_DIED, N_SPAWNSTATE, N_FORCEDEATH, N_TEAMINFO, N_ITEMACC, N_ITEMSPAWN, N_TIMEUP, N_CDIS, N_CURRENTMASTER, N_PONG, N_RESUME, N_SENDDEMOLIST, N_SENDDEMO, N_DEMOPLAYBACK, N_SENDMAP, N_MAPCHUNK, N_DROPFLAG, N_SCOREFLAG, N_RETURNFLAG, N_RESETFLAG, N_CLIENT, N_AUTHCHAL, N_INITAI, N_DEMOPACKET, -2, N_CALCLIGHT, N_REMIP, N_NEWMAP, N_GETMAP, N_SENDMAP, N_CLIPBOARD, -3, N_EDITENT, N_EDITF, N_EDITT, N_EDITM, N_FLIP, N_COPY, N_PASTE, N_ROTATE, N_REPLACE, N_DELCUBE, N_EDITVAR, -4, N_POS, NUMMSG),
       connectfilter(-1, N_CONNECT, -2, N_AUTHANS, -3, N_PING, NUMMSG);
 
     int checktype(int type, clientinfo *ci)
@@ -1504,6 +1791,15 @@ namespace server
     vector<worldstate> worldstates;
     bool reliablemessages = false;
 
+    VAR(clientworldstate, 0, 1, 1);
+    VAR(worldstatedist, 0, 512, 0x10000);
+    VAR(worldstateskip, 1, 4, 25);
+    VAR(worldstaterefresh, 0, 12, 25);
+
+    uint worldstateseq = 0, worldstatebuilt = 0;
+    int worldstateticks = 0;
+    int wsstatbytes = 0, wsstatshared = 0, wsstatclients = 0, wsstatticks = 0, wsstatmillis = 0;
+
     void cleanworldstate(ENetPacket *packet)
     {
         loopv(worldstates)
@@ -1543,6 +1839,8 @@ namespace server
             int size = wslen;
             if(ci.wsdata >= wsbuf.buf) { data = ci.wsdata + ci.wslen; size -= ci.wslen; }
             if(size <= 0) continue;
+            wsstatbytes += size;
+            wsstatshared += size;
             ENetPacket *packet = enet_packet_create(data, size, ENET_PACKET_FLAG_NO_ALLOCATE);
             sendpacket(ci.clientnum, 0, packet);
             if(packet->referenceCount) { ws.uses++; packet->freeCallback = cleanworldstate; }
@@ -1551,6 +1849,17 @@ namespace server
         wsbuf.offset(wsbuf.length());
     }
 
+    static void sendclientpositions(worldstate &ws, ucharbuf &wsbuf, int start, clientinfo &ci)
+    {
+        int size = wsbuf.length() - start;
+        if(size <= 0) return;
+        wsstatbytes += size;
+        ENetPacket *packet = enet_packet_create(&wsbuf.buf[start], size, ENET_PACKET_FLAG_NO_ALLOCATE);
+        sendpacket(ci.clientnum, 0, packet);
+        if(packet->referenceCount) { ws.uses++; packet->freeCallback = cleanworldstate; }
+        else enet_packet_destroy(packet);
+    }
+
     static inline void addposition(worldstate &ws, ucharbuf &wsbuf, int mtu, clientinfo &bi, clientinfo &ci)
     {
         if(bi.position.empty()) return;
@@ -1600,35 +1909,169 @@ namespace server
         else ci.wslen += len;
     }
 
+    static inline int worldstateinterval(clientinfo &ci, clientinfo &bi)
+    {
+        if(ci.state.state!=CS_ALIVE || !worldstatedist) return 1;
+        float dist = ci.state.o.dist(bi.state.o);
+        if(dist <= worldstatedist) return 1;
+        return min(1 + int((dist - worldstatedist)/worldstatedist), worldstateskip);
+    }
+
+    static inline bool freshposition(clientinfo &bi)
+    {
+        return !bi.position.empty() && int(bi.posseq - worldstatebuilt) > 0;
+    }
+
+    static inline bool wantclientposition(clientinfo &bi, clientinfo &ci)
+    {
+        if(bi.position.empty() || bi.ownernum == ci.clientnum) return false;
+        if(!ci.wsviews.inrange(bi.clientnum)) return true;
+        worldstateview &v = ci.wsviews[bi.clientnum];
+        if(v.seq == bi.posseq || worldstateticks - v.tick < worldstateinterval(ci, bi)) return false;
+        // identical bytes carry no new information, so only resend them often enough to keep the client from flagging a lag
+        return bi.poshash != v.hash || worldstateticks - v.tick >= worldstaterefresh;
+    }
+
+    // sizes the tick's buffer from what will actually be sent, so idle ticks allocate nothing
+    static int clientpositionsize()
+    {
+        int size = 0;
+        loopv(clients)
+        {
+            clientinfo &ci = *clients[i];
+            if(demorecord && freshposition(ci)) size += ci.position.length();
+            if(ci.state.aitype != AI_NONE) continue;
+            loopvj(clients) if(wantclientposition(*clients[j], ci)) size += clients[j]->position.length();
+        }
+        return size;
+    }
+
+    static inline void addclientposition(worldstate &ws, ucharbuf &wsbuf, int mtu, int &start, clientinfo &bi, clientinfo &ci)
+    {
+        if(freshposition(bi)) wsstatshared += bi.position.length();
+        if(!wantclientposition(bi, ci)) return;
+        while(ci.wsviews.length() <= bi.clientnum)
+        {
+            worldstateview &v = ci.wsviews.add();
+            v.seq = v.hash = 0;
+            v.tick = 0;
+        }
+        worldstateview &v = ci.wsviews[bi.clientnum];
+        if(wsbuf.length() - start + bi.position.length() > mtu)
+        {
+            sendclientpositions(ws, wsbuf, start, ci);
+            start = wsbuf.length();
+        }
+        wsbuf.put(bi.position.getbuf(), bi.position.length());
+        v.seq = bi.posseq;
+        v.hash = bi.poshash;
+        v.tick = worldstateticks;
+    }
+
+    static void recordpositions(ucharbuf &wsbuf, int mtu)
+    {
+        int start = wsbuf.length();
+        loopv(clients)
+        {
+            clientinfo &ci = *clients[i];
+            if(ci.state.aitype != AI_NONE) continue;
+            loopj(ci.bots.length()+1)
+            {
+                clientinfo &bi = j ? *ci.bots[j-1] : ci;
+                if(!freshposition(bi)) continue;
+                if(wsbuf.length() - start + bi.position.length() > mtu)
+                {
+                    recordpacket(0, &wsbuf.buf[start], wsbuf.length() - start);
+                    start = wsbuf.length();
+                }
+                wsbuf.put(bi.position.getbuf(), bi.position.length());
+            }
+        }
+        if(wsbuf.length() > start) recordpacket(0, &wsbuf.buf[start], wsbuf.length() - start);
+        wsbuf.offset(wsbuf.length());
+    }
+
+    static void buildclientpositions(worldstate &ws, ucharbuf &wsbuf, int mtu)
+    {
+        if(demorecord) recordpositions(wsbuf, mtu);
+        loopv(clients)
+        {
+            clientinfo &ci = *clients[i];
+            if(ci.state.aitype != AI_NONE) continue;
+            int start = wsbuf.length();
+            loopvj(clients)
+            {
+                clientinfo &bi = *clients[j];
+                if(bi.state.aitype != AI_NONE) continue;
+                addclientposition(ws, wsbuf, mtu, start, bi, ci);
+                loopvk(bi.bots) addclientposition(ws, wsbuf, mtu, start, *bi.bots[k], ci);
+            }
+            sendclientpositions(ws, wsbuf, start, ci);
+        }
+        wsbuf.offset(wsbuf.length());
+        worldstateticks++;
+    }
+
+    static void worldstatestats(int recipients)
+    {
+        if(!wsstatmillis) wsstatmillis = totalmillis;
+        int elapsed = totalmillis - wsstatmillis;
+        if(elapsed >= 60*1000)
+        {
+            if(isdedicatedserver() && wsstatclients && wsstatticks)
+            {
+                float clientsecs = wsstatclients/float(wsstatticks) * elapsed/1000.0f;
+                logoutf("worldstate: %.1f bytes/client/sec (%.1f shared, %s mode)", wsstatbytes/clientsecs, wsstatshared/clientsecs, clientworldstate ? "per-client" : "shared");
+            }
+            wsstatbytes = wsstatshared = wsstatclients = wsstatticks = 0;
+            wsstatmillis = totalmillis;
+        }
+        wsstatticks++;
+        wsstatclients += recipients;
+    }
+
     bool buildworldstate()
     {
-        int wsmax = 0;
+        int posmax = 0, msgmax = 0, recipients = 0;
         loopv(clients)
         {
             clientinfo &ci = *clients[i];
             ci.overflow = 0;
             ci.wsdata = NULL;
-            wsmax += ci.position.length();
-            if(ci.messages.length()) wsmax += 10 + ci.messages.length();
+            if(!clientworldstate) posmax += ci.position.length();
+            if(ci.messages.length()) msgmax += 10 + ci.messages.length();
+            if(ci.state.aitype == AI_NONE) recipients++;
         }
-        if(wsmax <= 0)
+        if(clientworldstate) posmax = clientpositionsize();
+        worldstatestats(recipients);
+        if(posmax + msgmax <= 0)
         {
+            if(clientworldstate)
+            {
+                worldstatebuilt = worldstateseq;
+                worldstateticks++;
+            }
             reliablemessages = false;
             return false;
         }
         worldstate &ws = worldstates.add();
-        ws.setup(2*wsmax);
+        ws.setup(clientworldstate ? posmax + 2*msgmax : 2*(posmax + msgmax));
         int mtu = getservermtu() - 100;
         if(mtu <= 0) mtu = ws.len;
         ucharbuf wsbuf(ws.data, ws.len);
-        loopv(clients)
+        if(clientworldstate) buildclientpositions(ws, wsbuf, mtu);
+        else
         {
-            clientinfo &ci = *clients[i];
-            if(ci.state.aitype != AI_NONE) continue;
-            addposition(ws, wsbuf, mtu, ci, ci);
-            loopvj(ci.bots) addposition(ws, wsbuf, mtu, *ci.bots[j], ci);
+            loopv(clients)
+            {
+                clientinfo &ci = *clients[i];
+                if(ci.state.aitype != AI_NONE) continue;
+                addposition(ws, wsbuf, mtu, ci, ci);
+                loopvj(ci.bots) addposition(ws, wsbuf, mtu, *ci.bots[j], ci);
+            }
+            sendpositions(ws, wsbuf);
         }
-        sendpositions(ws, wsbuf);
+        worldstatebuilt = worldstateseq;
         loopv(clients)
         {
             clientinfo &ci = *clients[i];
@@ -1902,6 +2345,7 @@ namespace server
 
         gamemode = mode;
         gamemillis = 0;
+        hitboxes.reset();
         gamelimit = (m_overtime ? 15 : 10)*60000;
         interm = 0;
         nextexceeded = 0;
@@ -2074,12 +2518,12 @@ namespace server
         servstate &ts = target->state;
         ts.dodamage(damage);
         if(target!=actor && !isteam(target->team, actor->team)) actor->state.damage += damage;
-        sendf(-1, 1, "ri5", N_DAMAGE, target->clientnum, actor->clientnum, damage, ts.health);
+        netmsg(-1, 1).i(N_DAMAGE).i(target->clientnum).i(actor->clientnum).i(damage).i(ts.health).send();
         if(target==actor) target->setpushed();
         else if(!hitpush.iszero())
         {
             ivec v = vec(hitpush).rescale(DNF);
-            sendf(ts.health<=0 ? -1 : target->ownernum, 1, "ri7", N_HITPUSH, target->clientnum, atk, damage, v.x, v.y, v.z);
+            netmsg(ts.health<=0 ? -1 : target->ownernum, 1).i(N_HITPUSH).i(target->clientnum).i(atk).i(damage).i(v.x).i(v.y).i(v.z).send();
             target->setpushed();
         }
         if(ts.health<=0)
@@ -2096,7 +2540,7 @@ namespace server
             }
             teaminfo *t = m_teammode && validteam(actor->team) ? &teaminfos[actor->team-1] : NULL;
             if(t) t->frags += fragvalue;
-            sendf(-1, 1, "ri5", N_DIED, target->clientnum, actor->clientnum, actor->state.frags, t ? t->frags : 0);
+            netmsg(-1, 1).i(N_DIED).i(target->clientnum).i(actor->clientnum).i(actor->state.frags).i(t ? t->frags : 0).send();
             target->position.setsize(0);
             if(smode) smode->died(target, actor);
             ts.state = CS_DEAD;
@@ -2107,6 +2551,7 @@ namespace server
                 addteamkill(actor, target, 1);
             }
             ts.deadflush = ts.lastdeath + DEATHMILLIS;
+            SERVERHOOK(HOOK_FRAG, 3, { args[0].setint(actor->clientnum); args[1].setint(target->clientnum); args[2].setint(atk); });
             // don't issue respawn yet until DEATHMILLIS has elapsed
             // ts.respawn();
         }
@@ -2127,16 +2572,14 @@ namespace server
         gs.state = CS_DEAD;
         gs.lastdeath = gamemillis;
         gs.respawn();
+        // suicides have no attack
+        SERVERHOOK(HOOK_FRAG, 3, { args[0].setint(ci->clientnum); args[1].setint(ci->clientnum); args[2].setint(-1); });
     }
 
-    void suicideevent::process(clientinfo *ci)
-    {
-        suicide(ci);
-    }
-
-    void explodeevent::process(clientinfo *ci)
+    void explodeevent(clientinfo *ci, const gameevent &e)
     {
         servstate &gs = ci->state;
+        int atk = e.atk, id = e.id;
         switch(atk)
         {
             case ATK_PULSE_SHOOT:
@@ -2146,15 +2589,15 @@ namespace server
             default:
                 return;
         }
-        sendf(-1, 1, "ri4x", N_EXPLODEFX, ci->clientnum, atk, id, ci->ownernum);
-        loopv(hits)
+        netmsg(-1, 1, ci->ownernum).i(N_EXPLODEFX).i(ci->clientnum).i(atk).i(id).send();
+        loopi(e.numhits)
         {
-            hitinfo &h = hits[i];
+            hitinfo &h = ci->eventhits[i];
             clientinfo *target = getinfo(h.target);
             if(!target || target->state.state!=CS_ALIVE || h.lifesequence!=target->state.lifesequence || h.dist<0 || h.dist>attacks[atk].exprad) continue;
 
             bool dup = false;
-            loopj(i) if(hits[j].target==h.target) { dup = true; break; }
+            loopj(i) if(ci->eventhits[j].target==h.target) { dup = true; break; }
             if(dup) continue;
 
             float damage = attacks[atk].damage*(1-h.dist/EXP_DISTSCALE/attacks[atk].exprad);
@@ -2163,9 +2606,57 @@ namespace server
         }
     }
 
-    void shotevent::process(clientinfo *ci)
+    VAR(lagcomp, 0, 1, 1);
+    VAR(lagcompwindow, 0, 150, 1000);
+    VAR(lagcompmargin, 0, 4, 64);
+
+    void recordhitboxes()
+    {
+        hitboxes.newframe(gamemillis);
+        loopv(clients)
+        {
+            clientinfo *ci = clients[i];
+            if(ci->state.state==CS_ALIVE) hitboxes.add(ci->clientnum, ci->state.o, ci->state.lifesequence);
+        }
+    }
+
+    bool checkhitbox(clientinfo *ci, int when, int atk, const hitinfo &h, const vec &from, const vec &to)
+    {
+        if(!lagcomp || attacks[atk].projspeed || attacks[atk].rays != 1) return true;
+        ENetPeer *peer = getclientpeer(ci->ownernum);
+        // the shooter saw the target as it was one round trip plus one worldstate interval before the shot reached us
+        int rewind = peer ? min(int(peer->roundTripTime), hitboxhistory::FRAMES*hitboxhistory::STEP) + 40 : 0;
+        static const physent player;
+        return hitboxes.checkhit(h.target, h.lifesequence, from, to, when - rewind, lagcompwindow, player.radius, player.maxheight + player.aboveeye, attacks[atk].margin + lagcompmargin);
+    }
+
+    void lagcompbench(int *numplayers, int *numshots)
+    {
+        int players = clamp(*numplayers > 0 ? *numplayers : 64, 1, int(MAXCLIENTS)), shots = *numshots > 0 ? *numshots : 100000;
+        hitboxhistory *h = new hitboxhistory;
+        loopi(hitboxhistory::FRAMES)
+        {
+            h->newframe(i*hitboxhistory::STEP);
+            loopj(players) h->add(j, vec(512 + (j%8)*64 + i, 512 + (j/8)*64, 512), 0);
+        }
+        int start = enet_time_get(), hits = 0;
+        loopi(shots)
+        {
+            int target = i%players, when = (hitboxhistory::FRAMES/2 + i%8)*hitboxhistory::STEP;
+            vec to(512 + (target%8)*64 + hitboxhistory::FRAMES/2, 512 + (target/8)*64, i&1 ? 560 : 520), from(to.x - 300, to.y + 200, to.z);
+            if(h->checkhit(target, 0, from, to, when, lagcompwindow, 4.1f, 20, lagcompmargin)) hits++;
+        }
+        int elapsed = max(int(enet_time_get()) - start, 1);
+        conoutf("lag compensation: %d shots against %d players in %d ms (%.1f ns/shot, %d hits)", shots, players, elapsed, elapsed*1e6f/shots, hits);
+        delete h;
+    }
+    COMMAND(lagcompbench, "ii");
+
+    void shotevent(clientinfo *ci, const gameevent &e)
     {
         servstate &gs = ci->state;
+        int millis = e.millis, atk = e.atk, id = e.id;
+        const vec &from = e.from, &to = e.to;
         int wait = millis - gs.lastshot;
         if(!gs.isalive(gamemillis) ||
            wait<gs.gunwait ||
@@ -2177,22 +2668,24 @@ namespace server
         gs.ammo[gun] -= attacks[atk].use;
         gs.lastshot = millis;
         gs.gunwait = attacks[atk].attackdelay;
-        sendf(-1, 1, "rii9x", N_SHOTFX, ci->clientnum, atk, id,
-                int(from.x*DMF), int(from.y*DMF), int(from.z*DMF),
-                int(to.x*DMF), int(to.y*DMF), int(to.z*DMF),
-                ci->ownernum);
+        netmsg(-1, 1, ci->ownernum).i(N_SHOTFX).i(ci->clientnum).i(atk).i(id)
+            .i(int(from.x*DMF)).i(int(from.y*DMF)).i(int(from.z*DMF))
+            .i(int(to.x*DMF)).i(int(to.y*DMF)).i(int(to.z*DMF))
+            .send();
         gs.shotdamage += attacks[atk].damage*attacks[atk].rays;
+        SERVERHOOK(HOOK_SHOT, 2, { args[0].setint(ci->clientnum); args[1].setint(atk); });
         switch(atk)
         {
             case ATK_PULSE_SHOOT: gs.projs.add(id); break;
             default:
             {
                 int totalrays = 0, maxrays = attacks[atk].rays;
-                loopv(hits)
+                loopi(e.numhits)
                 {
-                    hitinfo &h = hits[i];
+                    hitinfo &h = ci->eventhits[i];
                     clientinfo *target = getinfo(h.target);
                     if(!target || target->state.state!=CS_ALIVE || h.lifesequence!=target->state.lifesequence || h.rays<1 || h.dist > attacks[atk].range + 1) continue;
+                    if(!checkhitbox(ci, millis, atk, h, from, to)) continue;
 
                     totalrays += h.rays;
                     if(totalrays>maxrays) continue;
@@ -2204,41 +2697,47 @@ namespace server
         }
     }
 
-    void pickupevent::process(clientinfo *ci)
+    void pickupevent(clientinfo *ci, const gameevent &e)
     {
         servstate &gs = ci->state;
         if(m_mp(gamemode) && !gs.isalive(gamemillis)) return;
-        pickup(ent, ci->clientnum);
+        pickup(e.id, ci->clientnum);
     }
 
-    bool gameevent::flush(clientinfo *ci, int fmillis)
+    void processevent(clientinfo *ci, const gameevent &e)
     {
-        process(ci);
-        return true;
+        switch(e.type)
+        {
+            case GE_SHOT: shotevent(ci, e); break;
+            case GE_EXPLODE: explodeevent(ci, e); break;
+            case GE_SUICIDE: suicide(ci); break;
+            case GE_PICKUP: pickupevent(ci, e); break;
+        }
     }
 
-    bool timedevent::flush(clientinfo *ci, int fmillis)
+    bool flushevent(clientinfo *ci, const gameevent &e, int fmillis)
     {
-        if(millis > fmillis) return false;
-        else if(millis >= ci->lastevent)
+        if(!e.timed()) processevent(ci, e);
+        else if(e.millis > fmillis) return false;
+        else if(e.millis >= ci->lastevent)
         {
-            ci->lastevent = millis;
-            process(ci);
+            ci->lastevent = e.millis;
+            processevent(ci, e);
         }
         return true;
     }
 
     void clearevent(clientinfo *ci)
     {
-        delete ci->events.remove(0);
+        gameevent &e = ci->events.remove();
+        loopi(e.numhits) ci->eventhits.remove();
     }
 
     void flushevents(clientinfo *ci, int millis)
     {
         while(ci->events.length())
         {
-            gameevent *ev = ci->events[0];
-            if(ev->flush(ci, millis)) clearevent(ci);
+            if(flushevent(ci, ci->events[0], millis)) clearevent(ci);
             else break;
         }
     }
@@ -2254,25 +2753,65 @@ namespace server
 
     void cleartimedevents(clientinfo *ci)
     {
-        int keep = 0;
+        int keep = 0, keephits = 0, hit = 0;
         loopv(ci->events)
         {
-            if(ci->events[i]->keepable())
+            gameevent &e = ci->events[i];
+            if(e.keepable())
             {
-                if(keep < i)
-                {
-                    for(int j = keep; j < i; j++) delete ci->events[j];
-                    ci->events.remove(keep, i - keep);
-                    i = keep;
-                }
-                keep = i+1;
-                continue;
+                loopj(e.numhits) ci->eventhits[keephits++] = ci->eventhits[hit + j];
+                if(keep < i) ci->events[keep] = e;
+                keep++;
             }
+            hit += e.numhits;
         }
-        while(ci->events.length() > keep) delete ci->events.pop();
+        while(ci->events.length() > keep) ci->events.pop();
+        while(ci->eventhits.length() > keephits) ci->eventhits.pop();
         ci->timesync = false;
     }
 
+    VAR(eventlimit, 0, 1, 1);
+
+    // sustained events per second and burst size per event class
+    static const struct { int rate, burst; } eventlimits[NUMGAMEEVENTS] =
+    {
+        { 10, 20 },     // GE_SHOT
+        { 20, 40 },     // GE_EXPLODE
+        { 2, 4 },       // GE_SUICIDE
+        { 20, 40 }      // GE_PICKUP
+    };
+
+    // returns the slot for a new event, or NULL if the event should be dropped; the caller fills it in and commits it with events.add()
+    gameevent *newevent(clientinfo *ci, int type)
+    {
+        if(ci->state.state==CS_SPECTATOR) return NULL;
+        if(ci->events.full() || (eventlimit && !ci->eventbuckets[type].consume(totalmillis, eventlimits[type].rate, eventlimits[type].burst)))
+        {
+            if(!ci->droppedevents++ && isdedicatedserver()) logoutf("dropping events from %s", colorname(ci));
+            return NULL;
+        }
+        gameevent &e = ci->events.adding();
+        e.type = type;
+        e.millis = e.id = e.atk = e.numhits = 0;
+        return &e;
+    }
+
+    void parsehits(ucharbuf &p, clientinfo *ci, gameevent *e)
+    {
+        int hits = getint(p);
+        loopk(hits)
+        {
+            if(p.overread()) break;
+            hitinfo dummy, *hit = ci ? ci->addhit(e) : NULL;
+            if(!hit) hit = &dummy;
+            hit->target = getint(p);
+            hit->lifesequence = getint(p);
+            hit->dist = getint(p)/DMF;
+            hit->rays = getint(p);
+            loopk(3) hit->dir[k] = getint(p)/DNF;
+        }
+    }
+
     void serverupdate()
     {
         if(shouldstep && !gamepaused)
@@ -2282,6 +2821,8 @@ namespace server
             if(m_demo) readdemo();
             else if(!m_timed || gamemillis < gamelimit)
             {
+                if(curtime) recordhitboxes();
+                updatedemorecord();
                 processevents();
                 if(curtime)
                 {
@@ -2292,7 +2833,7 @@ namespace server
                         {
                             sents[i].spawntime = 0;
                             sents[i].spawned = true;
-                            sendf(-1, 1, "ri2", N_ITEMSPAWN, i);
+                            netmsg(-1, 1).i(N_ITEMSPAWN).i(i).send();
                         }
                     }
                 }
@@ -2301,6 +2842,9 @@ namespace server
             }
         }
 
+        sendmapchunks();
+        senddemochunks();
+
         while(bannedips.length() && bannedips[0].expire-totalmillis <= 0) bannedips.remove(0);
         loopv(connects) if(totalmillis-connects[i]->connectmillis>15000) disconnect_client(connects[i]->clientnum, DISC_TIMEOUT);
 
@@ -2447,6 +2991,7 @@ namespace server
             sendf(-1, 1, "ri2", N_CDIS, n);
             clients.removeobj(ci);
             aiman::removeai(ci);
+            SERVERHOOK(HOOK_DISCONNECT, 1, args[0].setint(n));
             if(!numclients(-1, false, true)) noclients(); // bans clear when server empties
             if(ci->local) checkpausegame();
         }
@@ -2660,16 +3205,133 @@ namespace server
             addgban(val);
     }
 
+    // the map is sent in chunks that are built once and shared by every downloader; each downloader only keeps
+    // a few chunks unacknowledged, so a download neither holds its own copy of the map nor starves the other channels
+    #define MAPCHUNKSIZE (16*1024)
+
+    VAR(mapchunkwindow, 1, 4, 64);
+
+    vector<ENetPacket *> mapchunks;
+
+    int nummapchunks() { return mapdata ? int((mapdata->size() + MAPCHUNKSIZE-1)/MAPCHUNKSIZE) : 0; }
+
+    ENetPacket *getmapchunk(int n)
+    {
+        while(mapchunks.length() <= n) mapchunks.add(NULL);
+        if(!mapchunks[n])
+        {
+            int size = int(mapdata->size()), offset = n*MAPCHUNKSIZE, len = min(MAPCHUNKSIZE, size - offset);
+            packetbuf p(MAXTRANS + len, ENET_PACKET_FLAG_RELIABLE);
+            putint(p, N_MAPCHUNK);
+            putint(p, mapdataid);
+            putint(p, n);
+            putint(p, size);
+            mapdata->seek(offset, SEEK_SET);
+            mapdata->read(p.subbuf(len).buf, len);
+            mapchunks[n] = p.finalize();
+            mapchunks[n]->referenceCount++;
+        }
+        return mapchunks[n];
+    }
+
+    void releasemapchunk(int n)
+    {
+        ENetPacket *&chunk = mapchunks[n];
+        if(chunk && --chunk->referenceCount <= 0) enet_packet_destroy(chunk);
+        chunk = NULL;
+    }
+
+    void clearmapchunks()
+    {
+        loopv(mapchunks) releasemapchunk(i);
+        mapchunks.setsize(0);
+        loopv(clients) if(clients[i]->getmapchunk >= 0)
+        {
+            clients[i]->getmapchunk = -1;
+            sendf(clients[i]->clientnum, 1, "ris", N_SERVMSG, "map download interrupted because the map on the server changed");
+        }
+    }
+
+    void sendmapchunks()
+    {
+        if(!mapdata) return;
+        int numchunks = nummapchunks(), needed = numchunks;
+        loopv(clients)
+        {
+            clientinfo *ci = clients[i];
+            if(ci->getmapchunk < 0) continue;
+            while(ci->getmapchunk < numchunks && getclientbacklog(ci->clientnum) < mapchunkwindow*MAPCHUNKSIZE)
+                sendpacket(ci->clientnum, 2, getmapchunk(ci->getmapchunk++));
+            if(ci->getmapchunk >= numchunks) ci->getmapchunk = -1;
+            else needed = min(needed, ci->getmapchunk);
+        }
+        // chunks behind every downloader are dropped once all peers have acknowledged them, and rebuilt from the file if asked for again
+        loopv(mapchunks)
+        {
+            if(i >= needed) break;
+            if(mapchunks[i] && mapchunks[i]->referenceCount <= 1) releasemapchunk(i);
+        }
+        while(mapchunks.length() && !mapchunks.last()) mapchunks.pop();
+    }
+
+    void senddemochunks()
+    {
+        loopv(clients)
+        {
+            clientinfo *ci = clients[i];
+            if(!ci->getdemo) continue;
+            demofile *d = NULL;
+            loopvj(demos) if(demos[j].id == ci->getdemo) { d = &demos[j]; break; }
+            if(!d)
+            {
+                ci->getdemo = 0;
+                sendf(ci->clientnum, 1, "ris", N_SERVMSG, "demo download interrupted because the demo was cleared");
+                continue;
+            }
+            while(ci->getdemooffset < d->len && getclientbacklog(ci->clientnum) < mapchunkwindow*MAPCHUNKSIZE)
+            {
+                int len = min(MAPCHUNKSIZE, d->len - ci->getdemooffset);
+                packetbuf p(MAXTRANS + len, ENET_PACKET_FLAG_RELIABLE);
+                putint(p, N_SENDDEMO);
+                putint(p, ci->getdemooffset);
+                putint(p, d->len);
+                if(!d->file->seek(ci->getdemooffset, SEEK_SET) || d->file->read(p.subbuf(len).buf, len) != len)
+                {
+                    ci->getdemo = 0;
+                    sendf(ci->clientnum, 1, "ris", N_SERVMSG, "failed to read demo");
+                    break;
+                }
+                sendpacket(ci->clientnum, 2, p.finalize());
+                ci->getdemooffset += len;
+            }
+            if(ci->getdemooffset >= d->len) ci->getdemo = 0;
+        }
+    }
+
+    void getmap(clientinfo *ci, int id, int chunk)
+    {
+        if(!mapdata) { sendf(ci->clientnum, 1, "ris", N_SERVMSG, "no map to send"); return; }
+        if(ci->getmapchunk >= 0) { sendf(ci->clientnum, 1, "ris", N_SERVMSG, "already sending map"); return; }
+        if(id != mapdataid || chunk <= 0 || chunk >= nummapchunks()) chunk = 0;
+        if(chunk) sendservmsgf("[%s is resuming the map download]", colorname(ci));
+        else sendservmsgf("[%s is getting the map]", colorname(ci));
+        ci->getmapchunk = chunk;
+        getmapchunk(chunk);
+        ci->needclipboard = totalmillis ? totalmillis : 1;
+    }
+
     void receivefile(int sender, uchar *data, int len)
     {
         if(!m_edit || len > 4*1024*1024) return;
         clientinfo *ci = getinfo(sender);
         if(ci->state.state==CS_SPECTATOR && !ci->privilege && !ci->local) return;
+        clearmapchunks();
         if(mapdata) DELETEP(mapdata);
         if(!len) return;
         mapdata = opentempfile("mapdata", "w+b");
         if(!mapdata) { sendf(sender, 1, "ris", N_SERVMSG, "failed to open temporary file for map"); return; }
         mapdata->write(data, len);
+        mapdataid = (mapdataid + 1 + rnd(0x10000)) & 0x7FFFFFFF;
         sendservmsgf("[%s sent a map to server, \"/getmap\" to receive it]", colorname(ci));
     }
 
@@ -2716,6 +3378,8 @@ namespace server
         if(m_demo) setupdemoplayback();
 
         if(servermotd[0]) sendf(ci->clientnum, 1, "ris", N_SERVMSG, servermotd);
+
+        SERVERHOOK(HOOK_CONNECT, 1, args[0].setint(ci->clientnum));
     }
 
     void parsepacket(int sender, int chan, packetbuf &p)     // has to parse exactly each byte of the packet
@@ -2833,6 +3497,8 @@ namespace server
                             cp->setexceeded();
                         cp->position.setsize(0);
                         while(curmsg<p.length()) cp->position.add(p.buf[curmsg++]);
+                        cp->posseq = ++worldstateseq;
+                        cp->poshash = memhash(cp->position.getbuf(), cp->position.length());
                     }
                     if(smode && cp->state.state==CS_ALIVE) smode->moved(cp, cp->state.o, cp->gameclip, pos, (flags&0x80)!=0);
                     cp->state.o = pos;
@@ -2894,7 +3560,7 @@ namespace server
                 {
                     ci->state.editstate = ci->state.state;
                     ci->state.state = CS_EDITING;
-                    ci->events.setsize(0);
+                    ci->clearevents();
                     ci->state.projs.reset();
                 }
                 else ci->state.state = ci->state.editstate;
@@ -2971,58 +3637,56 @@ namespace server
 
             case N_SUICIDE:
             {
-                if(cq) cq->addevent(new suicideevent);
+                // coalesced: one pending suicide is enough
+                if(!cq) break;
+                bool pending = false;
+                loopv(cq->events) if(cq->events[i].type==GE_SUICIDE) { pending = true; break; }
+                gameevent *e = pending ? NULL : newevent(cq, GE_SUICIDE);
+                if(e) cq->events.add();
                 break;
             }
 
             case N_SHOOT:
             {
-                shotevent *shot = new shotevent;
-                shot->id = getint(p);
-                shot->millis = cq ? cq->geteventmillis(gamemillis, shot->id) : 0;
-                shot->atk = getint(p);
-                loopk(3) shot->from[k] = getint(p)/DMF;
-                loopk(3) shot->to[k] = getint(p)/DMF;
-                int hits = getint(p);
-                loopk(hits)
+                int id = getint(p);
+                gameevent *e = cq ? newevent(cq, GE_SHOT) : NULL;
+                if(e)
+                {
+                    e->id = id;
+                    e->millis = cq->geteventmillis(gamemillis, id);
+                }
+                int atk = getint(p);
+                vec from, to;
+                loopk(3) from[k] = getint(p)/DMF;
+                loopk(3) to[k] = getint(p)/DMF;
+                if(e)
                 {
-                    if(p.overread()) break;
-                    hitinfo &hit = shot->hits.add();
-                    hit.target = getint(p);
-                    hit.lifesequence = getint(p);
-                    hit.dist = getint(p)/DMF;
-                    hit.rays = getint(p);
-                    loopk(3) hit.dir[k] = getint(p)/DNF;
+                    e->atk = atk;
+                    e->from = from;
+                    e->to = to;
                 }
+                parsehits(p, cq, e);
                 if(cq)
                 {
-                    cq->addevent(shot);
+                    if(e) cq->events.add();
                     cq->setpushed();
                 }
-                else delete shot;
                 break;
             }
 
             case N_EXPLODE:
             {
-                explodeevent *exp = new explodeevent;
                 int cmillis = getint(p);
-                exp->millis = cq ? cq->geteventmillis(gamemillis, cmillis) : 0;
-                exp->atk = getint(p);
-                exp->id = getint(p);
-                int hits = getint(p);
-                loopk(hits)
+                gameevent *e = cq ? newevent(cq, GE_EXPLODE) : NULL;
+                if(e) e->millis = cq->geteventmillis(gamemillis, cmillis);
+                int atk = getint(p), id = getint(p);
+                if(e)
                 {
-                    if(p.overread()) break;
-                    hitinfo &hit = exp->hits.add();
-                    hit.target = getint(p);
-                    hit.lifesequence = getint(p);
-                    hit.dist = getint(p)/DMF;
-                    hit.rays = getint(p);
-                    loopk(3) hit.dir[k] = getint(p)/DNF;
+                    e->atk = atk;
+                    e->id = id;
                 }
-                if(cq) cq->addevent(exp);
-                else delete exp;
+                parsehits(p, cq, e);
+                if(e) cq->events.add();
                 break;
             }
 
@@ -3030,9 +3694,15 @@ namespace server
             {
                 int n = getint(p);
                 if(!cq) break;
-                pickupevent *pickup = new pickupevent;
-                pickup->ent = n;
-                cq->addevent(pickup);
+                // coalesced: repeated requests for the same item while one is pending are dropped
+                bool pending = false;
+                loopv(cq->events) if(cq->events[i].type==GE_PICKUP && cq->events[i].id==n) { pending = true; break; }
+                gameevent *e = pending ? NULL : newevent(cq, GE_PICKUP);
+                if(e)
+                {
+                    e->id = n;
+                    cq->events.add();
+                }
                 break;
             }
 
@@ -3044,6 +3714,7 @@ namespace server
                 filtertext(text, text);
                 QUEUE_STR(text);
                 if(isdedicatedserver() && cq) logoutf("%s: %s", colorname(cq), text);
+                if(cq) SERVERHOOK(HOOK_TEXT, 3, { args[0].setint(cq->clientnum); args[1].setint(0); args[2].setcstr(text); });
                 break;
             }
 
@@ -3058,6 +3729,7 @@ namespace server
                     sendf(t->clientnum, 1, "riis", N_SAYTEAM, cq->clientnum, text);
                 }
                 if(isdedicatedserver() && cq) logoutf("%s <%s>: %s", colorname(cq), teamnames[cq->team], text);
+                SERVERHOOK(HOOK_TEXT, 3, { args[0].setint(cq->clientnum); args[1].setint(cq->team); args[2].setcstr(text); });
                 break;
             }
 
@@ -3313,16 +3985,11 @@ namespace server
             }
 
             case N_GETMAP:
-                if(!mapdata) sendf(sender, 1, "ris", N_SERVMSG, "no map to send");
-                else if(ci->getmap) sendf(sender, 1, "ris", N_SERVMSG, "already sending map");
-                else
-                {
-                    sendservmsgf("[%s is getting the map]", colorname(ci));
-                    if((ci->getmap = sendfile(sender, 2, mapdata, "ri", N_SENDMAP)))
-                        ci->getmap->freeCallback = freegetmap;
-                    ci->needclipboard = totalmillis ? totalmillis : 1;
-                }
+            {
+                int id = getint(p), chunk = getint(p);
+                getmap(ci, id, chunk);
                 break;
+            }
 
             case N_NEWMAP:
             {
@@ -31,6 +31,7 @@ enum
     CODE_LOCAL,
     CODE_DO, CODE_DOARGS,
     CODE_JUMP, CODE_JUMP_TRUE, CODE_JUMP_FALSE, CODE_JUMP_RESULT_TRUE, CODE_JUMP_RESULT_FALSE,
+    CODE_COMV_ARG,
 
     CODE_OP_MASK = 0x3F,
     CODE_RET = 6,
@@ -45,9 +46,16 @@ enum
 
 enum { ID_VAR, ID_FVAR, ID_SVAR, ID_COMMAND, ID_ALIAS, ID_LOCAL, ID_DO, ID_DOARGS, ID_IF, ID_RESULT, ID_NOT, ID_AND, ID_OR };
 
-enum { IDF_PERSIST = 1<<0, IDF_OVERRIDE = 1<<1, IDF_HEX = 1<<2, IDF_READONLY = 1<<3, IDF_OVERRIDDEN = 1<<4, IDF_UNKNOWN = 1<<5, IDF_ARG = 1<<6 };
+enum { IDF_PERSIST = 1<<0, IDF_OVERRIDE = 1<<1, IDF_HEX = 1<<2, IDF_READONLY = 1<<3, IDF_OVERRIDDEN = 1<<4, IDF_UNKNOWN = 1<<5, IDF_ARG = 1<<6, IDF_PURE = 1<<7 };
 
 struct ident;
+struct parsedlist;
+
+// VAL_STR values are either heap strings or short strings owned by the script VM, so free them with freescriptstr
+extern char *newscriptstr(const char *s);
+extern char *newscriptstr(const char *s, size_t len);
+extern char *intscriptstr(int v);
+extern void freescriptstr(char *s);
 
 struct identval
 {
@@ -132,7 +140,11 @@ struct ident
         identstack *stack;    // ID_ALIAS
         uint argmask;         // ID_COMMAND
     };
-    identfun fun; // ID_VAR, ID_FVAR, ID_SVAR, ID_COMMAND
+    union
+    {
+        identfun fun;      // ID_VAR, ID_FVAR, ID_SVAR, ID_COMMAND
+        parsedlist *list;  // ID_ALIAS
+    };
     int flags, index;
 
     ident() {}
@@ -150,26 +162,26 @@ struct ident
     { storage.s = s; }
     // ID_ALIAS
     ident(int t, const char *n, char *a, int flags)
-        : type(t), name(n), valtype(VAL_STR), code(NULL), stack(NULL), flags(flags)
+        : type(t), name(n), valtype(VAL_STR), code(NULL), stack(NULL), list(NULL), flags(flags)
     { val.s = a; }
     ident(int t, const char *n, int a, int flags)
-        : type(t), name(n), valtype(VAL_INT), code(NULL), stack(NULL), flags(flags)
+        : type(t), name(n), valtype(VAL_INT), code(NULL), stack(NULL), list(NULL), flags(flags)
     { val.i = a; }
     ident(int t, const char *n, float a, int flags)
-        : type(t), name(n), valtype(VAL_FLOAT), code(NULL), stack(NULL), flags(flags)
+        : type(t), name(n), valtype(VAL_FLOAT), code(NULL), stack(NULL), list(NULL), flags(flags)
     { val.f = a; }
     ident(int t, const char *n, int flags)
-        : type(t), name(n), valtype(VAL_NULL), code(NULL), stack(NULL), flags(flags)
+        : type(t), name(n), valtype(VAL_NULL), code(NULL), stack(NULL), list(NULL), flags(flags)
     {}
     ident(int t, const char *n, const tagval &v, int flags)
-        : type(t), name(n), valtype(v.type), code(NULL), stack(NULL), flags(flags)
+        : type(t), name(n), valtype(v.type), code(NULL), stack(NULL), list(NULL), flags(flags)
     { val = v; }
     // ID_COMMAND
     ident(int t, const char *n, const char *args, uint argmask, int numargs, void *f = NULL, int flags = 0)
         : type(t), name(n), numargs(numargs), args(args), argmask(argmask), fun((identfun)f), flags(flags)
     {}
 
-    void changed() { if(fun) fun(this); }
+    void changed();
 
     void setval(const tagval &v)
     {
@@ -185,7 +197,7 @@ struct ident
 
     void forcenull()
     {
-        if(valtype==VAL_STR) delete[] val.s;
+        if(valtype==VAL_STR) freescriptstr(val.s);
         valtype = VAL_NULL;
     }
 
@@ -200,6 +212,16 @@ struct ident
 
 extern void addident(ident *id);
 
+extern int scriptprof;
+extern void profchanged(ident *id);
+
+inline void ident::changed()
+{
+    if(!fun) return;
+    if(scriptprof) profchanged(this);
+    else fun(this);
+}
+
 extern tagval *commandret;
 extern const char *intstr(int v);
 extern void intret(int v);
@@ -270,7 +292,7 @@ static inline void getval(const identval &v, int type, tagval &r)
 {
     switch(type)
     {
-        case VAL_STR: case VAL_MACRO: case VAL_CSTR: r.setstr(newstring(v.s)); break;
+        case VAL_STR: case VAL_MACRO: case VAL_CSTR: r.setstr(newscriptstr(v.s)); break;
         case VAL_INT: r.setint(v.i); break;
         case VAL_FLOAT: r.setfloat(v.f); break;
         default: r.setnull(); break;
@@ -286,8 +308,8 @@ inline void ident::getcstr(tagval &v) const
     {
         case VAL_MACRO: v.setmacro(val.code); break;
         case VAL_STR: case VAL_CSTR: v.setcstr(val.s); break;
-        case VAL_INT: v.setstr(newstring(intstr(val.i))); break;
-        case VAL_FLOAT: v.setstr(newstring(floatstr(val.f))); break;
+        case VAL_INT: v.setstr(intscriptstr(val.i)); break;
+        case VAL_FLOAT: v.setstr(newscriptstr(floatstr(val.f))); break;
         default: v.setcstr(""); break;
     }
 }
@@ -374,8 +396,9 @@ inline void ident::getcval(tagval &v) const
 // anonymous inline commands, uses nasty template trick with line numbers to keep names unique
 #define ICOMMANDNAME(name) _icmd_##name
 #define ICOMMANDSNAME _icmds_
-#define ICOMMANDKNS(name, type, cmdname, nargs, proto, b) template<int N> struct cmdname; template<> struct cmdname<__LINE__> { static bool init; static void run proto; }; bool cmdname<__LINE__>::init = addcommand(name, (identfun)cmdname<__LINE__>::run, nargs, type); void cmdname<__LINE__>::run proto \
+#define ICOMMANDKNSF(name, type, flags, cmdname, nargs, proto, b) template<int N> struct cmdname; template<> struct cmdname<__LINE__> { static bool init; static void run proto; }; bool cmdname<__LINE__>::init = addcommand(name, (identfun)cmdname<__LINE__>::run, nargs, type, flags); void cmdname<__LINE__>::run proto \
     { b; }
+#define ICOMMANDKNS(name, type, cmdname, nargs, proto, b) ICOMMANDKNSF(name, type, 0, cmdname, nargs, proto, b)
 #define ICOMMANDKN(name, type, cmdname, nargs, proto, b) ICOMMANDKNS(#name, type, cmdname, nargs, proto, b)
 #define ICOMMANDK(name, type, nargs, proto, b) ICOMMANDKN(name, type, ICOMMANDNAME(name), nargs, proto, b)
 #define ICOMMANDKS(name, type, nargs, proto, b) ICOMMANDKNS(name, type, ICOMMANDSNAME, nargs, proto, b)
@@ -383,4 +406,7 @@ inline void ident::getcval(tagval &v) const
 #define ICOMMANDN(name, cmdname, nargs, proto, b) ICOMMANDNS(#name, cmdname, nargs, proto, b)
 #define ICOMMAND(name, nargs, proto, b) ICOMMANDN(name, ICOMMANDNAME(name), nargs, proto, b)
 #define ICOMMANDS(name, nargs, proto, b) ICOMMANDNS(name, ICOMMANDSNAME, nargs, proto, b)
+// pure builtins depend only on their arguments, so calls with constant arguments are folded at compile time
+#define ICOMMANDP(name, nargs, proto, b) ICOMMANDKNSF(#name, ID_COMMAND, IDF_PURE, ICOMMANDNAME(name), nargs, proto, b)
+#define ICOMMANDPS(name, nargs, proto, b) ICOMMANDKNSF(name, ID_COMMAND, IDF_PURE, ICOMMANDSNAME, nargs, proto, b)
 
@@ -761,6 +761,57 @@ struct ecjacobian
     }
     template<int Q_DIGITS> void mul(const bigint<Q_DIGITS> &q) { ecjacobian tmp(*this); mul(tmp, q); }
 
+    /* Windowed NAF multiplication for arbitrary points: only odd multiples up to 2^(WNAF_WIDTH-1) are precomputed,
+     * and negative digits reuse them with y negated, so about one addition is done per WNAF_WIDTH+1 bits.
+     */
+    #define WNAF_WIDTH 5
+    #define WNAF_POINTS (1<<(WNAF_WIDTH-2))
+
+    template<int Q_DIGITS> static int wnaf(const bigint<Q_DIGITS> &q, signed char *naf)
+    {
+        bigint<Q_DIGITS+1> k(q);
+        int n = 0;
+        while(!k.iszero())
+        {
+            int d = 0;
+            if(k.hasbit(0))
+            {
+                d = k.digits[0] & ((1<<WNAF_WIDTH)-1);
+                if(d >= 1<<(WNAF_WIDTH-1)) { d -= 1<<WNAF_WIDTH; k.add(bigint<1>(ushort(-d))); }
+                else k.sub(bigint<1>(ushort(d)));
+            }
+            naf[n++] = d;
+            k.rshift(1);
+        }
+        return n;
+    }
+
+    template<int Q_DIGITS> void mulwnaf(const ecjacobian &p, const bigint<Q_DIGITS> &q)
+    {
+        signed char naf[Q_DIGITS*BI_DIGIT_BITS+1];
+        int n = wnaf(q, naf);
+        ecjacobian odd[WNAF_POINTS], twice(p);
+        odd[0] = p;
+        twice.mul2();
+        for(int i = 1; i < WNAF_POINTS; i++) { odd[i] = odd[i-1]; odd[i].add(twice); }
+        *this = origin;
+        for(int i = n-1; i >= 0; i--)
+        {
+            mul2();
+            int d = naf[i];
+            if(d > 0) add(odd[d>>1]);
+            else if(d < 0)
+            {
+                ecjacobian neg(odd[(-d)>>1]);
+                neg.y.neg();
+                add(neg);
+            }
+        }
+    }
+    template<int Q_DIGITS> void mulwnaf(const bigint<Q_DIGITS> &q) { ecjacobian tmp(*this); mulwnaf(tmp, q); }
+
+    template<int Q_DIGITS> void mulbase(const bigint<Q_DIGITS> &q);
+
     void normalize()
     {
         if(z.iszero() || z.isone()) return;
@@ -838,6 +889,49 @@ const ecjacobian ecjacobian::base(
 #error Unsupported GF
 #endif
 
+/* Fixed-base comb multiplication for the generator: the scalar is split into COMB_WIDTH rows of COMB_SPACING bits,
+ * and each column of bits indexes a table of normalized sums of base*2^(row*COMB_SPACING), so a multiplication
+ * only needs COMB_SPACING doublings and mixed additions.
+ */
+#define COMB_WIDTH 8
+#define COMB_SPACING ((GF_BITS+COMB_WIDTH-1)/COMB_WIDTH)
+
+static ecjacobian *combtable = NULL;
+
+static void gencombtable()
+{
+    combtable = new ecjacobian[1<<COMB_WIDTH];
+    combtable[0] = ecjacobian::origin;
+    ecjacobian row(ecjacobian::base);
+    loopi(COMB_WIDTH)
+    {
+        if(i) loopj(COMB_SPACING) row.mul2();
+        row.normalize();
+        int bit = 1<<i;
+        combtable[bit] = row;
+        for(int j = 1; j < bit; j++)
+        {
+            combtable[bit+j] = combtable[j];
+            combtable[bit+j].add(row);
+            combtable[bit+j].normalize();
+        }
+    }
+}
+
+template<int Q_DIGITS> void ecjacobian::mulbase(const bigint<Q_DIGITS> &q)
+{
+    if(q.numbits() > COMB_WIDTH*COMB_SPACING) { mul(base, q); return; }
+    if(!combtable) gencombtable();
+    *this = origin;
+    for(int i = COMB_SPACING-1; i >= 0; i--)
+    {
+        mul2();
+        int column = 0;
+        loopj(COMB_WIDTH) if(q.hasbit(j*COMB_SPACING + i)) column |= 1<<j;
+        if(column) add(combtable[column]);
+    }
+}
+
 void genprivkey(const char *seed, vector<char> &privstr, vector<char> &pubstr)
 {
     tiger::hashval hash;
@@ -849,8 +943,8 @@ void genprivkey(const char *seed, vector<char> &privstr, vector<char> &pubstr)
     privkey.printdigits(privstr);
     privstr.add('\0');
 
-    ecjacobian c(ecjacobian::base);
-    c.mul(privkey);
+    ecjacobian c;
+    c.mulbase(privkey);
     c.normalize();
     c.print(pubstr);
     pubstr.add('\0');
@@ -877,12 +971,19 @@ void answerchallenge(const char *privstr, const char *challenge, vector<char> &a
     privkey.parse(privstr);
     ecjacobian answer;
     answer.parse(challenge);
-    answer.mul(privkey);
+    answer.mulwnaf(privkey);
     answer.normalize();
     answer.x.printdigits(answerstr);
     answerstr.add('\0');
 }
 
+void initchallenges()
+{
+    tiger::hashval hash;
+    tiger::hash((const uchar *)"", 0, hash);
+    if(!combtable) gencombtable();
+}
+
 void *parsepubkey(const char *pubstr)
 {
     ecjacobian *pubkey = new ecjacobian;
@@ -904,12 +1005,12 @@ void *genchallenge(void *pubkey, const void *seed, int seedlen, vector<char> &ch
     challenge.len = 8*sizeof(hash.bytes)/BI_DIGIT_BITS;
     challenge.shrink();
 
-    ecjacobian answer(*(ecjacobian *)pubkey);
-    answer.mul(challenge);
+    ecjacobian answer;
+    answer.mulwnaf(*(ecjacobian *)pubkey, challenge);
     answer.normalize();
 
-    ecjacobian secret(ecjacobian::base);
-    secret.mul(challenge);
+    ecjacobian secret;
+    secret.mulbase(challenge);
     secret.normalize();
 
     secret.print(challengestr);
@@ -929,3 +1030,47 @@ bool checkchallenge(const char *answerstr, void *correct)
     return answer == *(gfint *)correct;
 }
 
+
+void authbench(int *numchallenges)
+{
+    int n = *numchallenges > 0 ? *numchallenges : 1000;
+    vector<char> privkey, pubkey;
+    genprivkey("authbench", privkey, pubkey);
+    ecjacobian pub;
+    pub.parse(pubkey.getbuf());
+    gfint challenges[16];
+    loopi(16)
+    {
+        tiger::hashval hash;
+        tiger::hash((const uchar *)&i, sizeof(i), hash);
+        memcpy(challenges[i].digits, hash.bytes, sizeof(hash.bytes));
+        challenges[i].len = 8*sizeof(hash.bytes)/BI_DIGIT_BITS;
+        challenges[i].shrink();
+    }
+    int mismatches = 0, elapsed[2];
+    loopk(2)
+    {
+        int start = enet_time_get();
+        loopi(n)
+        {
+            const gfint &challenge = challenges[i%16];
+            ecjacobian answer, secret;
+            if(k) { answer.mulwnaf(pub, challenge); secret.mulbase(challenge); }
+            else { answer.mul(pub, challenge); secret.mul(ecjacobian::base, challenge); }
+            answer.normalize();
+            secret.normalize();
+            if(k && i < 16)
+            {
+                ecjacobian refanswer, refsecret;
+                refanswer.mul(pub, challenge);
+                refsecret.mul(ecjacobian::base, challenge);
+                refanswer.normalize();
+                refsecret.normalize();
+                if(answer.x != refanswer.x || secret.x != refsecret.x || secret.y != refsecret.y) mismatches++;
+            }
+        }
+        elapsed[k] = max(int(enet_time_get()) - start, 1);
+    }
+    conoutf("auth: %d challenges, %.0f/sec with double-and-add, %.0f/sec with comb/wnaf, %d mismatches", n, n*1000.0f/elapsed[0], n*1000.0f/elapsed[1], mismatches);
+}
+COMMAND(authbench, "i");
@@ -126,7 +126,7 @@ extern ident *getident(const char *name);
 extern ident *newident(const char *name, int flags = 0);
 extern ident *readident(const char *name);
 extern ident *writeident(const char *name, int flags = 0);
-extern bool addcommand(const char *name, identfun fun, const char *narg, int type = ID_COMMAND);
+extern bool addcommand(const char *name, identfun fun, const char *narg, int type = ID_COMMAND, int flags = 0);
 extern uint *compilecode(const char *p);
 extern void keepcode(uint *p);
 extern void freecode(uint *p);
@@ -150,6 +150,8 @@ extern bool executebool(const char *p);
 extern bool executebool(ident *id, tagval *args, int numargs, bool lookup = false);
 extern bool execidentbool(const char *name, bool noid = false, bool lookup = false);
 extern bool execfile(const char *cfgfile, bool msg = true);
+extern void printcfgstats();
+extern void dumpscriptprof();
 extern void alias(const char *name, const char *action);
 extern void alias(const char *name, tagval &v);
 extern const char *getalias(const char *name);
@@ -450,9 +452,36 @@ enum { DISC_NONE = 0, DISC_EOP, DISC_LOCAL, DISC_KICK, DISC_MSGERR, DISC_IPBAN,
 
 extern void *getclientinfo(int i);
 extern ENetPeer *getclientpeer(int i);
+extern int getclientbacklog(int i);
 extern ENetPacket *sendf(int cn, int chan, const char *format, ...);
 extern ENetPacket *sendfile(int cn, int chan, stream *file, const char *format = "", ...);
 extern void sendpacket(int cn, int chan, ENetPacket *packet, int exclude = -1);
+extern uchar *newmessagebuf();
+extern void freemessagebuf(uchar *buf);
+extern void sendmessage(int cn, int chan, const uchar *data, int len, int exclude = -1);
+
+// typed builder for hot reliable messages, written into a pooled buffer and batched without a packet of its own:
+// netmsg(-1, 1).i(N_DAMAGE).i(target).i(actor).i(damage).i(health).send();
+struct netmsg
+{
+    ucharbuf p;
+    int cn, chan, exclude;
+
+    netmsg(int cn, int chan, int exclude = -1) : p(newmessagebuf(), MAXTRANS), cn(cn), chan(chan), exclude(exclude) {}
+    ~netmsg() { if(p.buf) freemessagebuf(p.buf); }
+
+    netmsg &i(int n) { putint(p, n); return *this; }
+    netmsg &u(uint n) { putuint(p, n); return *this; }
+    netmsg &f(float n) { putfloat(p, n); return *this; }
+    netmsg &s(const char *str) { sendstring(str, p); return *this; }
+
+    void send()
+    {
+        sendmessage(cn, chan, p.buf, p.len, exclude);
+        freemessagebuf(p.buf);
+        p.buf = NULL;
+    }
+};
 extern void flushserver(bool force);
 extern int getservermtu();
 extern int getnumclients();
@@ -511,6 +540,7 @@ extern bool hashstring(const char *str, char *result, int maxlen);
 extern void answerchallenge(const char *privstr, const char *challenge, vector<char> &answerstr);
 extern void *parsepubkey(const char *pubstr);
 extern void freepubkey(void *pubkey);
+extern void initchallenges();
 extern void *genchallenge(void *pubkey, const void *seed, int seedlen, vector<char> &challengestr);
 extern void freechallenge(void *answer);
 extern bool checkchallenge(const char *answerstr, void *correct);
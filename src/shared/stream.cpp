@@ -225,10 +225,14 @@ done:
 
 #ifdef WIN32
 #include <shlobj.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #else
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #endif
 
@@ -351,6 +355,20 @@ bool createdir(const char *path)
 #endif
 }
 
+// modification time of a file on disk, or 0 if it only exists in a zip package
+llong getfilemtime(const char *filename)
+{
+    const char *found = findfile(filename, "rb");
+#ifdef WIN32
+    struct _stat st;
+    if(_stat(found, &st) < 0) return 0;
+#else
+    struct stat st;
+    if(stat(found, &st) < 0) return 0;
+#endif
+    return llong(st.st_mtime);
+}
+
 size_t fixpackagedir(char *dir)
 {
     path(dir);
@@ -680,6 +698,50 @@ struct filestream : stream
     }
 };
 
+struct memstream : stream
+{
+    const uchar *buf;
+    offset len, pos;
+
+    memstream() : buf(NULL), len(0), pos(0) {}
+    ~memstream() { close(); }
+
+    void open(const void *data, offset size)
+    {
+        buf = (const uchar *)data;
+        len = size;
+        pos = 0;
+    }
+
+    void close() { buf = NULL; len = pos = 0; }
+
+    bool end() { return pos >= len; }
+    offset tell() { return pos; }
+    offset size() { return len; }
+    bool seek(offset newpos, int whence)
+    {
+        switch(whence)
+        {
+            case SEEK_SET: break;
+            case SEEK_CUR: newpos += pos; break;
+            case SEEK_END: newpos += len; break;
+            default: return false;
+        }
+        if(newpos < 0 || newpos > len) return false;
+        pos = newpos;
+        return true;
+    }
+
+    int read(void *dst, int n)
+    {
+        n = int(min(offset(max(n, 0)), len - pos));
+        memcpy(dst, &buf[pos], n);
+        pos += n;
+        return n;
+    }
+    int getchar() { return pos < len ? buf[pos++] : -1; }
+};
+
 #ifndef STANDALONE
 VAR(dbggz, 0, 0, 1);
 #endif
@@ -707,11 +769,11 @@ struct gzstream : stream
     stream *file;
     z_stream zfile;
     uchar *buf;
-    bool reading, writing, autoclose;
+    bool reading, writing, autoclose, partialcrc;
     uint crc;
     int headersize;
 
-    gzstream() : file(NULL), buf(NULL), reading(false), writing(false), autoclose(false), crc(0), headersize(0)
+    gzstream() : file(NULL), buf(NULL), reading(false), writing(false), autoclose(false), partialcrc(false), crc(0), headersize(0)
     {
         zfile.zalloc = NULL;
         zfile.zfree = NULL;
@@ -798,6 +860,7 @@ struct gzstream : stream
         autoclose = needclose;
         file = f;
         crc = crc32(0, NULL, 0);
+        partialcrc = false;
         buf = new uchar[BUFSIZE];
 
         if(reading)
@@ -819,7 +882,8 @@ struct gzstream : stream
             uint checkcrc = 0, checksize = 0;
             loopi(4) checkcrc |= uint(readbyte()) << (i*8);
             loopi(4) checksize |= uint(readbyte()) << (i*8);
-            if(checkcrc != crc)
+            // after a seeksync the crc only covers the data since the sync point, so it can't match the trailer
+            if(checkcrc != crc && !partialcrc)
                 conoutf(CON_DEBUG, "gzip crc check failed: read %X, calculated %X", checkcrc, crc);
             if(checksize != zfile.total_out)
                 conoutf(CON_DEBUG, "gzip size check failed: read %u, calculated %u", checksize, uint(zfile.total_out));
@@ -912,6 +976,7 @@ struct gzstream : stream
             }
             inflateReset(&zfile);
             crc = crc32(0, NULL, 0);
+            partialcrc = false;
         }
 
         uchar skip[512];
@@ -957,6 +1022,37 @@ struct gzstream : stream
         return true;
     }
 
+    // flushes all pending output so that decompression can restart from the returned raw offset
+    offset syncpoint()
+    {
+        if(!writing) return -1;
+        zfile.avail_in = 0;
+        for(;;)
+        {
+            if(!zfile.avail_out && !flush()) { stopwriting(); return -1; }
+            int err = deflate(&zfile, Z_FULL_FLUSH);
+            if(err != Z_OK && err != Z_BUF_ERROR) { stopwriting(); return -1; }
+            if(zfile.avail_out > 0) break;
+        }
+        if(!flush()) { stopwriting(); return -1; }
+        return file->tell();
+    }
+
+    bool seeksync(offset rawpos, offset pos)
+    {
+        if(writing || !file || !file->seek(rawpos, SEEK_SET)) return false;
+        if(reading) inflateReset(&zfile);
+        else if(inflateInit2(&zfile, -MAX_WBITS) == Z_OK) reading = true;
+        else return false;
+        zfile.next_in = NULL;
+        zfile.avail_in = 0;
+        zfile.total_in = rawpos - headersize;
+        zfile.total_out = pos;
+        crc = crc32(0, NULL, 0);
+        partialcrc = true;
+        return true;
+    }
+
     int write(const void *buf, int len)
     {
         if(!writing || !buf || !len) return 0;
@@ -1152,6 +1248,13 @@ stream *openrawfile(const char *filename, const char *mode)
     return file;
 }
 
+stream *openmemstream(const void *buf, size_t len)
+{
+    memstream *mem = new memstream;
+    mem->open(buf, stream::offset(len));
+    return mem;
+}
+
 stream *openfile(const char *filename, const char *mode)
 {
 #ifndef STANDALONE
@@ -1211,3 +1314,48 @@ char *loadfile(const char *fn, int *size, bool utf8)
     return buf;
 }
 
+void *mapfile(const char *fn, size_t &size)
+{
+    const char *found = findfile(fn, "rb");
+    if(!found) return NULL;
+    void *buf = NULL;
+#ifdef WIN32
+    HANDLE file = CreateFile(found, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER len;
+    if(GetFileSizeEx(file, &len) && len.QuadPart > 0 && !len.HighPart)
+    {
+        HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(mapping)
+        {
+            buf = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if(buf) size = size_t(len.QuadPart);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(found, O_RDONLY);
+    if(fd < 0) return NULL;
+    struct stat st;
+    if(fstat(fd, &st) >= 0 && st.st_size > 0)
+    {
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(buf == MAP_FAILED) buf = NULL;
+        else size = size_t(st.st_size);
+    }
+    close(fd);
+#endif
+    return buf;
+}
+
+void unmapfile(void *buf, size_t size)
+{
+    if(!buf) return;
+#ifdef WIN32
+    UnmapViewOfFile(buf);
+#else
+    munmap(buf, size);
+#endif
+}
+
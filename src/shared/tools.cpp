@@ -22,6 +22,9 @@ void operator delete[](void *p) { if(p) free(p); }
 
 ////////////////////////// strings ////////////////////////////////////////
 
+bool countnewstrings = false; // only set while the script profiler is on
+THREADLOCAL uint numnewstrings = 0; // per thread, so the script profiler only sees the allocations of the main thread
+
 static string tmpstr[4];
 static int tmpidx = 0;
 
@@ -76,6 +79,23 @@ uint randomMT()
 #undef M
 #undef K
 
+////////////////////////// timers ////////////////////////////////////////
+
+ullong getmicroseconds()
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq = { 0 };
+    if(!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return ullong(t.QuadPart/freq.QuadPart)*1000000 + ullong(t.QuadPart%freq.QuadPart)*1000000/freq.QuadPart;
+#else
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ullong(t.tv_sec)*1000000 + t.tv_nsec/1000;
+#endif
+}
+
 ///////////////////////// network ///////////////////////
 
 // all network traffic is in 32bit ints, which are then compressed using the following simple scheme (assumes that most values are small).